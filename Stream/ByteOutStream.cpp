@@ -1,4 +1,4 @@
-#include "byteoutstream.h"
+#include "ByteOutStream.h"
 #include <string>
 
 endian byteoutstream::get_endian() {
@@ -11,6 +11,7 @@ void byteoutstream::seek_beg(uint64 pos) {
 }
 
 void byteoutstream::set_endian(endian e) {
+	if (!(e == endian_little || e == endian_big))return;
 	this->order = e;
 }
 
@@ -29,7 +30,7 @@ byteoutstream::~byteoutstream() {
 }
 
 void byteoutstream::write(const uint8* buf, uint32 size) {
-	if (this->position + size > this->size)this->grow(this->size + size);
+	if (this->position + size > this->size)this->grow(this->position + size);
 	this->buf += this->position;
 	memcpy(this->buf, buf, size);
 	this->buf -= this->position;
@@ -39,29 +40,45 @@ void byteoutstream::write(const uint8* buf, uint32 size) {
 
 void byteoutstream::write_int(uint8 width, uint64 val) {
 	if (width % 8 != 0)return;
-	int bytes = width / 8;
-	uint8* buffer = (uint8*)malloc(bytes);
-	if (!buffer)throw "out of memory";
-	if (this->order == LITTLE_ENDIAN) {
-		for (int i = 0; i < bytes; i++) {
-			buffer[i] = (uint64)val >> ((uint64)i << (uint64)3);
-		}
+	bool le = this->order == endian_little;
+	switch (width) {
+	case 8:
+		write_fixed<endian_little>((uint8)val);
+		return;
+	case 16:
+		if (le) write_fixed<endian_little>((uint16)val); else write_fixed<endian_big>((uint16)val);
+		return;
+	case 32:
+		if (le) write_fixed<endian_little>((uint32)val); else write_fixed<endian_big>((uint32)val);
+		return;
+	case 64:
+		if (le) write_fixed<endian_little>(val); else write_fixed<endian_big>(val);
+		return;
+	default:
+		break;
 	}
-	else {
-		uint64 mask = 0xFF << ((bytes-1) * 8);
-		for (int i = 0; i < bytes; i++) {
-			buffer[i] = (val & mask) >> ((bytes-i-1) * 8);
-			mask >>= 8;
-		}
+	int bytes = width / 8;
+	if (bytes > 8)return;
+	uint8 buffer[8];
+	for (int i = 0; i < bytes; i++) {
+		if (le)
+			buffer[i] = (uint8)(val >> (i * 8));
+		else
+			buffer[i] = (uint8)(val >> ((bytes - i - 1) * 8));
 	}
 	this->write(buffer, bytes);
-	free(buffer);
 }
 
+//size stays the logical end of the stream, the buffer grows geometrically behind it
 void byteoutstream::grow(uint64 dest_size) {
-	uint8* tmp = (uint8*)realloc(this->buf, dest_size);
-	if (!tmp)throw "out of memory";
-	this->buf = tmp;
+	if (dest_size > this->capacity) {
+		uint64 cap = this->capacity * 2;
+		if (cap < dest_size)cap = dest_size < 64 ? 64 : dest_size;
+		uint8* tmp = (uint8*)realloc(this->buf, cap);
+		if (!tmp)throw "out of memory";
+		this->buf = tmp;
+		this->capacity = cap;
+	}
 	this->size = dest_size;
 }
 
@@ -76,8 +93,9 @@ void byteoutstream::seek_end(uint64 pos) {
 }
 
 byteoutstream::byteoutstream(uint32 s) {
-	this->order = LITTLE_ENDIAN;
+	this->order = endian_little;
 	this->size = s;
+	this->capacity = s;
 	this->v = true;
 	this->mark = 0;
 	this->position = 0;
@@ -88,8 +106,9 @@ byteoutstream::byteoutstream(uint32 s) {
 byteoutstream::byteoutstream() {
 	this->position = 0;
 	this->buf = NULL;
-	this->order = LITTLE_ENDIAN;
+	this->order = endian_little;
 	this->size = 0;
+	this->capacity = 0;
 	this->v = true;
 	this->mark = 0;
 	this->b = false;
@@ -124,12 +143,12 @@ uint8* byteoutstream::get_buffer() {
 	return this->buf;
 }
 
-byteoutstream::byteoutstream(uint8* b, uint64 z) {
-	this->byteoutstream::byteoutstream();
+byteoutstream::byteoutstream(uint8* b, uint64 z) : byteoutstream() {
 	if (!b) {
 		this->v = 0;
 		return;
 	}
 	this->buf = b;
 	this->size = z;
+	this->capacity = z;
 }
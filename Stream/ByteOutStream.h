@@ -13,7 +13,7 @@ public:
 	uint64 get_stream_size();
 	endian get_endian();
 	uint64 get_mark();
-	void set_endian(endian e);
+	void set_endian(endian e);//endian_little or endian_big
 	void keep_buffer(bool b);
 	void mark_pos(uint64 pos);
 	void seek_beg(uint64 pos);
@@ -25,10 +25,79 @@ public:
 	void write_int(uint8 width,uint64 val);
 	bool valid();
 	uint64 get_position();
+
+	template<endian E, class T>
+	inline void write_fixed(T val) {
+		val = to_endian<E>(val);
+		this->write((const uint8*)&val, sizeof(T));
+	}
+
+	template<class T>
+	inline void write_be(T val) {
+		write_fixed<endian_big>(val);
+	}
+
+	template<class T>
+	inline void write_le(T val) {
+		write_fixed<endian_little>(val);
+	}
+
+	//bulk write of count values, swapped through a small stack buffer when E isnt the host order
+	template<endian E, class T>
+	inline void write_array(const T* in, uint32 count) {
+		if constexpr (E == endian_native || sizeof(T) == 1) {
+			this->write((const uint8*)in, count * (uint32)sizeof(T));
+		}
+		else {
+			T tmp[256];
+			while (count) {
+				uint32 n = count > 256 ? 256 : count;
+				for (uint32 i = 0; i < n; i++)
+					tmp[i] = byteswap(in[i]);
+				this->write((const uint8*)tmp, n * (uint32)sizeof(T));
+				in += n;
+				count -= n;
+			}
+		}
+	}
+	template<class T>
+	inline void write_varuint(T val) {
+		static_assert(std::is_unsigned<T>::value, "varints are encoded unsigned, zigzag on top for signed");
+		uint8 tmp[10];
+		int n = 0;
+		while (val >= 0x80) {
+			tmp[n++] = (uint8)val | 0x80;
+			val >>= 7;
+		}
+		tmp[n++] = (uint8)val;
+		this->write(tmp, n);
+	}
+
+	//encodes through a stack buffer so a whole array costs a handful of write calls
+	template<class T>
+	inline void write_varuint_array(const T* in, uint32 count) {
+		uint8 tmp[2560];
+		uint32 n = 0;
+		for (uint32 i = 0; i < count; i++) {
+			if (n > sizeof(tmp) - 10) {
+				this->write(tmp, n);
+				n = 0;
+			}
+			T val = in[i];
+			while (val >= 0x80) {
+				tmp[n++] = (uint8)val | 0x80;
+				val >>= 7;
+			}
+			tmp[n++] = (uint8)val;
+		}
+		if (n)
+			this->write(tmp, n);
+	}
 protected:
 	uint8* buf;
 	uint64 mark;
 	uint64 size;
+	uint64 capacity;
 	uint64 position;
 	endian order;
 	bool v;
@@ -1,4 +1,4 @@
-#include "bytestream.h"
+#include "ByteStream.h"
 #include <cstring>
 #include <stdlib.h>
 #include "ByteOutStream.h"
@@ -46,9 +46,9 @@ uint8* bytestream::read(uint32 size) {
 }
 
 uint8 bytestream::read() {
-	static uint8 buf = 0;
-	read_to(&buf, 1);
-	return buf;
+	uint8 b;
+	read_to(&b, 1);
+	return b;
 }
 
 unsigned char* bytestream::read_string() {
@@ -80,24 +80,30 @@ unsigned char* bytestream::read_string(uint32 size) {
 
 uint64 bytestream::read_int(uint8 width) {
 	if (width % 8 != 0)throw "bad int width, has to be a multiple of 8";
+	bool le = this->order == endian_little;
+	switch (width) {
+	case 8:
+		return read_fixed<endian_little, uint8>();
+	case 16:
+		return le ? read_fixed<endian_little, uint16>() : read_fixed<endian_big, uint16>();
+	case 32:
+		return le ? read_fixed<endian_little, uint32>() : read_fixed<endian_big, uint32>();
+	case 64:
+		return le ? read_fixed<endian_little, uint64>() : read_fixed<endian_big, uint64>();
+	default:
+		break;
+	}
 	uint64 ret = 0;
 	width /= 8;
-	uint8* buff = this->read(width);
-	if (!buff)return NULL;
-	if (this->order == LITTLE_ENDIAN) {
-		int x = 0;
-		for (int i = 0; i < width; i++) {
-			ret |= ((uint64)buff[x] << ((uint64)i << (uint64)3));
-			x++;
-		}
-	} else {
-		int x = 0;
-		for (int i = width - 1; i >= 0; i++) {
-			ret |= buff[x] << (i * 8);
-			x++;
-		}
+	if (width > 8)throw "bad int width, has to be a multiple of 8";
+	uint8 buff[8];
+	read_to(buff, width);
+	for (int i = 0; i < width; i++) {
+		if (le)
+			ret |= (uint64)buff[i] << (i * 8);
+		else
+			ret |= (uint64)buff[i] << ((width - i - 1) * 8);
 	}
-	free(buff);
 	return ret;
 }
 
@@ -116,7 +122,7 @@ bool bytestream::seek_cur(uint64 pos) {
 }
 
 void bytestream::set_endian(endian e) {
-	if (!(e == LITTLE_ENDIAN || e == BIG_ENDIAN))return;
+	if (!(e == endian_little || e == endian_big))return;
 	this->order = e;
 }
 
@@ -146,7 +152,15 @@ void bytestream::mark_pos(uint64 pos) {
 }
 
 void bytestream::read_to(uint8* buf, uint32 size) {
+	if (this->buf) {//in memory, skip the temporary
+		if (this->pos + size > this->size)
+			throw "cannot read that many bytes";
+		memcpy(buf, this->buf + this->pos, size);
+		this->pos += size;
+		return;
+	}
 	uint8* bufsrc = this->read(size);
+	if (!bufsrc)throw "cannot read that many bytes";
 	memcpy(buf, bufsrc, size);
 	free(bufsrc);
 }
@@ -158,7 +172,7 @@ void bytestream::keep_buffer(bool b) {
 bytestream::bytestream() {
 	this->pos = 0;
 	this->b = false;
-	this->order = LITTLE_ENDIAN;
+	this->order = endian_little;
 	this->mark = 0;
 	this->size = 0;
 }
@@ -31,10 +31,113 @@ public:
 	uint8* get_buffer();
 	void rewind();
 	endian get_endian();
-	void set_endian(endian e);
+	void set_endian(endian e);//endian_little or endian_big
 	void keep_buffer(bool b);//version >= 1.3.0
 	virtual bool seek_beg(uint64 pos);
 	bool seek_cur(uint64 pos);
 	bool seek_end(uint64 pos);
 	virtual bool valid();
+
+	//fixed width reads in a compile time byte order. in memory streams copy straight out of the buffer,
+	//anything backed by read(uint32) (filestream) goes through read_to
+	template<endian E, class T>
+	inline T read_fixed() {
+		T v;
+		if (this->buf) {
+			if (this->pos + sizeof(T) > this->size)
+				throw "cannot read that many bytes";
+			memcpy(&v, this->buf + this->pos, sizeof(T));
+			this->pos += sizeof(T);
+		}
+		else read_to((uint8*)&v, sizeof(T));
+		return to_endian<E>(v);
+	}
+
+	template<class T>
+	inline T read_be() {
+		return read_fixed<endian_big, T>();
+	}
+
+	template<class T>
+	inline T read_le() {
+		return read_fixed<endian_little, T>();
+	}
+
+	//decodes one LEB128 varint (7 bits a byte, high bit set = more follow) without bounds checks.
+	//callers make sure at least (bits + 6) / 7 bytes are readable
+	template<class T>
+	static inline T decode_varuint(const uint8*& p) {
+		constexpr int max_bytes = (sizeof(T) * 8 + 6) / 7;
+		T v = 0;
+		for (int i = 0; i < max_bytes; i++) {
+			uint8 b = p[i];
+			v |= (T)(b & 0x7F) << (7 * i);
+			if (!(b & 0x80)) {
+				p += i + 1;
+				return v;
+			}
+		}
+		throw "varint too long";
+	}
+
+	template<class T>
+	inline T read_varuint() {
+		static_assert(std::is_unsigned<T>::value, "varints are decoded unsigned, zigzag on top for signed");
+		constexpr uint64 max_bytes = (sizeof(T) * 8 + 6) / 7;
+		if (this->buf && this->size - this->pos >= max_bytes) {
+			const uint8* p = this->buf + this->pos;
+			T v = decode_varuint<T>(p);
+			this->pos = p - this->buf;
+			return v;
+		}
+		T v = 0;
+		for (uint64 i = 0; i < max_bytes; i++) {
+			uint8 b = read();
+			v |= (T)(b & 0x7F) << (7 * i);
+			if (!(b & 0x80))
+				return v;
+		}
+		throw "varint too long";
+	}
+
+	//bulk varint decode. runs of 8 single byte varints (the common case for small values) are
+	//detected with one 64 bit test and widened without looping on the continuation bits
+	template<class T>
+	inline void read_varuint_array(T* out, uint32 count) {
+		constexpr uint64 max_bytes = (sizeof(T) * 8 + 6) / 7;
+		uint32 i = 0;
+		if (this->buf) {
+			const uint8* p = this->buf + this->pos;
+			const uint8* end = this->buf + this->size;
+			while (i < count) {
+				if (count - i >= 8 && end - p >= 8) {
+					uint64 w;
+					memcpy(&w, p, 8);
+					if (!(w & 0x8080808080808080ull)) {
+						for (int k = 0; k < 8; k++)
+							out[i + k] = p[k];
+						p += 8;
+						i += 8;
+						continue;
+					}
+				}
+				if ((uint64)(end - p) < max_bytes)
+					break;
+				out[i++] = decode_varuint<T>(p);
+			}
+			this->pos = p - this->buf;
+		}
+		for (; i < count; i++)
+			out[i] = read_varuint<T>();
+	}
+
+	//bulk read of count values, swapped in place after one copy
+	template<endian E, class T>
+	inline void read_array(T* out, uint32 count) {
+		read_to((uint8*)out, count * (uint32)sizeof(T));
+		if constexpr (E != endian_native && sizeof(T) > 1) {
+			for (uint32 i = 0; i < count; i++)
+				out[i] = byteswap(out[i]);
+		}
+	}
 };
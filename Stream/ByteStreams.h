@@ -1,9 +1,19 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <type_traits>
 
-#define LITTLE_ENDIAN 1
-#define BIG_ENDIAN 2
+#ifndef _MSC_VER
+//msvc's checked fopen, which the streams use, for everything else
+inline int fopen_s(FILE** f, const char* path, const char* mode) {
+	*f = fopen(path, mode);
+	return *f ? 0 : errno;
+}
+#endif
 
 typedef uint8_t uint8;
 typedef uint16_t uint16;
@@ -16,3 +26,77 @@ typedef int32_t int32;
 typedef int64_t int64;
 
 typedef uint8 endian;
+
+//the byte orders, pass these to set_endian. no LITTLE_ENDIAN/BIG_ENDIAN macros: glibc's <endian.h>
+//defines its own (1234/4321), which clash with them and do not fit an endian
+constexpr endian endian_little = 1;
+constexpr endian endian_big = 2;
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr endian endian_native = endian_big;
+#else
+constexpr endian endian_native = endian_little;
+#endif
+
+inline uint16 bswap16(uint16 v) {
+#ifdef _MSC_VER
+	return _byteswap_ushort(v);
+#else
+	return __builtin_bswap16(v);
+#endif
+}
+
+inline uint32 bswap32(uint32 v) {
+#ifdef _MSC_VER
+	return _byteswap_ulong(v);
+#else
+	return __builtin_bswap32(v);
+#endif
+}
+
+inline uint64 bswap64(uint64 v) {
+#ifdef _MSC_VER
+	return _byteswap_uint64(v);
+#else
+	return __builtin_bswap64(v);
+#endif
+}
+
+//reverses the bytes of any 1/2/4/8 byte trivially copyable value (ints, float, double)
+template<class T>
+inline T byteswap(T v) {
+	static_assert(std::is_trivially_copyable<T>::value, "byteswap needs a trivially copyable type");
+	if constexpr (sizeof(T) == 1) {
+		return v;
+	}
+	else if constexpr (sizeof(T) == 2) {
+		uint16 u;
+		memcpy(&u, &v, 2);
+		u = bswap16(u);
+		memcpy(&v, &u, 2);
+		return v;
+	}
+	else if constexpr (sizeof(T) == 4) {
+		uint32 u;
+		memcpy(&u, &v, 4);
+		u = bswap32(u);
+		memcpy(&v, &u, 4);
+		return v;
+	}
+	else {
+		static_assert(sizeof(T) == 8, "byteswap only supports 1, 2, 4 and 8 byte values");
+		uint64 u;
+		memcpy(&u, &v, 8);
+		u = bswap64(u);
+		memcpy(&v, &u, 8);
+		return v;
+	}
+}
+
+//converts between host order and E. compiles to nothing or a single bswap
+template<endian E, class T>
+inline T to_endian(T v) {
+	if constexpr (E == endian_native)
+		return v;
+	else
+		return byteswap(v);
+}
@@ -1,11 +1,11 @@
-#pragma once
-#include "fileoutstream.h"
+#include "FileOutStream.h"
 
 void fileoutstream::write(const uint8* buf, uint32 size) {
-	if (this->position + size > this->size)this->grow(this->size + size);
+	if (this->position > this->size)this->grow(this->position);//zero fill a gap left by seeking past the end
 	fseek(file, position, SEEK_SET);
 	fwrite(buf, size, 1, this->file);
 	this->position += size;
+	if (this->position > this->size)this->size = this->position;//appends dont need zero filling first
 }
 
 fileoutstream::fileoutstream(const char* fp) {
@@ -20,7 +20,7 @@ fileoutstream::fileoutstream(const char* fp) {
 		return;
 	}
 	this->mark = 0;
-	this->order = LITTLE_ENDIAN;
+	this->order = endian_little;
 	this->position = ftell(f);
 	fseek(f, 0, SEEK_END);
 	this->size = ftell(f);
@@ -57,7 +57,6 @@ fileoutstream::fileoutstream(FILE* f) {
 		this->file = NULL;
 		return;
 	}
-	this->byteoutstream::byteoutstream(0);
 	this->position = ftell(f);
 	fseek(f, 0, SEEK_END);
 	this->size = ftell(f);
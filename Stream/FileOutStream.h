@@ -1,6 +1,6 @@
 #pragma once
 
-#include "byteoutstream.h"
+#include "ByteOutStream.h"
 #include <iostream>
 
 class fileoutstream : public byteoutstream {
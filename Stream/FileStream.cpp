@@ -1,4 +1,4 @@
-#include "filestream.h"
+#include "FileStream.h"
 #include <stdio.h>
 #include <sys/stat.h> 
 
@@ -23,7 +23,7 @@ filestream::filestream(const char* filepath) {
 }
 
 filestream::filestream(FILE * f) {
-	this->order = LITTLE_ENDIAN;
+	this->order = endian_little;
 	this->mark = 0;
 	if (f == nullptr) {
 		this->in = NULL;
@@ -49,5 +49,4 @@ uint8* filestream::read(uint32 size) {
 
 filestream::~filestream() {
 	if (this->in)fclose(this->in);
-	this->bytestream::~bytestream();
 }
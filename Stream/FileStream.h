@@ -1,7 +1,7 @@
 #pragma once
 
 #include <stdio.h>
-#include "bytestream.h"
+#include "ByteStream.h"
 
 class filestream : public bytestream {
 protected:
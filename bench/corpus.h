@@ -0,0 +1,432 @@
+#ifndef _NBT_BENCH_CORPUS
+#define _NBT_BENCH_CORPUS
+
+#include "../nbt.h"
+#include <cmath>
+
+//deterministic synthetic nbt shaped like real world data. same seed, same tree (compound key order on
+//the wire still follows the standard library's unordered_map)
+namespace nbt_corpus {
+
+	using namespace nbt;
+
+	class rng {
+		std::uint64_t m_state;
+	public:
+		explicit rng(std::uint64_t seed) : m_state(seed) {}
+
+		//splitmix64
+		std::uint64_t next() {
+			std::uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		std::int32_t range(std::int32_t lo, std::int32_t hi) {
+			return lo + (std::int32_t)(next() % (std::uint64_t)(hi - lo + 1));
+		}
+
+		double unit() {
+			return (next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+	};
+
+	inline void put(tag_compound* c, const char* key, base* tag) {
+		c->m_tagMap[key] = tag;
+	}
+
+	inline tag_byte* b(std::int8_t v) { tag_byte* t = new tag_byte; t->m_data = v; return t; }
+	inline tag_short* s(std::int16_t v) { tag_short* t = new tag_short; t->m_data = v; return t; }
+	inline tag_int* i(std::int32_t v) { tag_int* t = new tag_int; t->m_data = v; return t; }
+	inline tag_long* l(std::int64_t v) { tag_long* t = new tag_long; t->m_data = v; return t; }
+	inline tag_float* f(float v) { tag_float* t = new tag_float; t->m_data = v; return t; }
+	inline tag_double* d(double v) { tag_double* t = new tag_double; t->m_data = v; return t; }
+	inline tag_string* str(const std::string& v) { tag_string* t = new tag_string; t->m_data = v; return t; }
+
+	inline tag_list* doubles(std::initializer_list<double> v) {
+		tag_list* t = new tag_list;
+		for (double x : v)
+			t->append_tag(d(x));
+		return t;
+	}
+
+	inline tag_list* floats(std::initializer_list<float> v) {
+		tag_list* t = new tag_list;
+		for (float x : v)
+			t->append_tag(f(x));
+		return t;
+	}
+
+	inline tag_intarray* uuid(rng& r) {
+		tag_intarray* t = new tag_intarray;
+		t->mp_data = new std::int32_t[4];
+		t->m_dataSize = 4;
+		for (int k = 0; k < 4; k++)
+			t->mp_data[k] = (std::int32_t)r.next();
+		return t;
+	}
+
+	inline tag_longarray* longs(rng& r, int n) {
+		tag_longarray* t = new tag_longarray;
+		t->mp_data = new std::int64_t[n];
+		t->m_dataSize = n;
+		for (int k = 0; k < n; k++)
+			t->mp_data[k] = (std::int64_t)r.next();
+		return t;
+	}
+
+	inline tag_bytearray* bytes(rng& r, int n) {
+		tag_bytearray* t = new tag_bytearray;
+		t->mp_data = new std::int8_t[n];
+		t->m_dataSize = n;
+		for (int k = 0; k < n; k++)
+			t->mp_data[k] = (std::int8_t)r.next();
+		return t;
+	}
+
+	static const char* const block_names[] = {
+		"minecraft:stone", "minecraft:deepslate", "minecraft:dirt", "minecraft:grass_block", "minecraft:air",
+		"minecraft:water", "minecraft:andesite", "minecraft:diorite", "minecraft:granite", "minecraft:gravel",
+		"minecraft:coal_ore", "minecraft:iron_ore", "minecraft:copper_ore", "minecraft:oak_log", "minecraft:oak_leaves",
+		"minecraft:tuff", "minecraft:lava", "minecraft:bedrock", "minecraft:sand", "minecraft:clay",
+	};
+
+	static const char* const item_names[] = {
+		"minecraft:diamond_sword", "minecraft:iron_pickaxe", "minecraft:cooked_beef", "minecraft:torch", "minecraft:oak_planks",
+		"minecraft:cobblestone", "minecraft:bow", "minecraft:arrow", "minecraft:shield", "minecraft:golden_apple",
+	};
+
+	inline tag_compound* item(rng& r, int slot) {
+		tag_compound* c = new tag_compound;
+		put(c, "Slot", b((std::int8_t)slot));
+		put(c, "id", str(item_names[r.range(0, 9)]));
+		put(c, "Count", b((std::int8_t)r.range(1, 64)));
+		if (r.range(0, 3) == 0) {
+			tag_compound* tag = new tag_compound;
+			put(tag, "Damage", i(r.range(0, 1500)));
+			tag_list* ench = new tag_list;
+			for (int k = r.range(1, 4); k > 0; k--) {
+				tag_compound* e = new tag_compound;
+				put(e, "id", str("minecraft:unbreaking"));
+				put(e, "lvl", s((std::int16_t)r.range(1, 5)));
+				ench->append_tag(e);
+			}
+			put(tag, "Enchantments", ench);
+			put(c, "tag", tag);
+		}
+		return c;
+	}
+
+	//1.16+ layout, entries never span two longs
+	inline tag_longarray* packed(rng& r, int entries, int palette_size, int min_bits) {
+		int bits = min_bits;
+		while ((1 << bits) < palette_size)
+			bits++;
+		int per_long = 64 / bits;
+		int n = (entries + per_long - 1) / per_long;
+		tag_longarray* t = new tag_longarray;
+		t->mp_data = new std::int64_t[n];
+		t->m_dataSize = n;
+		for (int k = 0; k < n; k++) {
+			std::uint64_t v = 0;
+			for (int e = 0; e < per_long; e++)
+				v |= (std::uint64_t)r.range(0, palette_size - 1) << (e * bits);
+			t->mp_data[k] = (std::int64_t)v;
+		}
+		return t;
+	}
+
+	inline tag_compound* level_dat(std::uint64_t seed) {
+		rng r(seed);
+		tag_compound* root = new tag_compound;
+		tag_compound* data = new tag_compound;
+		put(data, "DataVersion", i(3465));
+		put(data, "version", i(19133));
+		put(data, "LevelName", str("New World"));
+		put(data, "GameType", i(0));
+		put(data, "Difficulty", b(2));
+		put(data, "hardcore", b(0));
+		put(data, "allowCommands", b(1));
+		put(data, "initialized", b(1));
+		put(data, "Time", l(r.range(0, 1 << 30)));
+		put(data, "DayTime", l(r.range(0, 24000)));
+		put(data, "LastPlayed", l((std::int64_t)r.next() >> 20));
+		put(data, "SpawnX", i(r.range(-1000, 1000)));
+		put(data, "SpawnY", i(r.range(60, 120)));
+		put(data, "SpawnZ", i(r.range(-1000, 1000)));
+		put(data, "SpawnAngle", f(0.0f));
+		put(data, "BorderSize", d(59999968.0));
+		put(data, "BorderCenterX", d(0.0));
+		put(data, "BorderCenterZ", d(0.0));
+		put(data, "raining", b(0));
+		put(data, "rainTime", i(r.range(0, 100000)));
+		put(data, "thundering", b(0));
+		put(data, "thunderTime", i(r.range(0, 100000)));
+		put(data, "clearWeatherTime", i(0));
+		put(data, "WanderingTraderSpawnChance", i(25));
+		put(data, "WanderingTraderSpawnDelay", i(24000));
+		put(data, "WasModded", b(0));
+		tag_compound* version = new tag_compound;
+		put(version, "Id", i(3465));
+		put(version, "Name", str("1.20.1"));
+		put(version, "Series", str("main"));
+		put(version, "Snapshot", b(0));
+		put(data, "Version", version);
+		tag_compound* rules = new tag_compound;
+		static const char* const rule_names[] = {
+			"doFireTick", "doMobSpawning", "keepInventory", "mobGriefing", "doDaylightCycle", "doWeatherCycle",
+			"randomTickSpeed", "spawnRadius", "maxEntityCramming", "commandBlockOutput", "naturalRegeneration",
+			"showDeathMessages", "doInsomnia", "doImmediateRespawn", "playersSleepingPercentage", "snowAccumulationHeight",
+		};
+		for (const char* name : rule_names)
+			put(rules, name, str(r.range(0, 1) ? "true" : "false"));
+		put(data, "GameRules", rules);
+		tag_compound* gen = new tag_compound;
+		put(gen, "seed", l((std::int64_t)r.next()));
+		put(gen, "generate_features", b(1));
+		put(gen, "bonus_chest", b(0));
+		tag_compound* dims = new tag_compound;
+		static const char* const dim_names[] = { "minecraft:overworld", "minecraft:the_nether", "minecraft:the_end" };
+		for (const char* name : dim_names) {
+			tag_compound* dim = new tag_compound;
+			put(dim, "type", str(name));
+			tag_compound* generator = new tag_compound;
+			put(generator, "type", str("minecraft:noise"));
+			put(generator, "settings", str(name));
+			tag_compound* biomes = new tag_compound;
+			put(biomes, "type", str("minecraft:multi_noise"));
+			put(biomes, "preset", str(name));
+			put(generator, "biome_source", biomes);
+			put(dim, "generator", generator);
+			put(dims, name, dim);
+		}
+		put(gen, "dimensions", dims);
+		put(data, "WorldGenSettings", gen);
+		tag_compound* packs = new tag_compound;
+		tag_list* enabled = new tag_list;
+		enabled->append_tag(str("vanilla"));
+		put(packs, "Enabled", enabled);
+		put(packs, "Disabled", new tag_list);
+		put(data, "DataPacks", packs);
+		put(root, "Data", data);
+		return root;
+	}
+
+	inline tag_compound* player(std::uint64_t seed) {
+		rng r(seed);
+		tag_compound* c = new tag_compound;
+		put(c, "DataVersion", i(3465));
+		put(c, "Pos", doubles({ r.unit() * 2000 - 1000, 64 + r.unit() * 40, r.unit() * 2000 - 1000 }));
+		put(c, "Motion", doubles({ 0.0, -0.0784000015258789, 0.0 }));
+		put(c, "Rotation", floats({ (float)(r.unit() * 360), (float)(r.unit() * 180 - 90) }));
+		put(c, "UUID", uuid(r));
+		put(c, "Health", f(20.0f));
+		put(c, "foodLevel", i(20));
+		put(c, "foodSaturationLevel", f(5.0f));
+		put(c, "foodExhaustionLevel", f((float)r.unit()));
+		put(c, "XpLevel", i(r.range(0, 60)));
+		put(c, "XpP", f((float)r.unit()));
+		put(c, "XpTotal", i(r.range(0, 5000)));
+		put(c, "Score", i(r.range(0, 5000)));
+		put(c, "Air", s(300));
+		put(c, "Fire", s(-20));
+		put(c, "FallDistance", f(0.0f));
+		put(c, "OnGround", b(1));
+		put(c, "Invulnerable", b(0));
+		put(c, "PortalCooldown", i(0));
+		put(c, "SelectedItemSlot", i(r.range(0, 8)));
+		put(c, "Dimension", str("minecraft:overworld"));
+		put(c, "playerGameType", i(0));
+		tag_list* inv = new tag_list;
+		for (int k = 0; k < 36; k++)
+			if (r.range(0, 2))
+				inv->append_tag(item(r, k));
+		put(c, "Inventory", inv);
+		tag_list* ender = new tag_list;
+		for (int k = 0; k < 27; k++)
+			if (!r.range(0, 2))
+				ender->append_tag(item(r, k));
+		put(c, "EnderItems", ender);
+		tag_compound* abilities = new tag_compound;
+		put(abilities, "walkSpeed", f(0.1f));
+		put(abilities, "flySpeed", f(0.05f));
+		put(abilities, "mayfly", b(0));
+		put(abilities, "flying", b(0));
+		put(abilities, "invulnerable", b(0));
+		put(abilities, "mayBuild", b(1));
+		put(abilities, "instabuild", b(0));
+		put(c, "abilities", abilities);
+		tag_list* attributes = new tag_list;
+		static const char* const attribute_names[] = { "minecraft:generic.max_health", "minecraft:generic.movement_speed", "minecraft:generic.attack_damage", "minecraft:generic.luck" };
+		for (const char* name : attribute_names) {
+			tag_compound* a = new tag_compound;
+			put(a, "Name", str(name));
+			put(a, "Base", d(r.unit() * 20));
+			attributes->append_tag(a);
+		}
+		put(c, "Attributes", attributes);
+		tag_compound* recipes = new tag_compound;
+		tag_list* known = new tag_list;
+		for (int k = 0; k < 120; k++)
+			known->append_tag(str("minecraft:recipe_" + std::to_string(r.range(0, 800))));
+		put(recipes, "recipes", known);
+		put(recipes, "toBeDisplayed", new tag_list);
+		put(c, "recipeBook", recipes);
+		return c;
+	}
+
+	//1.18+ chunk: 24 sections with block/biome palettes and packed long[] data
+	inline tag_compound* chunk(std::uint64_t seed) {
+		rng r(seed);
+		tag_compound* c = new tag_compound;
+		put(c, "DataVersion", i(3465));
+		put(c, "xPos", i(r.range(-2000, 2000)));
+		put(c, "zPos", i(r.range(-2000, 2000)));
+		put(c, "yPos", i(-4));
+		put(c, "Status", str("minecraft:full"));
+		put(c, "LastUpdate", l(r.range(0, 1 << 30)));
+		put(c, "InhabitedTime", l(r.range(0, 1 << 20)));
+		tag_list* sections = new tag_list;
+		for (int y = -4; y < 20; y++) {
+			tag_compound* sec = new tag_compound;
+			put(sec, "Y", b((std::int8_t)y));
+			tag_compound* states = new tag_compound;
+			tag_list* palette = new tag_list;
+			int palette_size = y >= 8 ? 1 : r.range(2, 20);
+			for (int k = 0; k < palette_size; k++) {
+				tag_compound* entry = new tag_compound;
+				put(entry, "Name", str(y >= 8 ? "minecraft:air" : block_names[k]));
+				if (k % 4 == 3) {
+					tag_compound* props = new tag_compound;
+					put(props, "axis", str("y"));
+					put(props, "waterlogged", str("false"));
+					put(entry, "Properties", props);
+				}
+				palette->append_tag(entry);
+			}
+			put(states, "palette", palette);
+			if (palette_size > 1)
+				put(states, "data", packed(r, 4096, palette_size, 4));
+			put(sec, "block_states", states);
+			tag_compound* biomes = new tag_compound;
+			tag_list* biome_palette = new tag_list;
+			int biome_count = r.range(1, 3);
+			for (int k = 0; k < biome_count; k++)
+				biome_palette->append_tag(str(k ? "minecraft:forest" : "minecraft:plains"));
+			put(biomes, "palette", biome_palette);
+			if (biome_count > 1)
+				put(biomes, "data", packed(r, 64, biome_count, 1));
+			put(sec, "biomes", biomes);
+			if (y < 8)
+				put(sec, "BlockLight", bytes(r, 2048));
+			put(sec, "SkyLight", bytes(r, 2048));
+			sections->append_tag(sec);
+		}
+		put(c, "sections", sections);
+		tag_compound* heightmaps = new tag_compound;
+		static const char* const heightmap_names[] = { "MOTION_BLOCKING", "MOTION_BLOCKING_NO_LEAVES", "OCEAN_FLOOR", "WORLD_SURFACE" };
+		for (const char* name : heightmap_names)
+			put(heightmaps, name, longs(r, 37));
+		put(c, "Heightmaps", heightmaps);
+		tag_list* block_entities = new tag_list;
+		for (int k = r.range(0, 6); k > 0; k--) {
+			tag_compound* be = new tag_compound;
+			put(be, "id", str("minecraft:chest"));
+			put(be, "x", i(r.range(-32000, 32000)));
+			put(be, "y", i(r.range(-64, 320)));
+			put(be, "z", i(r.range(-32000, 32000)));
+			put(be, "keepPacked", b(0));
+			tag_list* items = new tag_list;
+			for (int slot = 0; slot < 27; slot++)
+				if (!r.range(0, 3))
+					items->append_tag(item(r, slot));
+			put(be, "Items", items);
+			block_entities->append_tag(be);
+		}
+		put(c, "block_entities", block_entities);
+		put(c, "block_ticks", new tag_list);
+		put(c, "fluid_ticks", new tag_list);
+		put(c, "PostProcessing", new tag_list);
+		put(c, "isLightOn", b(1));
+		return c;
+	}
+
+	//1.17+ entity chunk with a few hundred mobs and dropped items
+	inline tag_compound* entity_chunk(std::uint64_t seed, int entities = 300) {
+		rng r(seed);
+		tag_compound* c = new tag_compound;
+		put(c, "DataVersion", i(3465));
+		tag_intarray* pos = new tag_intarray;
+		pos->mp_data = new std::int32_t[2]{ r.range(-2000, 2000), r.range(-2000, 2000) };
+		pos->m_dataSize = 2;
+		put(c, "Position", pos);
+		static const char* const mob_names[] = { "minecraft:zombie", "minecraft:skeleton", "minecraft:cow", "minecraft:sheep", "minecraft:item", "minecraft:villager" };
+		tag_list* list = new tag_list;
+		for (int k = 0; k < entities; k++) {
+			tag_compound* e = new tag_compound;
+			int kind = r.range(0, 5);
+			put(e, "id", str(mob_names[kind]));
+			put(e, "Pos", doubles({ r.unit() * 16, r.unit() * 100, r.unit() * 16 }));
+			put(e, "Motion", doubles({ 0.0, -0.0784, 0.0 }));
+			put(e, "Rotation", floats({ (float)(r.unit() * 360), 0.0f }));
+			put(e, "UUID", uuid(r));
+			put(e, "Air", s(300));
+			put(e, "Fire", s(-1));
+			put(e, "FallDistance", f(0.0f));
+			put(e, "OnGround", b(1));
+			put(e, "Invulnerable", b(0));
+			put(e, "PortalCooldown", i(0));
+			if (kind == 4) {
+				put(e, "Age", s((std::int16_t)r.range(0, 6000)));
+				put(e, "PickupDelay", s(0));
+				put(e, "Item", item(r, 0));
+			}
+			else {
+				put(e, "Health", f((float)r.range(1, 20)));
+				put(e, "HurtTime", s(0));
+				put(e, "DeathTime", s(0));
+				put(e, "PersistenceRequired", b(0));
+				put(e, "CanPickUpLoot", b(0));
+				put(e, "LeftHanded", b(0));
+				tag_list* armor = new tag_list;
+				tag_list* hands = new tag_list;
+				for (int slot = 0; slot < 4; slot++)
+					armor->append_tag(new tag_compound);
+				for (int slot = 0; slot < 2; slot++)
+					hands->append_tag(new tag_compound);
+				put(e, "ArmorItems", armor);
+				put(e, "HandItems", hands);
+				tag_list* drops = new tag_list;
+				for (int slot = 0; slot < 4; slot++)
+					drops->append_tag(f(0.085f));
+				put(e, "ArmorDropChances", drops);
+				tag_compound* memories = new tag_compound;
+				put(memories, "memories", new tag_compound);
+				put(e, "Brain", memories);
+			}
+			list->append_tag(e);
+		}
+		put(c, "Entities", list);
+		return c;
+	}
+
+	struct sample {
+		const char* const name;
+		tag_compound* (*make)(std::uint64_t seed);
+	};
+
+	inline tag_compound* entity_chunk_default(std::uint64_t seed) {
+		return entity_chunk(seed);
+	}
+
+	static const sample samples[] = {
+		{ "level.dat", level_dat },
+		{ "player", player },
+		{ "chunk", chunk },
+		{ "entity_chunk", entity_chunk_default },
+	};
+
+}
+
+#endif
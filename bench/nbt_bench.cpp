@@ -0,0 +1,280 @@
+//throughput benchmark for the read/write hot paths over the synthetic corpus in corpus.h.
+//build with the nbt_bench target of the CMakeLists.txt in the repository root (see README)
+//usage: nbt_bench [filter] [-t min_ms] [-d]   filter matches against "sample/benchmark",
+//-d writes the corpus out as <sample>.nbt (uncompressed, java) instead of benchmarking
+
+#include "corpus.h"
+#include "../nbt_deflate.h"
+#include "../Stream/FileStream.h"
+#include "../Stream/FileOutStream.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//every operator new in the process is counted, malloc/realloc inside the streams are not. the deletes
+//are kept out of line: gcc inlines free() into callers whose new it cant see, and -Wmismatched-new-delete
+//then reports operator new paired with free
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static std::atomic<std::uint64_t> g_allocs{ 0 };
+static std::atomic<std::uint64_t> g_alloc_bytes{ 0 };
+
+void* operator new(std::size_t size) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+	free(p);
+}
+
+BENCH_NOINLINE void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, std::size_t) noexcept {
+	free(p);
+}
+
+BENCH_NOINLINE void operator delete[](void* p, std::size_t) noexcept {
+	free(p);
+}
+
+using namespace nbt;
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//accumulates time and allocations between start() and stop() only, so setup and teardown
+//around the measured part are excluded
+struct result {
+	double seconds;
+	std::uint64_t ops;
+	std::uint64_t allocs;
+	std::uint64_t alloc_bytes;
+	double t0;
+	std::uint64_t a0;
+	std::uint64_t b0;
+
+	inline void start() {
+		a0 = g_allocs.load(std::memory_order_relaxed);
+		b0 = g_alloc_bytes.load(std::memory_order_relaxed);
+		t0 = now();
+	}
+
+	inline void stop() {
+		seconds += now() - t0;
+		allocs += g_allocs.load(std::memory_order_relaxed) - a0;
+		alloc_bytes += g_alloc_bytes.load(std::memory_order_relaxed) - b0;
+	}
+};
+
+static double g_min_seconds = 0.3;
+static const char* g_filter = NULL;
+
+//runs op until at least g_min_seconds of measured time have passed
+template<class F>
+static result measure(F op) {
+	result r = { 0, 0, 0, 0, 0, 0, 0 };
+	while (r.seconds < g_min_seconds || r.ops < 3) {
+		op(r);
+		r.ops++;
+	}
+	return r;
+}
+
+static std::uint64_t count_tags(const base* tag) {
+	std::uint64_t n = 1;
+	if (tag->get_id() == 10) {
+		const tag_compound* c = dynamic_cast<const tag_compound*>(tag);
+		for (auto it = c->m_tagMap.begin(); it != c->m_tagMap.end(); it++)
+			n += count_tags(it->second);
+	}
+	else if (tag->get_id() == 9) {
+		for (const base* child : dynamic_cast<const tag_list*>(tag)->get_tags())
+			n += count_tags(child);
+	}
+	return n;
+}
+
+static void report(const char* sample, const char* bench, const result& r, std::uint64_t bytes, std::uint64_t tags) {
+	double per_op = r.seconds / r.ops;
+	printf("%-14s %-24s %10.1f MB/s %10.2f Mtags/s %10.1f allocs/op %12.0f alloc B/op %10.1f us/op\n",
+		sample, bench, bytes / per_op / 1e6, tags / per_op / 1e6, (double)r.allocs / r.ops, (double)r.alloc_bytes / r.ops, per_op * 1e6);
+}
+
+static bool selected(const char* sample, const char* bench) {
+	if (!g_filter)
+		return true;
+	std::string name = std::string(sample) + "/" + bench;
+	return name.find(g_filter) != std::string::npos;
+}
+
+#ifndef _NBT_NO_COMPRESS
+static std::vector<uint8> gzip(const uint8* data, uint64 size) {
+	z_stream stream = { 0 };
+	deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);//15 + 16, gzip wrapper
+	std::vector<uint8> out(deflateBound(&stream, (uLong)size));
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = (uInt)size;
+	stream.next_out = out.data();
+	stream.avail_out = (uInt)out.size();
+	deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	return out;
+}
+#endif
+
+static void run_sample(const nbt_corpus::sample& s) {
+	tag_compound* tree = s.make(0x6E6274);
+	std::uint64_t tags = count_tags(tree);
+
+	byteoutstream encoded(0);
+	write_tag(encoded, tree);
+	std::vector<uint8> raw(encoded.get_buffer(), encoded.get_buffer() + encoded.get_position());
+	uint64 bytes = raw.size();
+
+	if (selected(s.name, "write_tag")) {
+		result r = measure([&](result& m) {
+			m.start();
+			byteoutstream out(0);
+			write_tag(out, tree);
+			m.stop();
+		});
+		report(s.name, "write_tag", r, bytes, tags);
+	}
+
+	if (selected(s.name, "read_tag")) {
+		result r = measure([&](result& m) {
+			bytestream in(raw.data(), raw.size());
+			in.keep_buffer(true);
+			m.start();
+			base* tag = read_tag(in);
+			m.stop();
+			delete tag;
+		});
+		report(s.name, "read_tag", r, bytes, tags);
+	}
+
+	if (selected(s.name, "read_tag_compound")) {
+		tag_compound reused;
+		result r = measure([&](result& m) {
+			bytestream in(raw.data(), raw.size());
+			in.keep_buffer(true);
+			m.start();
+			read_tag_compound(in, reused);
+			m.stop();
+		});
+		report(s.name, "read_tag_compound", r, bytes, tags);
+	}
+
+#ifndef _NBT_NO_COMPRESS
+	//gzip on the writing thread, then over the default worker count. out is reused, only compression is timed
+	for (unsigned threads : { 1u, 0u }) {
+		const char* name = threads == 1 ? "write_tag_gzip" : "write_tag_gzip_mt";
+		if (!selected(s.name, name))
+			continue;
+		deflate_options options;
+		options.threads = threads;
+		byteoutstream out(0);
+		result r = measure([&](result& m) {
+			out.seek_beg(0);
+			m.start();
+			write_tag(out, tree, format::java, options);
+			m.stop();
+		});
+		report(s.name, name, r, bytes, tags);
+	}
+
+	if (selected(s.name, "read_tag_gzip")) {
+		std::vector<uint8> packed = gzip(raw.data(), raw.size());
+		result r = measure([&](result& m) {
+			bytestream in(packed.data(), packed.size());
+			in.keep_buffer(true);
+			m.start();
+			base* tag = read_tag(in);
+			m.stop();
+			delete tag;
+		});
+		report(s.name, "read_tag_gzip", r, bytes, tags);
+	}
+#endif
+
+	if (selected(s.name, "read_tag_filestream")) {
+		std::string path = std::string("nbt_bench_") + s.name + ".tmp";
+		{
+			fileoutstream out(path.c_str());
+			out.write(raw.data(), (uint32)raw.size());
+		}
+		result r = measure([&](result& m) {
+			filestream in(path.c_str());
+			m.start();
+			base* tag = read_tag(in);
+			m.stop();
+			delete tag;
+		});
+		report(s.name, "read_tag_filestream", r, bytes, tags);
+		remove(path.c_str());
+	}
+
+	if (selected(s.name, "destroy")) {
+		result r = measure([&](result& m) {
+			bytestream in(raw.data(), raw.size());
+			in.keep_buffer(true);
+			base* tag = read_tag(in);
+			m.start();
+			delete tag;
+			m.stop();
+		});
+		report(s.name, "destroy", r, bytes, tags);
+	}
+
+	delete tree;
+}
+
+static void dump_sample(const nbt_corpus::sample& s) {
+	tag_compound* tree = s.make(0x6E6274);
+	std::string path = std::string(s.name) + ".nbt";
+	{
+		fileoutstream out(path.c_str());
+		write_tag(out, tree);
+	}
+	delete tree;
+	printf("wrote %s\n", path.c_str());
+}
+
+int main(int argc, char** argv) {
+	bool dump = false;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "-t" && i + 1 < argc)
+			g_min_seconds = atof(argv[++i]) / 1000.0;
+		else if (std::string(argv[i]) == "-d")
+			dump = true;
+		else
+			g_filter = argv[i];
+	}
+	for (const nbt_corpus::sample& s : nbt_corpus::samples) {
+		if (dump)
+			dump_sample(s);
+		else
+			run_sample(s);
+	}
+	return 0;
+}
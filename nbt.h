@@ -2,7 +2,11 @@
 #define _NBT
 
 #ifndef _NBT_NO_COMPRESS
+#if defined(__has_include) && !__has_include(<zlib/zlib.h>)
+#include <zlib.h>//system zlib, as on linux
+#else
 #include <zlib/zlib.h>
+#endif
 #define _NBT_GZIP_MAGIC 0x1f
 #define _NBT_GZIP_CHUNK 0x2000
 #endif
@@ -15,16 +19,26 @@
 #include "Stream/ByteOutStream.h"
 #include <unordered_map>
 #include <vector>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#ifdef _NBT_STATS
+#include <chrono>
+#endif
 
 namespace nbt {
 
 	class exception : public std::exception {
 	public:
-		explicit inline exception(const char* const msg) throw() : std::exception(msg) {}
-		virtual char const* what() const override {
-			return std::exception::what();//..
+		//msg is kept, not copied: every message is a string literal
+		explicit inline exception(const char* const msg) throw() : m_msg(msg) {}
+		virtual char const* what() const throw() override {
+			return m_msg;
 		}
 
+	private:
+		const char* m_msg;
+
 	};
 
 	class size_tracker {
@@ -44,6 +58,320 @@ namespace nbt {
 
 	constexpr size_tracker inf(std::numeric_limits<std::int64_t>::max());
 
+	//reference count of an array buffer shared between clones, allocated the first time one is cloned. cloning
+	//one const tag from several threads at once is safe, writing (unshare, decoding over it) is not
+	typedef std::atomic<std::uint32_t> cow_count;
+
+	//opt-in instrumentation of reads and writes, predefine '_NBT_STATS' to compile it in.
+	//install one per thread with stats_scope; without the define the hooks expand to nothing
+	struct stats {
+		std::uint64_t tags[13];//per tag id
+		std::uint64_t bytes[13];//encoded bytes per tag id, lists and compounds include their children
+		int max_depth;
+		std::uint64_t allocations;//tags, array/string buffers, compound nodes and list storage made while decoding
+		std::uint64_t allocated_bytes;
+		std::uint64_t largest_string;
+		std::uint64_t largest_array[13];//element count, only byte[] int[] long[] are used
+		std::uint64_t stream_bytes_in;//as read from the input stream, i.e. compressed size for gzip input
+		std::uint64_t stream_bytes_out;
+		std::uint64_t inflated_bytes;
+		std::uint64_t inflate_ns;
+		std::uint64_t parse_ns;
+		std::uint64_t write_ns;
+
+		//called after every tag (post order, so containers after their children). depth is -1 on writes
+		void (*on_tag)(void* user, std::int8_t id, std::uint64_t bytes, int depth);
+		void* user;
+
+		stats() : on_tag(NULL), user(NULL) {
+			reset();
+		}
+
+		void reset() {
+			memset(tags, 0, sizeof(tags));
+			memset(bytes, 0, sizeof(bytes));
+			memset(largest_array, 0, sizeof(largest_array));
+			max_depth = 0;
+			allocations = allocated_bytes = largest_string = 0;
+			stream_bytes_in = stream_bytes_out = inflated_bytes = 0;
+			inflate_ns = parse_ns = write_ns = 0;
+		}
+
+		static stats*& current() {
+			thread_local stats* active = NULL;
+			return active;
+		}
+
+		static inline void record_tag(std::int8_t id, std::uint64_t size, int depth) {
+			stats* s = current();
+			if (!s)
+				return;
+			s->tags[id]++;
+			s->bytes[id] += size;
+			if (depth > s->max_depth)
+				s->max_depth = depth;
+			if (s->on_tag)
+				s->on_tag(s->user, id, size, depth);
+		}
+
+		static inline void record_alloc(std::uint64_t size) {
+			if (stats* s = current()) {
+				s->allocations++;
+				s->allocated_bytes += size;
+			}
+		}
+
+		static inline void record_array(std::int8_t id, std::uint64_t count) {
+			if (stats* s = current())
+				if (count > s->largest_array[id])
+					s->largest_array[id] = count;
+		}
+
+		static inline void record_string(std::uint64_t length) {
+			if (stats* s = current()) {
+				if (length > s->largest_string)
+					s->largest_string = length;
+				if (length > std::string().capacity()) {//past the small string buffer
+					s->allocations++;
+					s->allocated_bytes += length + 1;
+				}
+			}
+		}
+
+		template<class T>
+		static inline T* counted(T* tag) {
+			record_alloc(sizeof(T));
+			return tag;
+		}
+	};
+
+	class stats_scope {
+#ifdef _NBT_STATS
+		stats* m_prev;
+	public:
+		explicit stats_scope(stats& s) : m_prev(stats::current()) {
+			stats::current() = &s;
+		}
+
+		~stats_scope() {
+			stats::current() = m_prev;
+		}
+#else
+	public:
+		explicit stats_scope(stats&) {}
+#endif
+		stats_scope(const stats_scope&) = delete;
+		stats_scope& operator=(const stats_scope&) = delete;
+	};
+
+#ifdef _NBT_STATS
+#define _NBT_STATS_BEGIN(stream) const uint64 _nbt_stats_pos = (stream).get_position()
+#define _NBT_STATS_END(stream, id, depth) nbt::stats::record_tag((id), (stream).get_position() - _nbt_stats_pos, (depth))
+#define _NBT_STATS_ALLOC(size) nbt::stats::record_alloc(size)
+#define _NBT_STATS_ARRAY(id, count) nbt::stats::record_array((id), (count))
+#define _NBT_STATS_STRING(length) nbt::stats::record_string(length)
+#define _NBT_STATS_NEW(T) nbt::stats::counted(new T)
+#define _NBT_STATS_TIMER(name) const auto name = std::chrono::steady_clock::now()
+#define _NBT_STATS_ELAPSED(field, name) do { if (nbt::stats* _s = nbt::stats::current()) _s->field += (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - name).count(); } while (0)
+#define _NBT_STATS_ADD(field, n) do { if (nbt::stats* _s = nbt::stats::current()) _s->field += (n); } while (0)
+#else
+#define _NBT_STATS_BEGIN(stream)
+#define _NBT_STATS_END(stream, id, depth)
+#define _NBT_STATS_ALLOC(size)
+#define _NBT_STATS_ARRAY(id, count)
+#define _NBT_STATS_STRING(length)
+#define _NBT_STATS_NEW(T) (new T)
+#define _NBT_STATS_TIMER(name)
+#define _NBT_STATS_ELAPSED(field, name)
+#define _NBT_STATS_ADD(field, n)
+#endif
+
+	//wire formats sharing the tag model
+	enum class format : std::uint8_t {
+		java,//big endian
+		bedrock,//little endian, level.dat and other bedrock files
+		bedrock_network,//little endian, int/long as zigzag varints, lengths as varints
+	};
+
+	//wire codecs. every tag is read and written through one of these, chosen at compile time,
+	//so the byte order is never tested per value
+	template<endian E>
+	struct fixed_codec {
+		static constexpr format fmt = E == endian_big ? format::java : format::bedrock;
+		static constexpr std::uint32_t max_string_length = std::numeric_limits<std::uint16_t>::max();
+
+		template<class T>
+		static inline T read(bytestream& input) {
+			return input.read_fixed<E, T>();
+		}
+
+		template<class T>
+		static inline void write(byteoutstream& output, T val) {
+			output.write_fixed<E>(val);
+		}
+
+		template<class T>
+		static inline void read_array(bytestream& input, T* out, std::uint32_t count) {
+			input.read_array<E>(out, count);
+		}
+
+		template<class T>
+		static inline void write_array(byteoutstream& output, const T* in, std::uint32_t count) {
+			output.write_array<E>(in, count);
+		}
+
+		//element count of lists and arrays
+		static inline std::int32_t read_length(bytestream& input) {
+			return input.read_fixed<E, std::int32_t>();
+		}
+
+		static inline void write_length(byteoutstream& output, std::int32_t len) {
+			output.write_fixed<E>(len);
+		}
+
+		static inline std::uint32_t read_string_length(bytestream& input) {
+			return input.read_fixed<E, std::uint16_t>();
+		}
+
+		static inline void write_string_length(byteoutstream& output, std::uint32_t len) {
+			output.write_fixed<E>((std::uint16_t)len);
+		}
+	};
+
+	typedef fixed_codec<endian_big> be_codec;//java edition
+	typedef fixed_codec<endian_little> le_codec;//bedrock edition, on disk
+
+	struct varint_codec {
+		static constexpr format fmt = format::bedrock_network;
+		static constexpr std::uint32_t max_string_length = std::numeric_limits<std::int16_t>::max();
+
+		static inline std::uint32_t zigzag(std::int32_t v) {
+			return ((std::uint32_t)v << 1) ^ (std::uint32_t)(v >> 31);
+		}
+
+		static inline std::uint64_t zigzag(std::int64_t v) {
+			return ((std::uint64_t)v << 1) ^ (std::uint64_t)(v >> 63);
+		}
+
+		static inline std::int32_t unzigzag(std::uint32_t v) {
+			return (std::int32_t)((v >> 1) ^ (0u - (v & 1)));
+		}
+
+		static inline std::int64_t unzigzag(std::uint64_t v) {
+			return (std::int64_t)((v >> 1) ^ (0ull - (v & 1)));
+		}
+
+		template<class T>
+		static inline T read(bytestream& input) {
+			if constexpr (std::is_same<T, std::int32_t>::value)
+				return unzigzag(input.read_varuint<std::uint32_t>());
+			else if constexpr (std::is_same<T, std::int64_t>::value)
+				return unzigzag(input.read_varuint<std::uint64_t>());
+			else
+				return input.read_fixed<endian_little, T>();
+		}
+
+		template<class T>
+		static inline void write(byteoutstream& output, T val) {
+			if constexpr (std::is_same<T, std::int32_t>::value || std::is_same<T, std::int64_t>::value)
+				output.write_varuint(zigzag(val));
+			else
+				output.write_fixed<endian_little>(val);
+		}
+
+		template<class T>
+		static inline void read_array(bytestream& input, T* out, std::uint32_t count) {
+			if constexpr (std::is_same<T, std::int32_t>::value || std::is_same<T, std::int64_t>::value) {
+				typedef typename std::make_unsigned<T>::type U;
+				input.read_varuint_array((U*)out, count);
+				for (std::uint32_t i = 0; i < count; i++)
+					out[i] = unzigzag(((U*)out)[i]);
+			}
+			else input.read_array<endian_little>(out, count);
+		}
+
+		template<class T>
+		static inline void write_array(byteoutstream& output, const T* in, std::uint32_t count) {
+			if constexpr (std::is_same<T, std::int32_t>::value || std::is_same<T, std::int64_t>::value) {
+				typedef typename std::make_unsigned<T>::type U;
+				U tmp[256];
+				while (count) {
+					std::uint32_t n = count > 256 ? 256 : count;
+					for (std::uint32_t i = 0; i < n; i++)
+						tmp[i] = zigzag(in[i]);
+					output.write_varuint_array(tmp, n);
+					in += n;
+					count -= n;
+				}
+			}
+			else output.write_array<endian_little>(in, count);
+		}
+
+		static inline std::int32_t read_length(bytestream& input) {
+			return unzigzag(input.read_varuint<std::uint32_t>());
+		}
+
+		static inline void write_length(byteoutstream& output, std::int32_t len) {
+			output.write_varuint(zigzag(len));
+		}
+
+		static inline std::uint32_t read_string_length(bytestream& input) {
+			return input.read_varuint<std::uint32_t>();
+		}
+
+		static inline void write_string_length(byteoutstream& output, std::uint32_t len) {
+			output.write_varuint(len);
+		}
+	};
+
+	//expands to the per codec virtual entry points of a tag, forwarding to its read_impl/write_impl templates
+#define _NBT_CODEC_OVERRIDES \
+		virtual void read_be(bytestream& input, int depth, size_tracker& tracker) override { _NBT_STATS_BEGIN(input); read_impl<be_codec>(input, depth, tracker); _NBT_STATS_END(input, get_id(), depth); } \
+		virtual void read_le(bytestream& input, int depth, size_tracker& tracker) override { _NBT_STATS_BEGIN(input); read_impl<le_codec>(input, depth, tracker); _NBT_STATS_END(input, get_id(), depth); } \
+		virtual void write_be(byteoutstream& output) override { _NBT_STATS_BEGIN(output); write_impl<be_codec>(output); _NBT_STATS_END(output, get_id(), -1); } \
+		virtual void write_le(byteoutstream& output) override { _NBT_STATS_BEGIN(output); write_impl<le_codec>(output); _NBT_STATS_END(output, get_id(), -1); } \
+		virtual void read_net(bytestream& input, int depth, size_tracker& tracker) override { _NBT_STATS_BEGIN(input); read_impl<varint_codec>(input, depth, tracker); _NBT_STATS_END(input, get_id(), depth); } \
+		virtual void write_net(byteoutstream& output) override { _NBT_STATS_BEGIN(output); write_impl<varint_codec>(output); _NBT_STATS_END(output, get_id(), -1); }
+
+	//heap footprint of a tree as filled in by base::memory_usage. allocator blocks are estimated as the
+	//request plus a header, rounded to 16 bytes, which is what the common 64 bit mallocs do
+	struct memory_report {
+		std::uint64_t tags[13];//tag objects per tag id
+		std::uint64_t payload[13];//array buffers and out of line string storage per tag id
+		std::uint64_t lists;//element pointer storage of lists
+		std::uint64_t nodes;//compound entries, their keys included
+		std::uint64_t buckets;//compound bucket arrays
+		std::uint64_t slack;//capacity reserved but unused, part of the above. compact gives it back
+		std::uint64_t shared;//array payload shared copy-on-write with clones, counted in full in payload too
+
+		memory_report() {
+			reset();
+		}
+
+		void reset() {
+			memset(tags, 0, sizeof(tags));
+			memset(payload, 0, sizeof(payload));
+			lists = nodes = buckets = slack = shared = 0;
+		}
+
+		std::uint64_t total() const {
+			std::uint64_t sum = lists + nodes + buckets;
+			for (int i = 0; i < 13; i++)
+				sum += tags[i] + payload[i];
+			return sum;
+		}
+
+		static constexpr std::uint64_t block(std::uint64_t size) {
+			return (size + 8 + 15) & ~15ull;
+		}
+
+		//storage a string of this capacity takes beyond its own object, 0 while it fits the small buffer
+		static inline std::uint64_t string_block(std::size_t capacity) {
+			static const std::size_t small = std::string().capacity();
+			return capacity > small ? block(capacity + 1) : 0;
+		}
+	};
+
 	class base {
 	public:
 
@@ -65,10 +393,61 @@ namespace nbt {
 			"long[]",
 		};
 
-		virtual void write(byteoutstream&) = 0;
-		virtual void read(bytestream&, int depth, size_tracker&) = 0;
+		virtual void read_be(bytestream&, int depth, size_tracker&) = 0;
+		virtual void read_le(bytestream&, int depth, size_tracker&) = 0;
+		virtual void write_be(byteoutstream&) = 0;
+		virtual void write_le(byteoutstream&) = 0;
+		virtual void read_net(bytestream&, int depth, size_tracker&) = 0;
+		virtual void write_net(byteoutstream&) = 0;
 		inline virtual std::int8_t get_id() const = 0;
 
+		//deep copy, caller owns it. array payloads are shared copy-on-write, see tag_bytearray::unshare
+		inline virtual base* clone() const = 0;
+
+		//estimated heap bytes held by this tag and its children, the tag object itself included
+		inline std::uint64_t memory_usage() const;
+		//adds this subtree to report, per tag type
+		inline void memory_usage(memory_report& report) const;
+		//gives back reserved capacity in the whole subtree: list storage, strings and compound keys are shrunk to
+		//their size, compound bucket arrays rehashed to the smallest count their load factor allows
+		inline void compact();
+
+		//statically picks the entry point for codec C, children use this so a whole tree stays on one codec
+		template<class C>
+		inline void read_as(bytestream& input, int depth, size_tracker& tracker) {
+			if constexpr (C::fmt == format::java)
+				read_be(input, depth, tracker);
+			else if constexpr (C::fmt == format::bedrock)
+				read_le(input, depth, tracker);
+			else
+				read_net(input, depth, tracker);
+		}
+
+		template<class C>
+		inline void write_as(byteoutstream& output) {
+			if constexpr (C::fmt == format::java)
+				write_be(output);
+			else if constexpr (C::fmt == format::bedrock)
+				write_le(output);
+			else
+				write_net(output);
+		}
+
+		//uses the stream's current byte order
+		inline void read(bytestream& input, int depth, size_tracker& tracker) {
+			if (input.get_endian() == endian_little)
+				read_le(input, depth, tracker);
+			else
+				read_be(input, depth, tracker);
+		}
+
+		inline void write(byteoutstream& output) {
+			if (output.get_endian() == endian_little)
+				write_le(output);
+			else
+				write_be(output);
+		}
+
 		virtual ~base() {}
 
 		static constexpr const char* const get_typename(int id) {
@@ -122,6 +501,19 @@ namespace nbt {
 
 	};
 
+	//downcast to the class of the tag's id. the scalar and array tags reach base through a virtual base, which
+	//static_cast cannot undo and dynamic_cast<T*> does by searching the hierarchy. dynamic_cast<void*> only
+	//reads the offset of the complete object from the vtable. T must be the tag's class, nothing checks it
+	template<class T>
+	inline T* tag_cast(base* tag) {
+		return static_cast<T*>(dynamic_cast<void*>(tag));
+	}
+
+	template<class T>
+	inline const T* tag_cast(const base* tag) {
+		return static_cast<const T*>(dynamic_cast<const void*>(tag));
+	}
+
 	class primitive : public virtual base {
 	public:
 		inline virtual std::int64_t get_long() const = 0;
@@ -151,13 +543,23 @@ namespace nbt {
 			return 1;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(8, m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<std::int8_t>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(72);
-			m_data = (int8_t)input.read();
+			m_data = C::template read<std::int8_t>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_byte* tag = new tag_byte();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -191,26 +593,26 @@ namespace nbt {
 
 		std::int8_t *mp_data;
 		int m_dataSize;
-		tag_bytearray() : mp_data(NULL), m_dataSize(0) {}
+		mutable std::atomic<cow_count*> mp_refs;//set while mp_data is shared with clones, published by clone()
+		tag_bytearray() : mp_data(NULL), m_dataSize(0), mp_refs(NULL) {}
 
 		tag_bytearray(const tag_bytearray&) = delete;
 		tag_bytearray& operator=(const tag_bytearray&) = delete;
 
-		tag_bytearray(tag_bytearray&& rhs) {
-
-			clear_buffer();
-			mp_data = rhs.mp_data;
-			m_dataSize = rhs.m_dataSize;
+		tag_bytearray(tag_bytearray&& rhs) : mp_data(rhs.mp_data), m_dataSize(rhs.m_dataSize), mp_refs(rhs.mp_refs.load(std::memory_order_relaxed)) {
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 		}
 
 		tag_bytearray& operator=(tag_bytearray&& rhs) {
 			clear_buffer();
 			mp_data = rhs.mp_data;
 			m_dataSize = rhs.m_dataSize;
+			mp_refs = rhs.mp_refs.load(std::memory_order_relaxed);
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 			return *this;
 		}
 
@@ -218,26 +620,78 @@ namespace nbt {
 			return 7;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			output.write_int(32, m_dataSize);
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			C::write_length(output, m_dataSize);
 			if (m_dataSize && mp_data)
-				output.write((uint8*)mp_data, m_dataSize);
+				C::write_array(output, mp_data, m_dataSize);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
-			clear_buffer();
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(192);
-			m_dataSize = input.read_int(32);
-			if (m_dataSize) {
-				size_tracker.read(8 * 1 * m_dataSize);
-				mp_data = new std::int8_t[m_dataSize];
-				input.read_to((uint8*)mp_data, m_dataSize);
+			std::int32_t size = C::read_length(input);
+			if (size < 0) {
+				clear_buffer();
+				throw exception("negative array length. corrupt tag?");
+			}
+			if (size && size == m_dataSize && mp_data && !mp_refs) {//decoding over this tag again, the buffer fits
+				size_tracker.read(8ull * 1 * size);
+				_NBT_STATS_ARRAY(7, size);
+				C::read_array(input, mp_data, size);
+				return;
+			}
+			clear_buffer();
+			if (size) {
+				size_tracker.read(8ull * 1 * size);
+				mp_data = new std::int8_t[size];
+				m_dataSize = size;
+				_NBT_STATS_ALLOC(sizeof(std::int8_t) * (std::uint64_t)size);
+				_NBT_STATS_ARRAY(7, size);
+				C::read_array(input, mp_data, size);
+			}
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		//the payload is shared with the original, see unshare
+		inline virtual base* clone() const override {
+			tag_bytearray* tag = new tag_bytearray();
+			if (m_dataSize && mp_data) {
+				cow_count* refs = mp_refs.load(std::memory_order_acquire);
+				if (!refs) {//first clone. other threads may be cloning this tag too, one count gets published
+					cow_count* fresh = new cow_count(1);
+					if (mp_refs.compare_exchange_strong(refs, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+						refs = fresh;
+					else delete fresh;
+				}
+				refs->fetch_add(1, std::memory_order_relaxed);
+				tag->mp_data = mp_data;
+				tag->m_dataSize = m_dataSize;
+				tag->mp_refs = refs;
+			}
+			return tag;
+		}
+
+		//gives this tag its own copy of a buffer shared with clones. call before writing through mp_data
+		inline void unshare() {
+			cow_count* refs = mp_refs.load(std::memory_order_relaxed);
+			if (!refs)
+				return;
+			if (refs->load(std::memory_order_acquire) != 1) {
+				std::int8_t* copy = new std::int8_t[m_dataSize];
+				memcpy(copy, mp_data, sizeof(std::int8_t) * (std::size_t)m_dataSize);
+				release_buffer();
+				mp_data = copy;
+			}
+			else {
+				delete refs;
+				mp_refs = NULL;
 			}
 		}
 
 		inline void clear_buffer() {
-			if (m_dataSize && mp_data)
-				delete[] mp_data;
+			release_buffer();
 			m_dataSize = 0;
 			mp_data = NULL;
 		}
@@ -246,6 +700,21 @@ namespace nbt {
 			clear_buffer();
 		}
 
+	private:
+
+		//drops this tags reference, the last owner frees the buffer
+		inline void release_buffer() {
+			if (cow_count* refs = mp_refs.load(std::memory_order_relaxed)) {
+				if (refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					delete refs;
+					delete[] mp_data;
+				}
+				mp_refs = NULL;
+			}
+			else if (m_dataSize && mp_data)
+				delete[] mp_data;
+		}
+
 	};
 
 	class tag_double : public typed_primitive<double> {
@@ -258,14 +727,23 @@ namespace nbt {
 			return 6;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(64, *(uint64*)&m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<double>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(128);
-			uint64 i = input.read_int(64);
-			m_data = *(double*)&i;
+			m_data = C::template read<double>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_double* tag = new tag_double();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -304,14 +782,23 @@ namespace nbt {
 			return 5;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(32, *(uint32*)&m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<float>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(96);
-			uint32 i = (uint32)input.read_int(32);
-			m_data = *(float*)&i;
+			m_data = C::template read<float>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_float* tag = new tag_float();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -350,13 +837,23 @@ namespace nbt {
 			return 2;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(16, m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<std::int16_t>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(80);
-			m_data = (int8_t)input.read_int(16);
+			m_data = C::template read<std::int16_t>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_short* tag = new tag_short();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -395,13 +892,23 @@ namespace nbt {
 			return 3;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(32, m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<std::int32_t>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(96);
-			m_data = (int32_t)input.read_int(32);
+			m_data = C::template read<std::int32_t>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_int* tag = new tag_int();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -437,16 +944,26 @@ namespace nbt {
 		tag_long() = default;
 
 		inline virtual std::int8_t get_id() const {
-			return 2;
+			return 4;
 		}
 
-		virtual void write(byteoutstream& out) override {
-			out.write_int(64, m_data);
+		template<class C>
+		inline void write_impl(byteoutstream& out) {
+			C::template write<std::int64_t>(out, m_data);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(128);
-			m_data = (int64_t)input.read_int(64);
+			m_data = C::template read<std::int64_t>(input);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_long* tag = new tag_long();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		inline virtual std::int16_t get_short() const override {
@@ -480,26 +997,26 @@ namespace nbt {
 
 		std::int32_t* mp_data;
 		int m_dataSize;
-		tag_intarray() : mp_data(NULL), m_dataSize(0) {}
+		mutable std::atomic<cow_count*> mp_refs;//set while mp_data is shared with clones, published by clone()
+		tag_intarray() : mp_data(NULL), m_dataSize(0), mp_refs(NULL) {}
 
 		tag_intarray(const tag_intarray&) = delete;
 		tag_intarray& operator=(const tag_intarray&) = delete;
 
-		tag_intarray(tag_intarray&& rhs) {
-
-			clear_buffer();
-			mp_data = rhs.mp_data;
-			m_dataSize = rhs.m_dataSize;
+		tag_intarray(tag_intarray&& rhs) : mp_data(rhs.mp_data), m_dataSize(rhs.m_dataSize), mp_refs(rhs.mp_refs.load(std::memory_order_relaxed)) {
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 		}
 
 		tag_intarray& operator=(tag_intarray&& rhs) {
 			clear_buffer();
 			mp_data = rhs.mp_data;
 			m_dataSize = rhs.m_dataSize;
+			mp_refs = rhs.mp_refs.load(std::memory_order_relaxed);
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 			return *this;
 		}
 
@@ -507,29 +1024,78 @@ namespace nbt {
 			return 11;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			output.write_int(32, m_dataSize);
-			if (m_dataSize && mp_data) {
-				for (int i = 0; i < m_dataSize; i++)
-					output.write_int(32, mp_data[i]);
-			}
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			C::write_length(output, m_dataSize);
+			if (m_dataSize && mp_data)
+				C::write_array(output, mp_data, m_dataSize);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
-			clear_buffer();
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(192);
-			m_dataSize = input.read_int(32);
-			if (m_dataSize) {
-				size_tracker.read(8 * 4 * m_dataSize);
-				mp_data = new std::int32_t[m_dataSize];
-				for (int i = 0; i < m_dataSize; i++)
-					mp_data[i] = input.read_int(32);
+			std::int32_t size = C::read_length(input);
+			if (size < 0) {
+				clear_buffer();
+				throw exception("negative array length. corrupt tag?");
+			}
+			if (size && size == m_dataSize && mp_data && !mp_refs) {//decoding over this tag again, the buffer fits
+				size_tracker.read(8ull * 4 * size);
+				_NBT_STATS_ARRAY(11, size);
+				C::read_array(input, mp_data, size);
+				return;
+			}
+			clear_buffer();
+			if (size) {
+				size_tracker.read(8ull * 4 * size);
+				mp_data = new std::int32_t[size];
+				m_dataSize = size;
+				_NBT_STATS_ALLOC(sizeof(std::int32_t) * (std::uint64_t)size);
+				_NBT_STATS_ARRAY(11, size);
+				C::read_array(input, mp_data, size);
+			}
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		//the payload is shared with the original, see unshare
+		inline virtual base* clone() const override {
+			tag_intarray* tag = new tag_intarray();
+			if (m_dataSize && mp_data) {
+				cow_count* refs = mp_refs.load(std::memory_order_acquire);
+				if (!refs) {//first clone. other threads may be cloning this tag too, one count gets published
+					cow_count* fresh = new cow_count(1);
+					if (mp_refs.compare_exchange_strong(refs, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+						refs = fresh;
+					else delete fresh;
+				}
+				refs->fetch_add(1, std::memory_order_relaxed);
+				tag->mp_data = mp_data;
+				tag->m_dataSize = m_dataSize;
+				tag->mp_refs = refs;
+			}
+			return tag;
+		}
+
+		//gives this tag its own copy of a buffer shared with clones. call before writing through mp_data
+		inline void unshare() {
+			cow_count* refs = mp_refs.load(std::memory_order_relaxed);
+			if (!refs)
+				return;
+			if (refs->load(std::memory_order_acquire) != 1) {
+				std::int32_t* copy = new std::int32_t[m_dataSize];
+				memcpy(copy, mp_data, sizeof(std::int32_t) * (std::size_t)m_dataSize);
+				release_buffer();
+				mp_data = copy;
+			}
+			else {
+				delete refs;
+				mp_refs = NULL;
 			}
 		}
 
 		inline void clear_buffer() {
-			if (m_dataSize && mp_data)
-				delete[] mp_data;
+			release_buffer();
 			m_dataSize = 0;
 			mp_data = NULL;
 		}
@@ -538,6 +1104,21 @@ namespace nbt {
 			clear_buffer();
 		}
 
+	private:
+
+		//drops this tags reference, the last owner frees the buffer
+		inline void release_buffer() {
+			if (cow_count* refs = mp_refs.load(std::memory_order_relaxed)) {
+				if (refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					delete refs;
+					delete[] mp_data;
+				}
+				mp_refs = NULL;
+			}
+			else if (m_dataSize && mp_data)
+				delete[] mp_data;
+		}
+
 	};
 
 	class tag_longarray : public typed<std::int64_t*> {
@@ -545,26 +1126,26 @@ namespace nbt {
 
 		std::int64_t* mp_data;
 		int m_dataSize;
-		tag_longarray() : mp_data(NULL), m_dataSize(0) {}
+		mutable std::atomic<cow_count*> mp_refs;//set while mp_data is shared with clones, published by clone()
+		tag_longarray() : mp_data(NULL), m_dataSize(0), mp_refs(NULL) {}
 
 		tag_longarray(const tag_longarray&) = delete;
 		tag_longarray& operator=(const tag_longarray&) = delete;
 
-		tag_longarray(tag_longarray&& rhs) {
-
-			clear_buffer();
-			mp_data = rhs.mp_data;
-			m_dataSize = rhs.m_dataSize;
+		tag_longarray(tag_longarray&& rhs) : mp_data(rhs.mp_data), m_dataSize(rhs.m_dataSize), mp_refs(rhs.mp_refs.load(std::memory_order_relaxed)) {
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 		}
 
 		tag_longarray& operator=(tag_longarray&& rhs) {
 			clear_buffer();
 			mp_data = rhs.mp_data;
 			m_dataSize = rhs.m_dataSize;
+			mp_refs = rhs.mp_refs.load(std::memory_order_relaxed);
 			rhs.mp_data = NULL;
 			rhs.m_dataSize = 0;
+			rhs.mp_refs = NULL;
 			return *this;
 		}
 
@@ -572,29 +1153,78 @@ namespace nbt {
 			return 12;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			output.write_int(32, m_dataSize);
-			if (m_dataSize && mp_data) {
-				for (int i = 0; i < m_dataSize; i++)
-					output.write_int(64, mp_data[i]);
-			}
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			C::write_length(output, m_dataSize);
+			if (m_dataSize && mp_data)
+				C::write_array(output, mp_data, m_dataSize);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
-			clear_buffer();
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(192);
-			m_dataSize = input.read_int(32);
-			if (m_dataSize) {
-				size_tracker.read(8 * 8 * m_dataSize);
-				mp_data = new std::int64_t[m_dataSize];
-				for (int i = 0; i < m_dataSize; i++)
-					mp_data[i] = input.read_int(64);
+			std::int32_t size = C::read_length(input);
+			if (size < 0) {
+				clear_buffer();
+				throw exception("negative array length. corrupt tag?");
+			}
+			if (size && size == m_dataSize && mp_data && !mp_refs) {//decoding over this tag again, the buffer fits
+				size_tracker.read(8ull * 8 * size);
+				_NBT_STATS_ARRAY(12, size);
+				C::read_array(input, mp_data, size);
+				return;
+			}
+			clear_buffer();
+			if (size) {
+				size_tracker.read(8ull * 8 * size);
+				mp_data = new std::int64_t[size];
+				m_dataSize = size;
+				_NBT_STATS_ALLOC(sizeof(std::int64_t) * (std::uint64_t)size);
+				_NBT_STATS_ARRAY(12, size);
+				C::read_array(input, mp_data, size);
+			}
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		//the payload is shared with the original, see unshare
+		inline virtual base* clone() const override {
+			tag_longarray* tag = new tag_longarray();
+			if (m_dataSize && mp_data) {
+				cow_count* refs = mp_refs.load(std::memory_order_acquire);
+				if (!refs) {//first clone. other threads may be cloning this tag too, one count gets published
+					cow_count* fresh = new cow_count(1);
+					if (mp_refs.compare_exchange_strong(refs, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+						refs = fresh;
+					else delete fresh;
+				}
+				refs->fetch_add(1, std::memory_order_relaxed);
+				tag->mp_data = mp_data;
+				tag->m_dataSize = m_dataSize;
+				tag->mp_refs = refs;
+			}
+			return tag;
+		}
+
+		//gives this tag its own copy of a buffer shared with clones. call before writing through mp_data
+		inline void unshare() {
+			cow_count* refs = mp_refs.load(std::memory_order_relaxed);
+			if (!refs)
+				return;
+			if (refs->load(std::memory_order_acquire) != 1) {
+				std::int64_t* copy = new std::int64_t[m_dataSize];
+				memcpy(copy, mp_data, sizeof(std::int64_t) * (std::size_t)m_dataSize);
+				release_buffer();
+				mp_data = copy;
+			}
+			else {
+				delete refs;
+				mp_refs = NULL;
 			}
 		}
 
 		inline void clear_buffer() {
-			if (m_dataSize && mp_data)
-				delete[] mp_data;
+			release_buffer();
 			m_dataSize = 0;
 			mp_data = NULL;
 		}
@@ -603,6 +1233,21 @@ namespace nbt {
 			clear_buffer();
 		}
 
+	private:
+
+		//drops this tags reference, the last owner frees the buffer
+		inline void release_buffer() {
+			if (cow_count* refs = mp_refs.load(std::memory_order_relaxed)) {
+				if (refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					delete refs;
+					delete[] mp_data;
+				}
+				mp_refs = NULL;
+			}
+			else if (m_dataSize && mp_data)
+				delete[] mp_data;
+		}
+
 	};
 
 	class tag_string : public base {
@@ -614,21 +1259,44 @@ namespace nbt {
 			return 8;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			if (m_data.length() > std::numeric_limits<std::uint16_t>::max())
-				throw exception("cannot write string: more than 2^16-1 bytes");
-			output.write_int(16, m_data.length());
-			if(m_data.length() > 0)
-				output.write((const uint8*)m_data.c_str(), m_data.length());
+		template<class C>
+		static inline void write_string(byteoutstream& output, const std::string& str) {
+			if (str.length() > C::max_string_length)
+				throw exception("cannot write string: too many bytes for the string length prefix");
+			C::write_string_length(output, (std::uint32_t)str.length());
+			if (str.length() > 0)
+				output.write((const uint8*)str.data(), (uint32)str.length());
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		static inline void read_string(bytestream& input, std::string& str, size_tracker& size_tracker) {
 			size_tracker.read(36 * 8);
-			uint32 size = input.read_int(16);
-			size_tracker.read(16 * size);
-			uint8* buffer = input.read(size);
-			m_data.assign((const char*)buffer, size);
-			free(buffer);
+			std::uint32_t size = C::read_string_length(input);
+			size_tracker.read(16ull * size);
+			_NBT_STATS_STRING(size);
+			str.resize(size);
+			if (size)
+				input.read_to((uint8*)&str[0], size);
+		}
+
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			write_string<C>(output, m_data);
+		}
+
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
+			read_string<C>(input, m_data, size_tracker);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		//copied, not shared like array payloads: m_data is a std::string that callers and the decoders write in
+		//place, and std::string cannot share its buffer. the copy is one short allocation for game ids and names
+		inline virtual base* clone() const override {
+			tag_string* tag = new tag_string();
+			tag->m_data = m_data;
+			return tag;
 		}
 
 		virtual bool is_empty() const override {
@@ -637,6 +1305,149 @@ namespace nbt {
 
 	};
 
+	//compound layouts learned while decoding. every distinct sequence of (id, key) entries is a path in a tree
+	//of shapes, each remembering the transition taken last time so repeated layouts are followed by comparing
+	//key bytes in place. the shape a compound ends on keeps a prototype map with those keys, which is copied
+	//with its hash codes and bucket array instead of hashing and inserting each key again. install one per
+	//thread with shape_scope (decode_context does), see tag_compound::read_shaped
+	struct shape_cache {
+		struct shape {
+			shape* parent = NULL;
+			shape* hint = NULL;//transition taken last time, checked first
+			std::int8_t id = 0;
+			std::uint32_t count = 0;//entries from the root to here
+			std::string key;
+			std::unordered_map<std::string, shape*> next;//by id byte + key
+			shape* inner = NULL;//root for compounds read as the value of this entry, or inside it
+			bool built = false;
+			std::unordered_map<std::string, base*> prototype;//keys mapped to their entry index (not a tag), made when a compound first ends here
+			std::vector<std::uint32_t> dropped;//entries overwritten by a later duplicate key
+		};
+
+		//past limit shapes nothing new is learned, unknown layouts decode the usual way
+		explicit shape_cache(std::size_t limit = 0x4000) : m_limit(limit) {}
+
+		shape_cache(const shape_cache&) = delete;
+		shape_cache& operator=(const shape_cache&) = delete;
+
+		//must not be called while a decode is using the cache
+		void clear() {
+			m_shapes.clear();
+			m_root.next.clear();
+			m_root.hint = NULL;
+			m_context = NULL;
+		}
+
+		std::size_t size() const {
+			return m_shapes.size();
+		}
+
+		//the shape after an entry, NULL once the limit is reached. entry is the id byte followed by the key
+		inline shape* step(shape* from, const std::string& entry) {
+			auto it = from->next.find(entry);
+			if (it != from->next.end()) {
+				from->hint = it->second;
+				return it->second;
+			}
+			if (m_shapes.size() >= m_limit)
+				return NULL;
+			m_shapes.emplace_back();
+			shape* to = &m_shapes.back();
+			to->parent = from;
+			to->id = entry[0];
+			to->count = from->count + 1;
+			to->key.assign(entry, 1, std::string::npos);
+			from->next.emplace(entry, to);
+			from->hint = to;
+			return to;
+		}
+
+		//where a compound starts: nested compounds get a root per enclosing entry, an Item compound and a
+		//Pos list element then never compete for the same hint
+		inline shape* start(shape* context) {
+			if (!context)
+				return &m_root;
+			if (!context->inner && m_shapes.size() < m_limit) {
+				m_shapes.emplace_back();
+				context->inner = &m_shapes.back();
+			}
+			return context->inner ? context->inner : &m_root;
+		}
+
+		inline void build(shape* end) {
+			if (end->built)
+				return;
+			std::vector<const shape*> chain(end->count);
+			for (const shape* s = end; s->parent; s = s->parent)
+				chain[s->count - 1] = s;
+			std::unordered_map<std::string, std::uint32_t> last;
+			for (std::uint32_t i = 0; i < end->count; i++)
+				last[chain[i]->key] = i;//duplicate keys, last one wins
+			end->prototype.reserve(last.size());
+			for (std::uint32_t i = 0; i < end->count; i++) {
+				if (last[chain[i]->key] == i)
+					end->prototype.emplace(chain[i]->key, (base*)(std::uintptr_t)i);
+				else end->dropped.push_back(i);
+			}
+			end->built = true;
+		}
+
+		//keys of the entries leading to at, oldest first
+		inline void keys(const shape* at, std::vector<const std::string*>& out) const {
+			out.assign(at->count, NULL);
+			for (const shape* s = at; s->parent; s = s->parent)
+				out[s->count - 1] = &s->key;
+		}
+
+		shape m_root;
+		std::deque<shape> m_shapes;
+		std::size_t m_limit;
+		shape* m_context = NULL;//entry whose value is being read
+		std::vector<base*> m_children;//entries read so far by the compounds being decoded, innermost last
+
+		static shape_cache*& current() {
+			thread_local shape_cache* active = NULL;
+			return active;
+		}
+	};
+
+	class shape_scope {
+		shape_cache* m_prev;
+	public:
+		explicit shape_scope(shape_cache& cache) : m_prev(shape_cache::current()) {
+			shape_cache::current() = &cache;
+		}
+
+		~shape_scope() {
+			shape_cache::current() = m_prev;
+		}
+
+		shape_scope(const shape_scope&) = delete;
+		shape_scope& operator=(const shape_scope&) = delete;
+	};
+
+	//while one is alive on a thread, decoding into an existing tree reconciles it with the input instead of
+	//clearing it first: compounds and lists read over their matching children in place, see reread_tag_compound
+	class reuse_scope {
+		bool m_prev;
+	public:
+		reuse_scope() : m_prev(active()) {
+			active() = true;
+		}
+
+		~reuse_scope() {
+			active() = m_prev;
+		}
+
+		reuse_scope(const reuse_scope&) = delete;
+		reuse_scope& operator=(const reuse_scope&) = delete;
+
+		static bool& active() {
+			thread_local bool on = false;
+			return on;
+		}
+	};
+
 	class tag_compound : public base {
 	public:
 
@@ -646,39 +1457,233 @@ namespace nbt {
 			return 10;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			tag_string name_proxy{};
-			std::uint8_t id;
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			std::int8_t id;
 			for (auto it = m_tagMap.begin(); it != m_tagMap.end(); it++) {
 				id = it->second->get_id();
 				if (id != 0) {//!=end
-					output.write_int(8, id);
-					name_proxy.m_data = it->first;
-					name_proxy.write(output);
-					it->second->write(output);
+					C::template write<std::int8_t>(output, id);
+					tag_string::write_string<C>(output, it->first);
+					it->second->template write_as<C>(output);
 				}
 			}
-			output.write_int(8, 0);//end footer
+			C::template write<std::int8_t>(output, 0);//end footer
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(384);
 			if (depth > 0x200)
 				throw exception("Tried to read NBT with too high complexity, depth > 512");
+			if (reuse_scope::active()) {
+				read_over<C>(input, depth, size_tracker);
+				return;
+			}
 			clear();
-			std::uint64_t id;
-			tag_string name_proxy{};
-			while ((id = input.read_int(8)) != 0) {
-				name_proxy.read(input, depth, size_tracker);//size off by a few bytes, not important (288-224)
-				base* tag = base::create(static_cast<std::int8_t>(id));
-				if (!tag)
-					throw exception("error reading compound tag: tag id invalid. corrupt tag?");
-				tag->read(input, depth + 1, size_tracker);
-				m_tagMap.insert(std::make_pair(name_proxy.m_data, tag));
-				size_tracker.read(288);
+			if (shape_cache* shapes = shape_cache::current()) {
+				if (input.get_buffer()) {//keys are compared in place
+					read_shaped<C>(input, depth, size_tracker, *shapes);
+					return;
+				}
+			}
+			std::int8_t id;
+			std::string name;
+			while ((id = C::template read<std::int8_t>(input)) != 0) {
+				tag_string::read_string<C>(input, name, size_tracker);//size off by a few bytes, not important (288-224)
+				read_entry<C>(input, depth, size_tracker, id, name);
+			}
+		}
+
+		template<class C>
+		inline void read_entry(bytestream& input, int depth, size_tracker& size_tracker, std::int8_t id, const std::string& name) {
+			base* tag = read_child<C>(input, depth, size_tracker, id);
+			auto res = m_tagMap.emplace(name, tag);
+			if (!res.second) {//duplicate key, last one wins
+				delete res.first->second;
+				res.first->second = tag;
+			}
+			_NBT_STATS_ALLOC(sizeof(*res.first) + 2 * sizeof(void*));//map node
+			_NBT_STATS_STRING(name.size());
+			size_tracker.read(288);
+		}
+
+		template<class C>
+		static inline base* read_child(bytestream& input, int depth, size_tracker& size_tracker, std::int8_t id) {
+			base* tag = base::create(id);
+			if (!tag)
+				throw exception("error reading compound tag: tag id invalid. corrupt tag?");
+			try {
+				tag->template read_as<C>(input, depth + 1, size_tracker);
+			}
+			catch (...) {
+				delete tag;
+				throw;
+			}
+			return tag;
+		}
+
+		//decodes over the current entries: a key read again with the same id is read in place, with another id
+		//it is replaced, keys missing from the input are dropped. entries seen this pass are marked in the low
+		//bit of their pointer until the sweep at the end, which also runs when the input turns out bad
+		template<class C>
+		inline void read_over(bytestream& input, int depth, size_tracker& size_tracker) {
+			const std::uintptr_t seen = 1;
+			std::int8_t id;
+			thread_local std::string name;//free again once the entry is found, before its value is read
+			try {
+				while ((id = C::template read<std::int8_t>(input)) != 0) {
+					tag_string::read_string<C>(input, name, size_tracker);
+					auto it = m_tagMap.find(name);
+					if (it == m_tagMap.end()) {
+						it = m_tagMap.emplace(name, (base*)NULL).first;//NULL until read, the sweep drops it on failure
+						it->second = (base*)((std::uintptr_t)read_child<C>(input, depth, size_tracker, id) | seen);
+						_NBT_STATS_ALLOC(sizeof(*it) + 2 * sizeof(void*));
+					}
+					else {
+						base* tag = (base*)((std::uintptr_t)it->second & ~seen);
+						it->second = (base*)((std::uintptr_t)tag | seen);
+						if (tag->get_id() == id)
+							tag->template read_as<C>(input, depth + 1, size_tracker);
+						else {
+							base* fresh = read_child<C>(input, depth, size_tracker, id);
+							delete tag;
+							it->second = (base*)((std::uintptr_t)fresh | seen);
+						}
+					}
+					size_tracker.read(288);
+				}
+			}
+			catch (...) {
+				sweep(seen);
+				throw;
+			}
+			sweep(seen);
+		}
+
+		inline void sweep(std::uintptr_t seen) {
+			for (auto it = m_tagMap.begin(); it != m_tagMap.end();) {
+				if ((std::uintptr_t)it->second & seen) {
+					it->second = (base*)((std::uintptr_t)it->second & ~seen);
+					it++;
+				}
+				else {
+					delete it->second;
+					it = m_tagMap.erase(it);
+				}
 			}
 		}
 
+		//follows the learned shapes while the entries match them. children are parked on the cache's stack
+		//until the end tag, then the map is copied from the prototype of the shape reached and filled in
+		template<class C>
+		inline void read_shaped(bytestream& input, int depth, size_tracker& size_tracker, shape_cache& shapes) {
+			std::vector<base*>& children = shapes.m_children;
+			const std::size_t first = children.size();
+			shape_cache::shape* const outer = shapes.m_context;
+			shape_cache::shape* at = shapes.start(outer);
+			std::string entry;//id byte + key, only filled when the hint misses
+			std::unordered_map<std::string, base*> map;
+			std::int8_t id;
+			try {
+				while ((id = C::template read<std::int8_t>(input)) != 0) {
+					size_tracker.read(36 * 8);
+					std::uint32_t length = C::read_string_length(input);
+					size_tracker.read(16ull * length);
+					_NBT_STATS_STRING(length);
+					shape_cache::shape* next = at->hint;
+					uint64 pos = input.get_position();
+					if (next && next->id == id && next->key.size() == length && length <= input.get_stream_size() - pos
+						&& !memcmp(input.get_buffer() + pos, next->key.data(), length)) {
+						input.seek_cur(length);
+					}
+					else {
+						entry.resize(length + 1);
+						entry[0] = (char)id;
+						if (length)
+							input.read_to((uint8*)&entry[1], length);
+						next = shapes.step(at, entry);
+						if (!next) {//out of room for new shapes, the rest goes the usual way
+							spill(shapes, at, first);
+							std::string name = entry.substr(1);
+							read_entry<C>(input, depth, size_tracker, id, name);
+							while ((id = C::template read<std::int8_t>(input)) != 0) {
+								tag_string::read_string<C>(input, name, size_tracker);
+								read_entry<C>(input, depth, size_tracker, id, name);
+							}
+							shapes.m_context = outer;
+							return;
+						}
+					}
+					shapes.m_context = next;
+					children.push_back(read_child<C>(input, depth, size_tracker, id));
+					at = next;
+					size_tracker.read(288);
+				}
+				shapes.m_context = outer;
+				shapes.build(at);
+				map = at->prototype;
+			}
+			catch (...) {
+				shapes.m_context = outer;
+				for (std::size_t i = first; i < children.size(); i++)
+					delete children[i];
+				children.resize(first);
+				throw;
+			}
+			//each copied node still holds its entry index, so the fill doesn't depend on the copy's iteration order
+			for (auto& slot : map) {
+				slot.second = children[first + (std::uint32_t)(std::uintptr_t)slot.second];
+				_NBT_STATS_ALLOC(sizeof(slot) + 2 * sizeof(void*));
+				_NBT_STATS_STRING(slot.first.size());
+			}
+			for (std::uint32_t index : at->dropped)
+				delete children[first + index];
+			children.resize(first);
+			m_tagMap = std::move(map);
+		}
+
+		//moves the children read so far into the map, keyed by the shapes they came through
+		inline void spill(shape_cache& shapes, const shape_cache::shape* at, std::size_t first) {
+			std::vector<const std::string*> keys;
+			shapes.keys(at, keys);
+			std::vector<base*>& children = shapes.m_children;
+			for (std::size_t i = 0; i < keys.size(); i++) {
+				base* tag = children[first + i];
+				children[first + i] = NULL;
+				auto res = m_tagMap.emplace(*keys[i], tag);
+				if (!res.second) {
+					delete res.first->second;
+					res.first->second = tag;
+				}
+			}
+			children.resize(first);
+		}
+
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_compound* tag = new tag_compound();
+			try {
+				tag->m_tagMap.reserve(m_tagMap.size());
+				for (auto it = m_tagMap.begin(); it != m_tagMap.end(); it++) {
+					base* child = it->second->clone();
+					try {
+						tag->m_tagMap.emplace(it->first, child);
+					}
+					catch (...) {
+						delete child;
+						throw;
+					}
+				}
+			}
+			catch (...) {
+				delete tag;
+				throw;
+			}
+			return tag;
+		}
+
 		void clear() {
 			for (auto it = m_tagMap.begin(); it != m_tagMap.end(); it++) {
 				delete it->second;
@@ -705,41 +1710,109 @@ namespace nbt {
 			return 9;
 		}
 
-		virtual void write(byteoutstream& output) override {
-			output.write_int(8, m_tagType);
-			output.write_int(32, m_tagList.size());
+		template<class C>
+		inline void write_impl(byteoutstream& output) {
+			C::template write<std::int8_t>(output, m_tagType);
+			C::write_length(output, (std::int32_t)m_tagList.size());
 			for (auto it = m_tagList.begin(); it != m_tagList.end(); it++)
-				(*it)->write(output);
+				(*it)->template write_as<C>(output);
 		}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(296);
 			if (depth > 0x200)
 				throw exception("Tried to read NBT with too high complexity, depth > 512");
-			m_tagType = input.read_int(8);
-			size_t size = input.read_int(32);
-			if (m_tagType == 0 && size > 0)
+			std::int8_t type = C::template read<std::int8_t>(input);
+			std::int32_t size = C::read_length(input);
+			if (size < 0)
+				throw exception("negative list length. corrupt tag?");
+			if (type == 0 && size > 0)
 				throw exception("missing type on list tag");
-			size_tracker.read(size * 32);
-			for (int i = 0; i < size; i++) {
+			size_tracker.read(size * 32ull);
+			std::int32_t kept = 0;
+			if (reuse_scope::active()) {//elements of the same type are read over in place, the rest is dropped
+				if (type == m_tagType)
+					kept = (std::int32_t)std::min<std::size_t>(size, m_tagList.size());
+				for (std::size_t i = kept; i < m_tagList.size(); i++)
+					delete m_tagList[i];
+				m_tagList.resize(kept);
+			}
+			m_tagType = type;
+			for (std::int32_t i = 0; i < kept; i++)
+				m_tagList[i]->template read_as<C>(input, depth + 1, size_tracker);
+			//every element takes at least a byte, so never reserve more than whats left in the stream
+			std::uint64_t left = input.get_stream_size() - input.get_position();
+#ifdef _NBT_STATS
+			std::size_t capacity = m_tagList.capacity();
+#endif
+			m_tagList.reserve(m_tagList.size() + ((std::uint64_t)(size - kept) < left ? size - kept : left));
+			_NBT_STATS_ALLOC((m_tagList.capacity() - capacity) * sizeof(base*));
+			for (std::int32_t i = kept; i < size; i++) {
 				base* tag = base::create(m_tagType);
 				if (!tag)
 					throw exception("error reading compound tag: tag id invalid. corrupt tag?");
-				tag->read(input, depth + 1, size_tracker);
+				try {
+					tag->template read_as<C>(input, depth + 1, size_tracker);
+				}
+				catch (...) {
+					delete tag;
+					throw;
+				}
 				m_tagList.push_back(tag);
 			}
 		}
 
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			tag_list* tag = new tag_list();
+			tag->m_tagType = m_tagType;
+			try {
+				tag->m_tagList.reserve(m_tagList.size());
+				for (auto it = m_tagList.begin(); it != m_tagList.end(); it++)
+					tag->m_tagList.push_back((*it)->clone());
+			}
+			catch (...) {
+				delete tag;
+				throw;
+			}
+			return tag;
+		}
+
 		base* pop_tag() {
 			base* end = m_tagList.back();
 			m_tagList.pop_back();
 			return end;
 		}
 
-		std::int8_t get_tag_type() {
+		std::int8_t get_tag_type() const {
 			return m_tagType;
 		}
 
+		//element type of an empty list, which append_tag cannot infer
+		void set_tag_type(std::int8_t type) {
+			if (m_tagList.size() && type != m_tagType)
+				throw exception("cannot change the element type of a non empty list");
+			m_tagType = type;
+		}
+
+		const std::vector<base*>& get_tags() const {
+			return m_tagList;
+		}
+
+		std::size_t capacity() const {
+			return m_tagList.capacity();
+		}
+
+		void shrink_to_fit() {
+			m_tagList.shrink_to_fit();
+		}
+
+		std::size_t size() const {
+			return m_tagList.size();
+		}
+
 		//WARNING: assumes transfer of ownership to this (i.e, deletes after done)
 		void append_tag(base* tag) {
 			if (!tag)
@@ -753,6 +1826,46 @@ namespace nbt {
 			}
 		}
 
+		//WARNING: assumes transfer of ownership to this. inserts before index, same type rules as append_tag
+		void insert_tag(std::size_t index, base* tag) {
+			if (!tag)
+				throw exception("null tag passed to tag_list::insert");
+			if (index > m_tagList.size())
+				throw exception("list insert index out of range");
+			if (tag->get_id() != 0) {
+				if (m_tagList.size() == 0)
+					m_tagType = tag->get_id();
+				else if (m_tagType != tag->get_id())
+					throw exception("trying to add tag of different type to list tag");
+				m_tagList.insert(m_tagList.begin() + index, tag);
+			}
+		}
+
+		//WARNING: assumes transfer of ownership to this. puts tag at index and hands back the tag it replaces,
+		//which the caller now owns. tag must have the list's type unless it is the only element
+		base* replace_tag(std::size_t index, base* tag) {
+			if (!tag || tag->get_id() == 0)
+				throw exception("null or end tag passed to tag_list::replace");
+			if (index >= m_tagList.size())
+				throw exception("list replace index out of range");
+			if (m_tagList.size() == 1)
+				m_tagType = tag->get_id();
+			else if (m_tagType != tag->get_id())
+				throw exception("trying to add tag of different type to list tag");
+			base* old = m_tagList[index];
+			m_tagList[index] = tag;
+			return old;
+		}
+
+		//deletes count tags starting at index
+		void erase_tags(std::size_t index, std::size_t count) {
+			if (index > m_tagList.size() || count > m_tagList.size() - index)
+				throw exception("list erase range out of range");
+			for (std::size_t i = index; i < index + count; i++)
+				delete m_tagList[i];
+			m_tagList.erase(m_tagList.begin() + index, m_tagList.begin() + index + count);
+		}
+
 		//check by ptr
 		void remove_tag_direct(const base* const tag_ptr) {
 			for (auto it = m_tagList.begin(); it != m_tagList.end(); it++)
@@ -782,72 +1895,202 @@ namespace nbt {
 			return 0;
 		}
 
-		virtual void write(byteoutstream& output) override {}
+		template<class C>
+		inline void write_impl(byteoutstream& output) {}
 
-		virtual void read(bytestream& input, int depth, size_tracker& size_tracker) override {
+		template<class C>
+		inline void read_impl(bytestream& input, int depth, size_tracker& size_tracker) {
 			size_tracker.read(64);
 		}
 
+		_NBT_CODEC_OVERRIDES
+
+		inline virtual base* clone() const override {
+			return new tag_end();
+		}
+
 	};
 
-	inline void write_tag(byteoutstream& output, base* input) {
+	//one step of a path into nested compounds/lists, a key or a list index
+	struct path_step {
+		static constexpr int each = -2;//index matching every element, where a path is a pattern (see nbt_index.h)
+
+		std::string key;
+		std::int64_t index;
+
+		path_step(const char* k) : key(k), index(-1) {}
+		path_step(std::string k) : key(std::move(k)), index(-1) {}
+		path_step(int i) : index(i) {}
+	};
+
+	//path from a list element or chunk root down to a field, e.g. { "Pos", 0 } or { "Item", "id" }
+	typedef std::vector<path_step> field_path;
+
+#ifndef _NBT_NO_COMPRESS
+	//inflates everything from the current position to the end of input (gzip or zlib, auto detected).
+	//returns a malloc'd buffer, ownership goes to the caller (normally handed to a bytestream)
+	inline uint8* inflate_remaining(bytestream& input, uint64& out_size) {
+		uint32 in_size = (uint32)(input.get_stream_size() - input.get_position());
+		z_stream stream = { 0 };
+		uint8* in = input.read(in_size);//load it all, nbt depth prevents bigger files. shouldnt be >1gb
+		byteoutstream out_buf = byteoutstream(_NBT_GZIP_CHUNK);
+		out_buf.keep_buffer(true);
+		uint8 out[_NBT_GZIP_CHUNK];
+		memset(out, 0, _NBT_GZIP_CHUNK);
+		stream.zalloc = Z_NULL;
+		stream.zfree = Z_NULL;
+		stream.opaque = 0;
+		stream.next_in = in;
+		stream.avail_in = in_size;
+		uint64 z = 0;
+		int stat;
+		inflateInit2(&stream, 47);//15, add mask of 32 (1bit) to enable gz
+		do {
+			stream.avail_out = _NBT_GZIP_CHUNK;
+			stream.next_out = out;
+			stat = inflate(&stream, Z_NO_FLUSH);
+			if (!(stat == Z_OK || stat == Z_STREAM_END || stat == Z_BUF_ERROR)) {
+				inflateEnd(&stream);
+				free(in);
+				free(out_buf.get_buffer());
+				throw exception("bad gzip compressed data");
+			}
+			z += (_NBT_GZIP_CHUNK - stream.avail_out);
+			out_buf.write(out, _NBT_GZIP_CHUNK - stream.avail_out);
+
+		} while (stream.avail_out == 0);
+		inflateEnd(&stream);
+		free(in);
+		out_size = z;
+		return out_buf.get_buffer();
+	}
+#endif
+
+	//root tag (id, name, payload) in codec C, uncompressed. the root name is skipped
+	template<class C>
+	inline void write_tag_as(byteoutstream& output, base* input) {
 		if (input) {
-			endian e = output.get_endian();
-			output.set_endian(BIG_ENDIAN);
-			output.write_int(8, input->get_id());
-			output.write_int(16, 0);//empty utf
-			input->write(output);
-			output.set_endian(e);
+			C::template write<std::int8_t>(output, input->get_id());
+			C::write_string_length(output, 0);//empty utf
+			input->template write_as<C>(output);
 		}
 	}
 
-	inline base* read_tag(bytestream& input, size_tracker& tracker) {
-		endian e = input.get_endian();
-		input.set_endian(BIG_ENDIAN);
+	template<class C>
+	inline base* read_tag_as(bytestream& input, size_tracker& tracker) {
+		std::int8_t head = C::template read<std::int8_t>(input);
+		base* tag = base::create(head);
+		if (!tag)
+			throw exception("tag not created (invalid/out of mem)");
+		try {
+			input.seek_cur(C::read_string_length(input));
+			tag->template read_as<C>(input, 0, tracker);
+		}
+		catch (...) {
+			delete tag;
+			throw;
+		}
+		return tag;
+	}
+
+	template<class C>
+	inline void read_tag_compound_as(bytestream& input, tag_compound& output, size_tracker& tracker) {
+		std::int8_t head = C::template read<std::int8_t>(input);
+		if (head != output.get_id())
+			throw exception("not a compound tag");
+		input.seek_cur(C::read_string_length(input));
+		output.template read_as<C>(input, 0, tracker);
+	}
+
+	inline void write_tag(byteoutstream& output, base* input, format fmt) {
+		_NBT_STATS_TIMER(write_start);
+		_NBT_STATS_BEGIN(output);
+		switch (fmt) {
+		case format::java:
+			write_tag_as<be_codec>(output, input);
+			break;
+		case format::bedrock:
+			write_tag_as<le_codec>(output, input);
+			break;
+		case format::bedrock_network:
+			write_tag_as<varint_codec>(output, input);
+			break;
+		}
+		_NBT_STATS_ADD(stream_bytes_out, output.get_position() - _nbt_stats_pos);
+		_NBT_STATS_ELAPSED(write_ns, write_start);
+	}
+
+	inline void write_tag(byteoutstream& output, base* input) {
+		write_tag(output, input, format::java);
+	}
+
+	//uncompressed root in fmt, timed as parse time
+	inline base* read_tag_uncompressed(bytestream& input, size_tracker& tracker, format fmt) {
+		_NBT_STATS_TIMER(parse_start);
+		base* tag;
+		switch (fmt) {
+		case format::bedrock:
+			tag = read_tag_as<le_codec>(input, tracker);
+			break;
+		case format::bedrock_network:
+			tag = read_tag_as<varint_codec>(input, tracker);
+			break;
+		default:
+			tag = read_tag_as<be_codec>(input, tracker);
+			break;
+		}
+		_NBT_STATS_ELAPSED(parse_ns, parse_start);
+		return tag;
+	}
+
+	inline void read_tag_compound_uncompressed(bytestream& input, tag_compound& output, size_tracker& tracker, format fmt) {
+		_NBT_STATS_TIMER(parse_start);
+		switch (fmt) {
+		case format::bedrock:
+			read_tag_compound_as<le_codec>(input, output, tracker);
+			break;
+		case format::bedrock_network:
+			read_tag_compound_as<varint_codec>(input, output, tracker);
+			break;
+		default:
+			read_tag_compound_as<be_codec>(input, output, tracker);
+			break;
+		}
+		_NBT_STATS_ELAPSED(parse_ns, parse_start);
+	}
+
+#ifndef _NBT_NO_COMPRESS
+	//inflates the rest of input into a new in memory stream, timed as inflate time
+	inline uint8* inflate_for_read(bytestream& input, uint64& size) {
+		_NBT_STATS_ADD(stream_bytes_in, input.get_stream_size() - input.get_position());
+		_NBT_STATS_TIMER(inflate_start);
+		uint8* buffer = inflate_remaining(input, size);
+		_NBT_STATS_ELAPSED(inflate_ns, inflate_start);
+		_NBT_STATS_ADD(inflated_bytes, size);
+		return buffer;
+	}
+#endif
+
+	//compressed input is detected by the gzip magic, which is never a valid tag id
+	inline base* read_tag(bytestream& input, size_tracker& tracker, format fmt) {
 		std::int8_t head = input.read();
+		input.seek_beg(input.get_position() - 1);
 #ifndef _NBT_NO_COMPRESS
 		if (head == _NBT_GZIP_MAGIC) {//compressed
-			input.seek_beg(input.get_position() - 1);
-			z_stream stream = { 0 };
-			uint8* in = input.read((uint32)input.get_stream_size());//load it all, nbt depth prevents bigger files. shouldnt be >1gb
-			byteoutstream out_buf = byteoutstream(_NBT_GZIP_CHUNK);
-			out_buf.keep_buffer(true);
-			uint8 out[_NBT_GZIP_CHUNK];
-			memset(out, 0, _NBT_GZIP_CHUNK);
-			stream.zalloc = Z_NULL;
-			stream.zfree = Z_NULL;
-			stream.opaque = 0;
-			stream.avail_in = 0;
-			stream.next_in = in;
-			uint64 z = 0;
-			int stat;
-			stream.avail_in = (uint32)input.get_stream_size();
-			inflateInit2(&stream, 47);//15, add mask of 32 (1bit) to enable gz
-			do {
-				stream.avail_out = _NBT_GZIP_CHUNK;
-				stream.next_out = out;
-				stat = inflate(&stream, Z_NO_FLUSH);
-				if (!(stat == Z_OK || stat == Z_STREAM_END || stat == Z_BUF_ERROR)) {
-					inflateEnd(&stream);
-					throw exception("bad gzip compressed data");
-				}
-				z += (_NBT_GZIP_CHUNK - stream.avail_out);
-				out_buf.write(out, _NBT_GZIP_CHUNK - stream.avail_out);
-
-			} while (stream.avail_out == 0);
-			inflateEnd(&stream);
-			free(in);
-			bytestream nstream = bytestream(out_buf.get_buffer(), z);
-			input.set_endian(e);
-			return read_tag(nstream, tracker);
+			uint64 z;
+			uint8* buffer = inflate_for_read(input, z);
+			bytestream nstream = bytestream(buffer, z);
+			return read_tag_uncompressed(nstream, tracker, fmt);
 		}
 #endif
-		base* tag = base::create((std::int8_t)head);
-		if (!tag)
-			throw exception("tag not created (invalid/out of mem)");
-		input.seek_cur(input.read_int(16));
-		tag->read(input, 0, tracker);
-		input.set_endian(e);
+		_NBT_STATS_BEGIN(input);
+		base* tag = read_tag_uncompressed(input, tracker, fmt);
+		_NBT_STATS_ADD(stream_bytes_in, input.get_position() - _nbt_stats_pos);
+		return tag;
+	}
+
+	inline base* read_tag(bytestream& input, size_tracker& tracker) {
+		return read_tag(input, tracker, format::java);
 	}
 
 	inline base* read_tag(bytestream& input) {
@@ -855,53 +2098,25 @@ namespace nbt {
 		return read_tag(input, _tracker);
 	}
 
-	inline void read_tag_compound(bytestream& input, tag_compound& output, size_tracker& tracker) {
-		endian e = input.get_endian();
-		input.set_endian(BIG_ENDIAN);
-		std::int8_t head = input.read_int(8);
+	inline void read_tag_compound(bytestream& input, tag_compound& output, size_tracker& tracker, format fmt) {
+		std::int8_t head = input.read();
+		input.seek_beg(input.get_position() - 1);
 #ifndef _NBT_NO_COMPRESS
 		if (head == _NBT_GZIP_MAGIC) {//compressed
-			input.seek_beg(input.get_position() - 1);
-			z_stream stream = { 0 };
-			uint8* in = input.read((uint32)input.get_stream_size());//load it all, nbt depth prevents bigger files. shouldnt be >1gb
-			byteoutstream out_buf = byteoutstream(_NBT_GZIP_CHUNK);
-			out_buf.keep_buffer(true);
-			uint8 out[_NBT_GZIP_CHUNK];
-			memset(out, 0, _NBT_GZIP_CHUNK);
-			stream.zalloc = Z_NULL;
-			stream.zfree = Z_NULL;
-			stream.opaque = 0;
-			stream.avail_in = 0;
-			stream.next_in = in;
-			uint64 z=0;
-			int stat;
-			stream.avail_in = (uint32)input.get_stream_size();
-			inflateInit2(&stream, 47);//15, add mask of 32 (1bit) to enable gz
-			do {
-				stream.avail_out = _NBT_GZIP_CHUNK;
-				stream.next_out = out;
-				stat = inflate(&stream, Z_NO_FLUSH);
-				if (!(stat == Z_OK || stat == Z_STREAM_END || stat == Z_BUF_ERROR)) {
-					inflateEnd(&stream);
-					throw exception("bad gzip compressed data");
-				}
-				z += (_NBT_GZIP_CHUNK - stream.avail_out);
-				out_buf.write(out, _NBT_GZIP_CHUNK - stream.avail_out);
-
-			} while (stream.avail_out == 0);
-			inflateEnd(&stream);
-			free(in);
-			bytestream nstream = bytestream(out_buf.get_buffer(), z);
-			read_tag_compound(nstream, output, tracker);
-			input.set_endian(e);
+			uint64 z;
+			uint8* buffer = inflate_for_read(input, z);
+			bytestream nstream = bytestream(buffer, z);
+			read_tag_compound_uncompressed(nstream, output, tracker, fmt);
 			return;
 		}
 #endif
-		if (head != output.get_id())
-			throw exception("not a compound tag");
-		input.seek_cur(input.read_int(16));
-		output.read(input, 0, tracker);
-		input.set_endian(e);
+		_NBT_STATS_BEGIN(input);
+		read_tag_compound_uncompressed(input, output, tracker, fmt);
+		_NBT_STATS_ADD(stream_bytes_in, input.get_position() - _nbt_stats_pos);
+	}
+
+	inline void read_tag_compound(bytestream& input, tag_compound& output, size_tracker& tracker) {
+		read_tag_compound(input, output, tracker, format::java);
 	}
 
 	inline void read_tag_compound(bytestream& input, tag_compound& output) {
@@ -909,39 +2124,246 @@ namespace nbt {
 		read_tag_compound(input, output, _tracker);
 	}
 
-	base* base::create(std::int8_t id) {
+	//decodes over output, which keeps the nodes, strings and array buffers that the input matches (see
+	//reuse_scope). re-decoding uncompressed input of the same shape allocates nothing. on failure output is left valid
+	//but only partly updated
+	inline void reread_tag_compound(bytestream& input, tag_compound& output, size_tracker& tracker, format fmt) {
+		reuse_scope reuse;
+		read_tag_compound(input, output, tracker, fmt);
+	}
+
+	inline void reread_tag_compound(bytestream& input, tag_compound& output) {
+		size_tracker _tracker = size_tracker(inf);
+		reread_tag_compound(input, output, _tracker, format::java);
+	}
+
+	//bedrock level.dat: int32 storage version and int32 payload length (both little endian), then little endian nbt.
+	//returns the storage version
+	inline std::int32_t read_bedrock_level(bytestream& input, tag_compound& output, size_tracker& tracker) {
+		std::int32_t version = input.read_le<std::int32_t>();
+		std::int32_t length = input.read_le<std::int32_t>();
+		if (length < 0 || (std::uint64_t)length > input.get_stream_size() - input.get_position())
+			throw exception("bedrock level header length is past the end of the stream");
+		read_tag_compound_as<le_codec>(input, output, tracker);
+		return version;
+	}
+
+	inline std::int32_t read_bedrock_level(bytestream& input, tag_compound& output) {
+		size_tracker _tracker = size_tracker(inf);
+		return read_bedrock_level(input, output, _tracker);
+	}
+
+	inline void write_bedrock_level(byteoutstream& output, tag_compound* input, std::int32_t version) {
+		output.write_le<std::int32_t>(version);
+		uint64 length_pos = output.get_position();
+		output.write_le<std::int32_t>(0);//patched below
+		write_tag_as<le_codec>(output, input);
+		uint64 end = output.get_position();
+		output.seek_beg(length_pos);
+		output.write_le<std::int32_t>((std::int32_t)(end - length_pos - 4));
+		output.seek_beg(end);
+	}
+
+	//cleared tags that base::create hands out instead of allocating, per tag id. installed on a thread by
+	//a decode_context (nbt_batch.h), which also fills it with the nodes of trees it is given back
+	struct tag_cache {
+		std::vector<base*> m_free[13];
+
+		inline base* take(std::int8_t id) {
+			std::vector<base*>& list = m_free[id];
+			if (list.empty())
+				return NULL;
+			base* tag = list.back();
+			list.pop_back();
+			return tag;
+		}
+
+		static tag_cache*& current() {
+			thread_local tag_cache* active = NULL;
+			return active;
+		}
+	};
+
+	inline base* base::create(std::int8_t id) {
+		if ((std::uint8_t)id < 13) {
+			if (tag_cache* cache = tag_cache::current())
+				if (base* tag = cache->take(id))
+					return tag;
+		}
 		switch (id) {
 		case 0:
-			return new tag_end;
+			return _NBT_STATS_NEW(tag_end);
 		case 1:
-			return new tag_byte;
+			return _NBT_STATS_NEW(tag_byte);
 		case 2:
-			return new tag_short;
+			return _NBT_STATS_NEW(tag_short);
 		case 3:
-			return new tag_int;
+			return _NBT_STATS_NEW(tag_int);
 		case 4:
-			return new tag_long;
+			return _NBT_STATS_NEW(tag_long);
 		case 5:
-			return new tag_float;
+			return _NBT_STATS_NEW(tag_float);
 		case 6:
-			return new tag_double;
+			return _NBT_STATS_NEW(tag_double);
 		case 7:
-			return new tag_bytearray;
+			return _NBT_STATS_NEW(tag_bytearray);
 		case 8:
-			return new tag_string;
+			return _NBT_STATS_NEW(tag_string);
 		case 9:
-			return new tag_list;
+			return _NBT_STATS_NEW(tag_list);
 		case 10:
-			return new tag_compound;
+			return _NBT_STATS_NEW(tag_compound);
 		case 11:
-			return new tag_intarray;
+			return _NBT_STATS_NEW(tag_intarray);
 		case 12:
-			return new tag_longarray;
+			return _NBT_STATS_NEW(tag_longarray);
 		default:
 			return NULL;
 		}
 	}
 
+	inline void base::memory_usage(memory_report& report) const {
+		std::int8_t id = get_id();
+		switch (id) {
+		case 0:
+			report.tags[0] += memory_report::block(sizeof(tag_end));
+			break;
+		case 1:
+			report.tags[1] += memory_report::block(sizeof(tag_byte));
+			break;
+		case 2:
+			report.tags[2] += memory_report::block(sizeof(tag_short));
+			break;
+		case 3:
+			report.tags[3] += memory_report::block(sizeof(tag_int));
+			break;
+		case 4:
+			report.tags[4] += memory_report::block(sizeof(tag_long));
+			break;
+		case 5:
+			report.tags[5] += memory_report::block(sizeof(tag_float));
+			break;
+		case 6:
+			report.tags[6] += memory_report::block(sizeof(tag_double));
+			break;
+		case 7: {
+			const tag_bytearray* tag = tag_cast<tag_bytearray>(this);
+			report.tags[7] += memory_report::block(sizeof(tag_bytearray));
+			if (tag->m_dataSize && tag->mp_data) {
+				std::uint64_t bytes = memory_report::block((std::uint64_t)tag->m_dataSize);
+				report.payload[7] += bytes;
+				if (tag->mp_refs)
+					report.shared += bytes;
+			}
+			break;
+		}
+		case 8: {
+			const tag_string* tag = static_cast<const tag_string*>(this);
+			std::uint64_t bytes = memory_report::string_block(tag->m_data.capacity());
+			report.tags[8] += memory_report::block(sizeof(tag_string));
+			report.payload[8] += bytes;
+			if (bytes)
+				report.slack += tag->m_data.capacity() - tag->m_data.size();
+			break;
+		}
+		case 9: {
+			const tag_list* tag = static_cast<const tag_list*>(this);
+			report.tags[9] += memory_report::block(sizeof(tag_list));
+			if (tag->capacity()) {
+				report.lists += memory_report::block(tag->capacity() * sizeof(base*));
+				report.slack += (tag->capacity() - tag->size()) * sizeof(base*);
+			}
+			for (const base* child : tag->get_tags())
+				child->memory_usage(report);
+			break;
+		}
+		case 10: {
+			const tag_compound* tag = static_cast<const tag_compound*>(this);
+			const std::size_t node = sizeof(void*) + sizeof(std::pair<const std::string, base*>) + sizeof(std::size_t);
+			report.tags[10] += memory_report::block(sizeof(tag_compound));
+			std::size_t buckets = tag->m_tagMap.bucket_count();
+			if (buckets > 1) {//a single bucket lives inside the map
+				report.buckets += memory_report::block(buckets * sizeof(void*));
+				std::size_t needed = (std::size_t)std::ceil(tag->m_tagMap.size() / tag->m_tagMap.max_load_factor());
+				if (buckets > needed)
+					report.slack += (buckets - needed) * sizeof(void*);
+			}
+			for (auto it = tag->m_tagMap.begin(); it != tag->m_tagMap.end(); it++) {
+				std::uint64_t key = memory_report::string_block(it->first.capacity());
+				report.nodes += memory_report::block(node) + key;
+				if (key)
+					report.slack += it->first.capacity() - it->first.size();
+				it->second->memory_usage(report);
+			}
+			break;
+		}
+		case 11: {
+			const tag_intarray* tag = tag_cast<tag_intarray>(this);
+			report.tags[11] += memory_report::block(sizeof(tag_intarray));
+			if (tag->m_dataSize && tag->mp_data) {
+				std::uint64_t bytes = memory_report::block((std::uint64_t)tag->m_dataSize * 4);
+				report.payload[11] += bytes;
+				if (tag->mp_refs)
+					report.shared += bytes;
+			}
+			break;
+		}
+		case 12: {
+			const tag_longarray* tag = tag_cast<tag_longarray>(this);
+			report.tags[12] += memory_report::block(sizeof(tag_longarray));
+			if (tag->m_dataSize && tag->mp_data) {
+				std::uint64_t bytes = memory_report::block((std::uint64_t)tag->m_dataSize * 8);
+				report.payload[12] += bytes;
+				if (tag->mp_refs)
+					report.shared += bytes;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	inline std::uint64_t base::memory_usage() const {
+		memory_report report;
+		memory_usage(report);
+		return report.total();
+	}
+
+	inline void base::compact() {
+		switch (get_id()) {
+		case 8:
+			static_cast<tag_string*>(this)->m_data.shrink_to_fit();
+			break;
+		case 9: {
+			tag_list* tag = static_cast<tag_list*>(this);
+			tag->shrink_to_fit();
+			for (base* child : tag->get_tags())
+				child->compact();
+			break;
+		}
+		case 10: {
+			tag_compound* tag = static_cast<tag_compound*>(this);
+			//keys are const in the map: the nodes of long keys with spare capacity are taken out, shrunk and put back
+			std::vector<std::unordered_map<std::string, base*>::node_type> loose;
+			for (auto it = tag->m_tagMap.begin(); it != tag->m_tagMap.end();) {
+				it->second->compact();
+				if (memory_report::string_block(it->first.capacity()) && it->first.capacity() > it->first.size())
+					loose.push_back(tag->m_tagMap.extract(it++));
+				else it++;
+			}
+			for (auto& n : loose) {
+				n.key().shrink_to_fit();
+				tag->m_tagMap.insert(std::move(n));
+			}
+			tag->m_tagMap.rehash(0);
+			break;
+		}
+		default://scalars hold nothing, array buffers are allocated to size
+			break;
+		}
+	}
+
 }
 
 #endif
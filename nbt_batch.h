@@ -0,0 +1,254 @@
+#ifndef _NBT_BATCH
+#define _NBT_BATCH
+
+#include "nbt.h"
+#include "nbt_visit.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace nbt {
+
+	//reusable state for decoding many small payloads on one thread. trees given back with recycle are
+	//taken apart into a per type cache of cleared tags, later decodes take their nodes from it instead of
+	//allocating. cleared compounds, lists and strings keep their bucket arrays and capacity. compound layouts
+	//are learned in a shape_cache, so payloads repeating the same structure skip most key hashing
+	class decode_context {
+	public:
+
+		explicit decode_context(format fmt = format::java, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max(), std::size_t cache_limit = 0x4000)
+			: m_format(fmt), m_maxBytes(max_bytes), m_cacheLimit(cache_limit) {}
+
+		decode_context(const decode_context&) = delete;
+		decode_context& operator=(const decode_context&) = delete;
+
+		~decode_context() {
+			for (std::vector<base*>& list : m_cache.m_free)
+				for (base* tag : list)
+					delete tag;
+		}
+
+		//one root tag (gzip/zlib detected), caller owns the result. throws nbt::exception
+		base* decode(const uint8* data, std::size_t size) {
+			if (!size)
+				throw exception("empty nbt payload");
+			bytestream input((uint8*)data, size);
+			input.keep_buffer(true);
+			size_tracker tracker(m_maxBytes);
+			scope installed(m_cache);
+			shape_scope shaped(m_shapes);
+			try {
+#ifndef _NBT_NO_COMPRESS
+				if (data[0] == _NBT_GZIP_MAGIC)
+					return read_tag(input, tracker, m_format);
+#endif
+				return read_tag_uncompressed(input, tracker, m_format);
+			}
+			catch (const char* msg) {//short reads in the streams
+				throw exception(msg);
+			}
+		}
+
+		//hands a tree back once the caller is done with it. its nodes feed later decodes on this context
+		void recycle(base* tree) {
+			if (!tree)
+				return;
+			std::int8_t id = tree->get_id();
+			if (id == 9) {
+				tag_list* list = tag_cast<tag_list>(tree);
+				while (list->size())
+					recycle(list->pop_tag());
+				list->clear();
+			}
+			else if (id == 10) {
+				tag_compound* compound = tag_cast<tag_compound>(tree);
+				for (auto it = compound->m_tagMap.begin(); it != compound->m_tagMap.end(); it++)
+					recycle(it->second);
+				compound->m_tagMap.clear();
+			}
+			else if (id == 8) {
+				tag_cast<tag_string>(tree)->m_data.clear();
+			}
+			else if (id == 7) {
+				tag_cast<tag_bytearray>(tree)->clear_buffer();
+			}
+			else if (id == 11) {
+				tag_cast<tag_intarray>(tree)->clear_buffer();
+			}
+			else if (id == 12) {
+				tag_cast<tag_longarray>(tree)->clear_buffer();
+			}
+			std::vector<base*>& list = m_cache.m_free[id];
+			if (list.size() < m_cacheLimit)
+				list.push_back(tree);
+			else delete tree;
+		}
+
+		format get_format() const {
+			return m_format;
+		}
+
+	private:
+
+		//installs the cache on this thread for one decode, nested contexts restore the outer one
+		struct scope {
+			tag_cache* m_prev;
+			explicit scope(tag_cache& cache) : m_prev(tag_cache::current()) {
+				tag_cache::current() = &cache;
+			}
+			~scope() {
+				tag_cache::current() = m_prev;
+			}
+		};
+
+		tag_cache m_cache;
+		shape_cache m_shapes;
+		format m_format;
+		std::int64_t m_maxBytes;
+		std::size_t m_cacheLimit;
+	};
+
+	struct blob {
+		const uint8* data;
+		std::size_t size;
+	};
+
+	struct decoded {
+		base* tag;//NULL if decoding failed
+		std::string error;
+	};
+
+	//decodes arrays of small payloads, spread over a fixed set of worker threads that each keep their own
+	//decode_context. decode and recycle are meant to be called from one thread, one batch at a time
+	class batch_decoder {
+	public:
+
+		//threads == 0 picks the hardware concurrency, 1 decodes on the calling thread only
+		explicit batch_decoder(unsigned threads = 0, format fmt = format::java, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max())
+			: m_job(NULL), m_generation(0), m_busy(0), m_stop(false), m_recycleNext(0) {
+			if (!threads)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned i = 0; i < threads; i++)
+				m_contexts.emplace_back(new decode_context(fmt, max_bytes));
+			for (unsigned i = 1; i < threads; i++)
+				m_workers.emplace_back(&batch_decoder::work, this, i);
+		}
+
+		batch_decoder(const batch_decoder&) = delete;
+		batch_decoder& operator=(const batch_decoder&) = delete;
+
+		~batch_decoder() {
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& t : m_workers)
+				t.join();
+			for (decode_context* ctx : m_contexts)
+				delete ctx;
+		}
+
+		//out[i] receives the tree (owned by the caller) or the error for in[i]. a bad payload never
+		//affects the others
+		void decode(const blob* in, std::size_t n, decoded* out) {
+			job j = { in, out, n, 0 };
+			if (m_workers.empty() || n < parallel_cutoff) {
+				run(j, *m_contexts[0]);
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_job = &j;
+				m_busy = (unsigned)m_workers.size();
+				m_generation++;
+			}
+			m_wake.notify_all();
+			run(j, *m_contexts[0]);
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_done.wait(lock, [this] { return m_busy == 0; });
+			m_job = NULL;
+		}
+
+		//hands trees back, spread over the worker contexts so every thread gets nodes to reuse
+		void recycle(decoded* results, std::size_t n) {
+			for (std::size_t i = 0; i < n; i++) {
+				if (results[i].tag) {
+					m_contexts[m_recycleNext]->recycle(results[i].tag);
+					m_recycleNext = (m_recycleNext + 1) % m_contexts.size();
+					results[i].tag = NULL;
+				}
+			}
+		}
+
+		std::size_t get_threads() const {
+			return m_contexts.size();
+		}
+
+	private:
+
+		//below this many payloads waking the workers costs more than it saves
+		static constexpr std::size_t parallel_cutoff = 64;
+		static constexpr std::size_t claim_size = 16;
+
+		struct job {
+			const blob* in;
+			decoded* out;
+			std::size_t n;
+			std::atomic<std::size_t> next;
+		};
+
+		static void run(job& j, decode_context& ctx) {
+			for (;;) {
+				std::size_t begin = j.next.fetch_add(claim_size, std::memory_order_relaxed);
+				if (begin >= j.n)
+					return;
+				std::size_t end = std::min(begin + claim_size, j.n);
+				for (std::size_t i = begin; i < end; i++) {
+					decoded& d = j.out[i];
+					d.tag = NULL;
+					d.error.clear();
+					try {
+						d.tag = ctx.decode(j.in[i].data, j.in[i].size);
+					}
+					catch (const std::exception& e) {
+						d.error = e.what();
+					}
+				}
+			}
+		}
+
+		void work(unsigned index) {
+			std::uint64_t seen = 0;
+			for (;;) {
+				job* j;
+				{
+					std::unique_lock<std::mutex> lock(m_lock);
+					m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+					if (m_stop)
+						return;
+					seen = m_generation;
+					j = m_job;
+				}
+				run(*j, *m_contexts[index]);
+				std::lock_guard<std::mutex> lock(m_lock);
+				if (--m_busy == 0)
+					m_done.notify_one();
+			}
+		}
+
+		std::vector<decode_context*> m_contexts;
+		std::vector<std::thread> m_workers;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		job* m_job;
+		std::uint64_t m_generation;
+		unsigned m_busy;
+		bool m_stop;
+		std::size_t m_recycleNext;
+	};
+
+}
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef _NBT_CACHE
+#define _NBT_CACHE
+
+#include "nbt.h"
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace nbt {
+
+	//(region, chunk x, chunk z). region is any id the caller gives its region files or dimensions
+	struct chunk_key {
+		std::uint32_t region;
+		std::int32_t x;
+		std::int32_t z;
+
+		bool operator==(const chunk_key& rhs) const {
+			return region == rhs.region && x == rhs.x && z == rhs.z;
+		}
+	};
+
+	struct chunk_key_hash {
+		std::size_t operator()(const chunk_key& k) const {
+			std::uint64_t h = ((std::uint64_t)(std::uint32_t)k.x << 32 | (std::uint32_t)k.z) ^ ((std::uint64_t)k.region * 0x9E3779B97F4A7C15ull);
+			h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;//splitmix64 finalizer
+			h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+			return (std::size_t)(h ^ (h >> 31));
+		}
+	};
+
+	enum class eviction {
+		drop,
+		compress,//keep evicted trees as gzip'd nbt, decoded again on the next hit. needs zlib
+	};
+
+	struct cache_stats {
+		std::uint64_t hits;//decoded entries found
+		std::uint64_t compressed_hits;//entries that had to be inflated and decoded again
+		std::uint64_t misses;
+		std::uint64_t evictions;//entries dropped
+		std::uint64_t compressions;//entries moved to the compressed form
+		std::uint64_t entries;
+		std::uint64_t bytes;//what the cache holds right now, as counted against the budget
+	};
+
+	namespace cache_detail {
+
+#ifndef _NBT_NO_COMPRESS
+		//gzip'd nbt in one malloc'd buffer, so read_tag takes it back as is
+		inline uint8* gzip_tree(tag_compound* tree, format fmt, std::size_t& size) {
+			byteoutstream raw(0);
+			raw.keep_buffer(true);
+			try {
+				write_tag(raw, tree, fmt);
+			}
+			catch (...) {
+				free(raw.get_buffer());
+				throw;
+			}
+			z_stream z;
+			memset(&z, 0, sizeof(z));
+			if (deflateInit2(&z, 1, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK) {//31: gzip wrapper, read_tag detects it
+				free(raw.get_buffer());
+				throw exception("deflateInit failed");
+			}
+			uLong bound = deflateBound(&z, (uLong)raw.get_position());
+			uint8* out = (uint8*)malloc(bound);
+			if (!out) {
+				deflateEnd(&z);
+				free(raw.get_buffer());
+				throw exception("out of memory");
+			}
+			z.next_in = raw.get_buffer();
+			z.avail_in = (uInt)raw.get_position();
+			z.next_out = out;
+			z.avail_out = (uInt)bound;
+			int stat = deflate(&z, Z_FINISH);
+			size = z.total_out;
+			deflateEnd(&z);
+			free(raw.get_buffer());
+			if (stat != Z_STREAM_END) {
+				free(out);
+				throw exception("deflate failed");
+			}
+			return out;
+		}
+#endif
+
+	}
+
+	//bounded cache of decoded compounds shared between threads. the key space is split over shards, each
+	//with its own lock, lru order and slice of the byte budget. trees are handed out as shared_ptr, so an
+	//evicted tree lives on until its last reader lets go, and must not be modified while cached
+	template<class Key, class Hash = std::hash<Key>>
+	class tree_cache {
+	public:
+
+		typedef std::shared_ptr<const tag_compound> handle;
+
+		//budget is in bytes as counted by base::memory_usage (plus the compressed size of compressed
+		//entries). shards is rounded up to a power of two. fmt is used for the compressed form
+		explicit tree_cache(std::size_t budget, eviction policy = eviction::drop, unsigned shards = 16, format fmt = format::java)
+			: m_policy(policy), m_format(fmt) {
+#ifdef _NBT_NO_COMPRESS
+			m_policy = eviction::drop;
+#endif
+			unsigned n = 1;
+			m_shift = 64;
+			while (n < shards) {
+				n <<= 1;
+				m_shift--;
+			}
+			m_shards.reset(new shard[n]);
+			m_shardCount = n;
+			for (unsigned i = 0; i < n; i++)
+				m_shards[i].budget = budget / n;
+		}
+
+		tree_cache(const tree_cache&) = delete;
+		tree_cache& operator=(const tree_cache&) = delete;
+
+		~tree_cache() {
+			clear();
+		}
+
+		//NULL on a miss
+		handle get(const Key& key) {
+			shard& s = shard_of(key);
+			std::unique_lock<std::mutex> lock(s.lock);
+			auto it = s.index.find(key);
+			if (it == s.index.end()) {
+				s.stats.misses++;
+				return handle();
+			}
+			entry_it e = it->second;
+			if (e->tree) {
+				s.hot.splice(s.hot.begin(), s.hot, e);
+				s.stats.hits++;
+				return e->tree;
+			}
+			s.stats.compressed_hits++;
+			return thaw(s, e);
+		}
+
+		//takes ownership of tree and replaces any entry under key. trees bigger than a shard's budget are not
+		//kept, but the returned handle still owns them
+		handle put(const Key& key, tag_compound* tree) {
+			handle h(tree);
+			std::size_t bytes = tree_bytes(tree);
+			shard& s = shard_of(key);
+			std::lock_guard<std::mutex> lock(s.lock);
+			auto it = s.index.find(key);
+			if (it != s.index.end())
+				remove(s, it->second);
+			if (bytes > s.budget)
+				return h;
+			s.hot.push_front(entry{ key, h, NULL, 0, bytes, true });
+			s.index.emplace(key, s.hot.begin());
+			s.bytes += bytes;
+			trim(s);
+			return h;
+		}
+
+		//get, or on a miss decode with load() (returning an owned tag_compound*, NULL for none) and cache it.
+		//load runs without any lock held, two threads missing the same key at once may both run it
+		template<class Load>
+		handle get_or_load(const Key& key, Load load) {
+			handle h = get(key);
+			if (h)
+				return h;
+			tag_compound* tree = load();
+			if (!tree)
+				return handle();
+			return put(key, tree);
+		}
+
+		bool erase(const Key& key) {
+			shard& s = shard_of(key);
+			std::lock_guard<std::mutex> lock(s.lock);
+			auto it = s.index.find(key);
+			if (it == s.index.end())
+				return false;
+			remove(s, it->second);
+			return true;
+		}
+
+		void clear() {
+			for (unsigned i = 0; i < m_shardCount; i++) {
+				shard& s = m_shards[i];
+				std::lock_guard<std::mutex> lock(s.lock);
+				while (!s.hot.empty())
+					remove(s, s.hot.begin());
+				while (!s.cold.empty())
+					remove(s, s.cold.begin());
+			}
+		}
+
+		cache_stats stats() const {
+			cache_stats total = {};
+			for (unsigned i = 0; i < m_shardCount; i++) {
+				shard& s = m_shards[i];
+				std::lock_guard<std::mutex> lock(s.lock);
+				total.hits += s.stats.hits;
+				total.compressed_hits += s.stats.compressed_hits;
+				total.misses += s.stats.misses;
+				total.evictions += s.stats.evictions;
+				total.compressions += s.stats.compressions;
+				total.entries += s.index.size();
+				total.bytes += s.bytes;
+			}
+			return total;
+		}
+
+		static std::size_t tree_bytes(const tag_compound* tree) {
+			//the tree, plus shared_ptr's control block
+			return (std::size_t)(tree->memory_usage() + memory_report::block(3 * sizeof(void*)));
+		}
+
+	private:
+
+		struct entry {
+			Key key;
+			handle tree;//NULL while compressed
+			uint8* packed;//gzip'd nbt while compressed
+			std::size_t packed_size;
+			std::size_t bytes;//counted against the budget
+			bool hot;
+		};
+
+		typedef typename std::list<entry>::iterator entry_it;
+
+		//hot holds decoded trees, cold compressed ones, both most recently used first
+		struct shard {
+			std::mutex lock;
+			std::list<entry> hot;
+			std::list<entry> cold;
+			std::unordered_map<Key, entry_it, Hash> index;
+			std::size_t bytes = 0;
+			std::size_t budget = 0;
+			cache_stats stats = {};
+		};
+
+		std::unique_ptr<shard[]> m_shards;
+		unsigned m_shardCount;
+		int m_shift;
+		eviction m_policy;
+		format m_format;
+
+		shard& shard_of(const Key& key) {
+			if (m_shardCount == 1)
+				return m_shards[0];
+			//fibonacci hashing, so identity hashes (std::hash of ints) spread too
+			std::uint64_t h = (std::uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull;
+			return m_shards[h >> m_shift];
+		}
+
+		void remove(shard& s, entry_it e) {
+			s.bytes -= e->bytes;
+			s.index.erase(e->key);
+			free(e->packed);
+			if (e->hot)
+				s.hot.erase(e);
+			else s.cold.erase(e);
+		}
+
+		//evicts from the cold end until the shard fits its budget. with eviction::compress, decoded trees first
+		//move to the compressed list (deflated under the shard lock), then the oldest compressed entries go
+		void trim(shard& s) {
+			while (s.bytes > s.budget) {
+#ifndef _NBT_NO_COMPRESS
+				if (m_policy == eviction::compress && !s.hot.empty()) {
+					entry_it e = std::prev(s.hot.end());
+					std::size_t size;
+					uint8* packed = NULL;
+					try {
+						packed = cache_detail::gzip_tree(const_cast<tag_compound*>(e->tree.get()), m_format, size);
+					}
+					catch (const exception&) {}
+					if (packed && (std::size_t)memory_report::block(size) < e->bytes) {
+						s.bytes -= e->bytes;
+						e->bytes = (std::size_t)memory_report::block(size);
+						s.bytes += e->bytes;
+						e->tree.reset();
+						e->packed = packed;
+						e->packed_size = size;
+						e->hot = false;
+						s.cold.splice(s.cold.begin(), s.hot, e);
+						s.stats.compressions++;
+						continue;
+					}
+					free(packed);
+				}
+#endif
+				entry_it victim;
+				if (!s.cold.empty())
+					victim = std::prev(s.cold.end());
+				else if (!s.hot.empty())
+					victim = std::prev(s.hot.end());
+				else break;
+				remove(s, victim);
+				s.stats.evictions++;
+			}
+		}
+
+		//decodes a compressed entry back into the hot list. decoding runs under the shard lock
+		handle thaw(shard& s, entry_it e) {
+#ifndef _NBT_NO_COMPRESS
+			tag_compound* tree = new tag_compound();
+			try {
+				bytestream input(e->packed, e->packed_size);
+				input.keep_buffer(true);
+				size_tracker tracker = size_tracker(inf);
+				read_tag_compound(input, *tree, tracker, m_format);
+			}
+			catch (...) {
+				delete tree;
+				remove(s, e);
+				return handle();
+			}
+			handle h(tree);
+			free(e->packed);
+			e->packed = NULL;
+			e->packed_size = 0;
+			s.bytes -= e->bytes;
+			e->bytes = tree_bytes(tree);
+			s.bytes += e->bytes;
+			e->tree = h;
+			e->hot = true;
+			s.hot.splice(s.hot.begin(), s.cold, e);
+			trim(s);
+			return h;
+#else
+			return handle();
+#endif
+		}
+	};
+
+	typedef tree_cache<chunk_key, chunk_key_hash> chunk_cache;
+
+}
+
+#endif
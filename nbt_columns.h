@@ -0,0 +1,712 @@
+#ifndef _NBT_COLUMNS
+#define _NBT_COLUMNS
+
+#include "nbt.h"
+#include "nbt_visit.h"
+#include <algorithm>
+
+//predefine '_NBT_NO_SIMD' to force the scalar kernels
+#if !defined(_NBT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define _NBT_COLUMNS_SSE2
+#endif
+
+namespace nbt {
+
+	//one field across every row (list element), stored contiguously as the class of the tag found there:
+	//int8_t, int16_t, int32_t, int64_t, float or double, strings as uint32_t codes into dictionary(). the
+	//first value found decides the type. rows without the field, or with a tag of another type there, are
+	//null: their bit in mask() is clear and their value is 0
+	class column {
+	public:
+
+		//tag id of the values, 0 while every row is null
+		std::int8_t type() const {
+			return m_type;
+		}
+
+		std::size_t size() const {
+			return m_rows;
+		}
+
+		//rows nulled because the field had another type than the column
+		std::size_t mismatched() const {
+			return m_mismatched;
+		}
+
+		bool valid(std::size_t row) const {
+			return m_mask[row >> 6] >> (row & 63) & 1;
+		}
+
+		//a bit per row, 64 rows per word
+		const std::uint64_t* mask() const {
+			return m_mask.data();
+		}
+
+		std::size_t null_count() const {
+			std::size_t n = m_rows;
+			for (std::uint64_t word : m_mask)
+				n -= popcount(word);
+			return n;
+		}
+
+		//T must be the class for type(), NULL while every row is null
+		template<class T>
+		const T* values() const {
+			if (!m_type)
+				return NULL;
+			if (value_id<T>() != m_type)
+				throw exception("column holds values of another type");
+			return store<T>().data();
+		}
+
+		//string columns: the distinct values, indexed by code
+		const std::vector<std::string>& dictionary() const {
+			return m_dictionary;
+		}
+
+		const std::string& string_at(std::size_t row) const {
+			return m_dictionary[values<std::uint32_t>()[row]];
+		}
+
+		static inline int popcount(std::uint64_t v) {
+#ifdef _MSC_VER
+			return (int)__popcnt64(v);
+#else
+			return __builtin_popcountll(v);
+#endif
+		}
+
+		//value class of a column of tag id type
+		template<class T>
+		static constexpr std::int8_t value_id() {
+			return std::is_same<T, std::int8_t>::value ? 1 : std::is_same<T, std::int16_t>::value ? 2 : std::is_same<T, std::int32_t>::value ? 3
+				: std::is_same<T, std::int64_t>::value ? 4 : std::is_same<T, float>::value ? 5 : std::is_same<T, double>::value ? 6
+				: std::is_same<T, std::uint32_t>::value ? 8 : 0;
+		}
+
+		//filling, used by extract_columns
+		void reset(std::size_t rows) {
+			*this = column();
+			m_rows = rows;
+			m_mask.assign((rows + 63) / 64, 0);
+		}
+
+		template<class T>
+		void set(std::size_t row, T v) {
+			if (!claim(value_id<T>()))
+				return;
+			store<T>()[row] = v;
+			m_mask[row >> 6] |= 1ull << (row & 63);
+		}
+
+		void set_string(std::size_t row, const char* s, std::size_t n) {
+			if (!claim(8))
+				return;
+			m_scratch.assign(s, n);
+			auto it = m_codes.find(m_scratch);
+			if (it == m_codes.end()) {
+				it = m_codes.emplace(m_scratch, (std::uint32_t)m_dictionary.size()).first;
+				m_dictionary.push_back(m_scratch);
+			}
+			m_code[row] = it->second;
+			m_mask[row >> 6] |= 1ull << (row & 63);
+		}
+
+		//a tag at the field that is not a number or string
+		void mismatch() {
+			m_mismatched++;
+		}
+
+		//drops what only filling needs
+		void finish() {
+			m_codes = std::unordered_map<std::string, std::uint32_t>();
+			m_scratch = std::string();
+		}
+
+	private:
+
+		bool claim(std::int8_t id) {
+			if (m_type == id)
+				return true;
+			if (m_type) {
+				m_mismatched++;
+				return false;
+			}
+			m_type = id;
+			switch (id) {
+			case 1: m_i8.resize(m_rows); break;
+			case 2: m_i16.resize(m_rows); break;
+			case 3: m_i32.resize(m_rows); break;
+			case 4: m_i64.resize(m_rows); break;
+			case 5: m_f32.resize(m_rows); break;
+			case 6: m_f64.resize(m_rows); break;
+			case 8: m_code.resize(m_rows); break;
+			}
+			return true;
+		}
+
+		template<class T>
+		std::vector<T>& store() {
+			return const_cast<std::vector<T>&>(static_cast<const column*>(this)->store<T>());
+		}
+
+		template<class T>
+		const std::vector<T>& store() const {
+			if constexpr (std::is_same<T, std::int8_t>::value)
+				return m_i8;
+			else if constexpr (std::is_same<T, std::int16_t>::value)
+				return m_i16;
+			else if constexpr (std::is_same<T, std::int32_t>::value)
+				return m_i32;
+			else if constexpr (std::is_same<T, std::int64_t>::value)
+				return m_i64;
+			else if constexpr (std::is_same<T, float>::value)
+				return m_f32;
+			else if constexpr (std::is_same<T, double>::value)
+				return m_f64;
+			else {
+				static_assert(std::is_same<T, std::uint32_t>::value, "not a column value type");
+				return m_code;
+			}
+		}
+
+		std::int8_t m_type = 0;
+		std::size_t m_rows = 0;
+		std::size_t m_mismatched = 0;
+		std::vector<std::uint64_t> m_mask;
+		std::vector<std::int8_t> m_i8;
+		std::vector<std::int16_t> m_i16;
+		std::vector<std::int32_t> m_i32;
+		std::vector<std::int64_t> m_i64;
+		std::vector<float> m_f32;
+		std::vector<double> m_f64;
+		std::vector<std::uint32_t> m_code;
+		std::vector<std::string> m_dictionary;
+		std::unordered_map<std::string, std::uint32_t> m_codes;
+		std::string m_scratch;
+	};
+
+	namespace columns_detail {
+
+		//the fields as a tree of steps, so shared prefixes (Pos 0, Pos 1, Pos 2) are walked once
+		struct field_node {
+			std::string key;
+			std::int64_t index;//list index, or -1 for a key
+			std::vector<std::size_t> columns;//fields ending here
+			std::vector<field_node> children;
+			std::int64_t max_index = -1;//highest list index among the children
+		};
+
+		inline field_node build(const std::vector<field_path>& fields) {
+			field_node root;
+			root.index = -1;
+			for (std::size_t i = 0; i < fields.size(); i++) {
+				if (fields[i].empty())
+					throw exception("empty field path");
+				field_node* at = &root;
+				for (const path_step& step : fields[i]) {
+					auto it = std::find_if(at->children.begin(), at->children.end(), [&step](const field_node& n) {
+						return n.index == step.index && (step.index >= 0 || n.key == step.key);
+					});
+					if (it == at->children.end()) {
+						at->children.emplace_back();
+						at->children.back().key = step.key;
+						at->children.back().index = step.index;
+						at->max_index = std::max(at->max_index, step.index);
+						it = at->children.end() - 1;
+					}
+					at = &*it;
+				}
+				at->columns.push_back(i);
+			}
+			return root;
+		}
+
+		inline void set(column& c, std::size_t row, const base* tag) {
+			switch (tag->get_id()) {
+			case 1: c.set(row, tag_cast<tag_byte>(tag)->m_data); break;
+			case 2: c.set(row, tag_cast<tag_short>(tag)->m_data); break;
+			case 3: c.set(row, tag_cast<tag_int>(tag)->m_data); break;
+			case 4: c.set(row, tag_cast<tag_long>(tag)->m_data); break;
+			case 5: c.set(row, tag_cast<tag_float>(tag)->m_data); break;
+			case 6: c.set(row, tag_cast<tag_double>(tag)->m_data); break;
+			case 8: {
+				const std::string& s = static_cast<const tag_string*>(tag)->m_data;
+				c.set_string(row, s.data(), s.size());
+				break;
+			}
+			default: c.mismatch(); break;
+			}
+		}
+
+		inline void from_tree(const base* at, const field_node& node, std::size_t row, std::vector<column>& columns) {
+			for (std::size_t c : node.columns)
+				set(columns[c], row, at);
+			if (node.children.empty())
+				return;
+			if (at->get_id() == 10) {
+				const tag_compound* compound = static_cast<const tag_compound*>(at);
+				for (const field_node& child : node.children) {
+					if (child.index >= 0)
+						continue;
+					auto it = compound->m_tagMap.find(child.key);
+					if (it != compound->m_tagMap.end())
+						from_tree(it->second, child, row, columns);
+				}
+			}
+			else if (at->get_id() == 9) {
+				const std::vector<base*>& tags = static_cast<const tag_list*>(at)->get_tags();
+				for (const field_node& child : node.children)
+					if (child.index >= 0 && (std::size_t)child.index < tags.size())
+						from_tree(tags[(std::size_t)child.index], child, row, columns);
+			}
+		}
+
+		//reads the fields straight from encoded nbt, everything else is skipped without being decoded
+		template<class C>
+		struct scanner {
+			bytestream& input;
+			std::vector<column>& columns;
+			std::size_t row;
+
+			static constexpr bool varint = C::fmt == format::bedrock_network;
+
+			void seek(std::uint64_t n) {
+				if (!input.seek_cur(n))
+					throw exception("nbt data ends inside a value");
+			}
+
+			std::int32_t length() {
+				std::int32_t n = C::read_length(input);
+				if (n < 0)
+					throw exception("negative length. corrupt tag?");
+				return n;
+			}
+
+			//payload bytes of a tag id, 0 when it varies
+			static std::uint64_t width(std::int8_t id) {
+				switch (id) {
+				case 1: return 1;
+				case 2: return 2;
+				case 3: return varint ? 0 : 4;
+				case 4: return varint ? 0 : 8;
+				case 5: return 4;
+				case 6: return 8;
+				default: return 0;
+				}
+			}
+
+			void skip(std::int8_t id, int depth) {
+				if (depth > 0x200)
+					throw exception("Tried to read NBT with too high complexity, depth > 512");
+				switch (id) {
+				case 1: case 2: case 5: case 6:
+					seek(width(id));
+					break;
+				case 3:
+					C::template read<std::int32_t>(input);
+					break;
+				case 4:
+					C::template read<std::int64_t>(input);
+					break;
+				case 7:
+					seek((std::uint64_t)length());
+					break;
+				case 8:
+					seek(C::read_string_length(input));
+					break;
+				case 9: {
+					std::int8_t type = C::template read<std::int8_t>(input);
+					skip_many(type, length(), depth + 1);
+					break;
+				}
+				case 10:
+					while ((id = C::template read<std::int8_t>(input)) != 0) {
+						seek(C::read_string_length(input));
+						skip(id, depth + 1);
+					}
+					break;
+				case 11:
+				case 12: {
+					std::int32_t n = length();
+					if (!varint)
+						seek((std::uint64_t)n * (id == 11 ? 4 : 8));
+					else for (std::int32_t i = 0; i < n; i++) {
+						if (id == 11)
+							C::template read<std::int32_t>(input);
+						else C::template read<std::int64_t>(input);
+					}
+					break;
+				}
+				default:
+					throw exception("error reading tag: tag id invalid. corrupt tag?");
+				}
+			}
+
+			void skip_many(std::int8_t type, std::int64_t n, int depth) {
+				if (n <= 0)
+					return;
+				if (type == 0)
+					throw exception("missing type on list tag");
+				if (std::uint64_t w = width(type)) {
+					seek(w * (std::uint64_t)n);
+					return;
+				}
+				for (std::int64_t i = 0; i < n; i++)
+					skip(type, depth);
+			}
+
+			//the value of tag id at node: fills the fields ending there and descends to the ones below
+			void value(std::int8_t id, const field_node& node, int depth) {
+				if (node.columns.empty() && node.children.empty()) {
+					skip(id, depth);
+					return;
+				}
+				switch (id) {
+				case 1: fill(C::template read<std::int8_t>(input), node); return;
+				case 2: fill(C::template read<std::int16_t>(input), node); return;
+				case 3: fill(C::template read<std::int32_t>(input), node); return;
+				case 4: fill(C::template read<std::int64_t>(input), node); return;
+				case 5: fill(C::template read<float>(input), node); return;
+				case 6: fill(C::template read<double>(input), node); return;
+				case 8: {
+					std::uint32_t n = C::read_string_length(input);
+					const char* s = (const char*)input.get_buffer() + input.get_position();
+					seek(n);
+					for (std::size_t c : node.columns)
+						columns[c].set_string(row, s, n);
+					return;
+				}
+				}
+				for (std::size_t c : node.columns)
+					columns[c].mismatch();
+				if (id == 10 && !node.children.empty())
+					compound(node, depth);
+				else if (id == 9 && node.max_index >= 0)
+					list(node, depth);
+				else skip(id, depth);
+			}
+
+			template<class T>
+			void fill(T v, const field_node& node) {
+				for (std::size_t c : node.columns)
+					columns[c].set(row, v);
+			}
+
+			void compound(const field_node& node, int depth) {
+				if (depth > 0x200)
+					throw exception("Tried to read NBT with too high complexity, depth > 512");
+				std::int8_t id;
+				while ((id = C::template read<std::int8_t>(input)) != 0) {
+					std::uint32_t n = C::read_string_length(input);
+					const char* key = (const char*)input.get_buffer() + input.get_position();
+					seek(n);
+					const field_node* match = NULL;
+					for (const field_node& child : node.children) {
+						if (child.index < 0 && child.key.size() == n && !memcmp(child.key.data(), key, n)) {
+							match = &child;
+							break;
+						}
+					}
+					if (match)
+						value(id, *match, depth + 1);
+					else skip(id, depth + 1);
+				}
+			}
+
+			void list(const field_node& node, int depth) {
+				if (depth > 0x200)
+					throw exception("Tried to read NBT with too high complexity, depth > 512");
+				std::int8_t type = C::template read<std::int8_t>(input);
+				std::int32_t n = length();
+				if (type == 0 && n > 0)
+					throw exception("missing type on list tag");
+				std::int32_t i = 0;
+				for (; i < n && i <= node.max_index; i++) {
+					const field_node* match = NULL;
+					for (const field_node& child : node.children)
+						if (child.index == i)
+							match = &child;
+					if (match)
+						value(type, *match, depth + 1);
+					else skip(type, depth + 1);
+				}
+				skip_many(type, n - i, depth + 1);//past the last index asked for
+			}
+
+			//follows list_path from the root tag to the list, false if it is not there
+			bool find(const field_path& list_path, std::int8_t& id, int& depth) {
+				id = C::template read<std::int8_t>(input);
+				seek(C::read_string_length(input));//root name
+				for (const path_step& step : list_path) {
+					if (++depth > 0x200)
+						throw exception("Tried to read NBT with too high complexity, depth > 512");
+					if (step.index < 0) {
+						if (id != 10)
+							return false;
+						std::int8_t child;
+						bool found = false;
+						while ((child = C::template read<std::int8_t>(input)) != 0) {
+							std::uint32_t n = C::read_string_length(input);
+							const char* key = (const char*)input.get_buffer() + input.get_position();
+							seek(n);
+							if (step.key.size() == n && !memcmp(step.key.data(), key, n)) {
+								id = child;
+								found = true;
+								break;
+							}
+							skip(child, depth);
+						}
+						if (!found)
+							return false;
+					}
+					else {
+						if (id != 9)
+							return false;
+						std::int8_t type = C::template read<std::int8_t>(input);
+						std::int32_t n = length();
+						if (step.index >= n)
+							return false;
+						skip_many(type, step.index, depth);
+						id = type;
+					}
+				}
+				return true;
+			}
+		};
+
+		template<class C>
+		inline void from_bytes(bytestream& input, const field_path& list_path, const field_node& fields, std::vector<column>& columns) {
+			scanner<C> scan{ input, columns, 0 };
+			std::int8_t id;
+			int depth = 0;
+			if (!scan.find(list_path, id, depth) || id != 9) {
+				for (column& c : columns)
+					c.reset(0);
+				return;
+			}
+			std::int8_t type = C::template read<std::int8_t>(input);
+			std::int32_t n = scan.length();
+			if (n > 0 && type != 10)
+				throw exception("not a list of compounds");
+			//every compound takes at least its end byte
+			if ((std::uint64_t)n > input.get_stream_size() - input.get_position())
+				throw exception("list length is past the end of the stream");
+			for (column& c : columns)
+				c.reset((std::size_t)n);
+			for (std::int32_t i = 0; i < n; i++) {
+				scan.row = (std::size_t)i;
+				scan.compound(fields, depth + 1);
+			}
+		}
+
+	}
+
+	//a column per field, a row per compound of list
+	inline std::vector<column> extract_columns(const tag_list& list, const std::vector<field_path>& fields) {
+		columns_detail::field_node tree = columns_detail::build(fields);
+		if (list.size() && list.get_tag_type() != 10)
+			throw exception("not a list of compounds");
+		std::vector<column> columns(fields.size());
+		for (column& c : columns)
+			c.reset(list.size());
+		const std::vector<base*>& tags = list.get_tags();
+		for (std::size_t row = 0; row < tags.size(); row++)
+			columns_detail::from_tree(tags[row], tree, row, columns);
+		for (column& c : columns)
+			c.finish();
+		return columns;
+	}
+
+	//same, straight from an encoded tree (gzip detected): list_path leads from the root tag to the list, empty
+	//when the root is the list. nothing outside the fields is decoded. no rows if the list is not there
+	inline std::vector<column> extract_columns(const uint8* data, std::size_t size, format fmt, const field_path& list_path, const std::vector<field_path>& fields) {
+		columns_detail::field_node tree = columns_detail::build(fields);
+		std::vector<column> columns(fields.size());
+		if (!size)
+			throw exception("empty nbt data");
+		bytestream raw((uint8*)data, size);
+		raw.keep_buffer(true);
+		uint8* inflated = NULL;
+		uint64 inflated_size = 0;
+#ifndef _NBT_NO_COMPRESS
+		if (data[0] == _NBT_GZIP_MAGIC)
+			inflated = inflate_for_read(raw, inflated_size);
+#endif
+		bytestream input = inflated ? bytestream(inflated, inflated_size) : bytestream((uint8*)data, size);
+		if (!inflated)
+			input.keep_buffer(true);
+		try {
+			switch (fmt) {
+			case format::bedrock:
+				columns_detail::from_bytes<le_codec>(input, list_path, tree, columns);
+				break;
+			case format::bedrock_network:
+				columns_detail::from_bytes<varint_codec>(input, list_path, tree, columns);
+				break;
+			default:
+				columns_detail::from_bytes<be_codec>(input, list_path, tree, columns);
+				break;
+			}
+		}
+		catch (const char* msg) {//short reads in the stream
+			throw exception(msg);
+		}
+		for (column& c : columns)
+			c.finish();
+		return columns;
+	}
+
+	//aggregates over the non null rows. sum is an int64_t for integer columns, a double for float ones
+	template<class T>
+	struct column_stats {
+		std::size_t count;
+		T min;
+		T max;
+		typename std::conditional<std::is_floating_point<T>::value, double, std::int64_t>::type sum;
+	};
+
+	namespace columns_detail {
+
+		//64 rows that are all set, the common case. split over independent accumulators so the loop vectorizes
+		template<class T, class S>
+		inline void block(const T* v, T& mn, T& mx, S& sum) {
+#ifdef _NBT_COLUMNS_SSE2
+			if constexpr (std::is_same<T, double>::value) {
+				__m128d lo = _mm_set1_pd(mn), hi = _mm_set1_pd(mx), acc = _mm_setzero_pd();
+				for (int i = 0; i < 64; i += 2) {
+					__m128d x = _mm_loadu_pd(v + i);
+					lo = _mm_min_pd(x, lo);//nan in x gives back the second operand, so nans are passed over
+					hi = _mm_max_pd(x, hi);
+					acc = _mm_add_pd(acc, x);
+				}
+				double l[2], h[2], a[2];
+				_mm_storeu_pd(l, lo);
+				_mm_storeu_pd(h, hi);
+				_mm_storeu_pd(a, acc);
+				mn = std::min(l[0], l[1]);
+				mx = std::max(h[0], h[1]);
+				sum += a[0] + a[1];
+				return;
+			}
+			else if constexpr (std::is_same<T, float>::value) {
+				__m128 lo = _mm_set1_ps(mn), hi = _mm_set1_ps(mx);
+				__m128d acc = _mm_setzero_pd();
+				for (int i = 0; i < 64; i += 4) {
+					__m128 x = _mm_loadu_ps(v + i);
+					lo = _mm_min_ps(x, lo);
+					hi = _mm_max_ps(x, hi);
+					acc = _mm_add_pd(acc, _mm_add_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(_mm_movehl_ps(x, x))));
+				}
+				float l[4], h[4];
+				double a[2];
+				_mm_storeu_ps(l, lo);
+				_mm_storeu_ps(h, hi);
+				_mm_storeu_pd(a, acc);
+				mn = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+				mx = std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+				sum += a[0] + a[1];
+				return;
+			}
+#endif
+			T lo[4] = { mn, mn, mn, mn }, hi[4] = { mx, mx, mx, mx };
+			S acc[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < 64; i += 4) {
+				for (int k = 0; k < 4; k++) {
+					T x = v[i + k];
+					lo[k] = x < lo[k] ? x : lo[k];
+					hi[k] = x > hi[k] ? x : hi[k];
+					acc[k] += x;
+				}
+			}
+			mn = std::min(std::min(lo[0], lo[1]), std::min(lo[2], lo[3]));
+			mx = std::max(std::max(hi[0], hi[1]), std::max(hi[2], hi[3]));
+			sum += (acc[0] + acc[1]) + (acc[2] + acc[3]);
+		}
+
+		inline int lowest_bit(std::uint64_t v) {
+#ifdef _MSC_VER
+			unsigned long i;
+			_BitScanForward64(&i, v);
+			return (int)i;
+#else
+			return __builtin_ctzll(v);
+#endif
+		}
+
+	}
+
+	//T is the column's value class (see column::values). count is 0 and min/max meaningless when every row is null
+	template<class T>
+	inline column_stats<T> summarize(const column& c) {
+		column_stats<T> s = { 0, std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest(), 0 };
+		const T* v = c.values<T>();
+		if (!v)
+			return s;
+		const std::uint64_t* mask = c.mask();
+		for (std::size_t base = 0; base < c.size(); base += 64) {
+			std::uint64_t m = mask[base >> 6];
+			if (m == ~0ull) {
+				columns_detail::block(v + base, s.min, s.max, s.sum);
+				s.count += 64;
+				continue;
+			}
+			s.count += column::popcount(m);
+			while (m) {
+				T x = v[base + columns_detail::lowest_bit(m)];
+				s.min = x < s.min ? x : s.min;
+				s.max = x > s.max ? x : s.max;
+				s.sum += x;
+				m &= m - 1;
+			}
+		}
+		return s;
+	}
+
+	//non null numeric rows counted into bins equal parts of [lo, hi). values outside, and nans, are not counted
+	inline std::vector<std::uint64_t> histogram(const column& c, double lo, double hi, std::size_t bins) {
+		std::vector<std::uint64_t> counts(bins);
+		if (!bins || !(hi > lo))
+			return counts;
+		double scale = bins / (hi - lo);
+		auto count = [&](auto* v) {
+			const std::uint64_t* mask = c.mask();
+			for (std::size_t base = 0; base < c.size(); base += 64) {
+				std::uint64_t m = mask[base >> 6];
+				while (m) {
+					double x = (double)v[base + columns_detail::lowest_bit(m)];
+					m &= m - 1;
+					if (x >= lo && x < hi)
+						counts[std::min(bins - 1, (std::size_t)((x - lo) * scale))]++;
+				}
+			}
+		};
+		switch (c.type()) {
+		case 1: count(c.values<std::int8_t>()); break;
+		case 2: count(c.values<std::int16_t>()); break;
+		case 3: count(c.values<std::int32_t>()); break;
+		case 4: count(c.values<std::int64_t>()); break;
+		case 5: count(c.values<float>()); break;
+		case 6: count(c.values<double>()); break;
+		case 8: throw exception("histogram of a string column, use value_counts");
+		}
+		return counts;
+	}
+
+	//string columns: non null rows per dictionary code
+	inline std::vector<std::uint64_t> value_counts(const column& c) {
+		std::vector<std::uint64_t> counts(c.dictionary().size());
+		const std::uint32_t* v = c.values<std::uint32_t>();
+		if (!v)
+			return counts;
+		const std::uint64_t* mask = c.mask();
+		for (std::size_t base = 0; base < c.size(); base += 64)
+			for (std::uint64_t m = mask[base >> 6]; m; m &= m - 1)
+				counts[v[base + columns_detail::lowest_bit(m)]]++;
+		return counts;
+	}
+
+}
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef _NBT_DEFLATE
+#define _NBT_DEFLATE
+
+#include "nbt.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef _NBT_NO_COMPRESS
+namespace nbt {
+
+	enum class deflate_wrapper : std::uint8_t {
+		gzip,//what read_tag and minecraft's own files expect
+		zlib,//region file chunks
+	};
+
+	struct deflate_options {
+		deflate_wrapper wrapper = deflate_wrapper::gzip;
+		int level = 6;
+		unsigned threads = 0;//0 picks the hardware concurrency, 1 compresses on the writing thread
+		std::size_t block_size = 0x20000;
+	};
+
+	//output stream that deflates everything written to it into sink as one gzip or zlib stream, pigz style:
+	//the input is cut into blocks that are compressed independently on worker threads, each primed with the
+	//last 32k of the block before it so the ratio stays close to a single stream. blocks end on a sync flush
+	//(byte aligned, not final) so they can be concatenated, and the checksums are combined at the end.
+	//writes must be sequential, call finish() after the last one
+	class deflate_outstream : public byteoutstream {
+	public:
+
+		explicit deflate_outstream(byteoutstream& sink, const deflate_options& options = deflate_options())
+			: m_sink(sink), m_options(options), mp_current(NULL), m_fill(0), m_check(0), m_stop(false), m_finished(false) {
+			if (m_options.block_size < 0x8000)
+				m_options.block_size = 0x8000;
+			if (!m_options.threads)
+				m_options.threads = std::max(1u, std::thread::hardware_concurrency());
+			m_check = m_options.wrapper == deflate_wrapper::gzip ? crc32(0, Z_NULL, 0) : adler32(0, Z_NULL, 0);
+			write_header();
+			if (m_options.threads > 1) {
+				for (unsigned i = 0; i < m_options.threads; i++)
+					m_workers.emplace_back(&deflate_outstream::work, this);
+			}
+			else m_inline.reset(new compressor(m_options.level));
+		}
+
+		deflate_outstream(const deflate_outstream&) = delete;
+		deflate_outstream& operator=(const deflate_outstream&) = delete;
+
+		//without finish() the sink is left with an unterminated stream
+		~deflate_outstream() {
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& t : m_workers)
+				t.join();
+			delete mp_current;
+		}
+
+		void write(const uint8* buf, uint32 size) override {
+			if (m_finished)
+				throw exception("write to a finished deflate_outstream");
+			if (this->position != this->size)
+				throw exception("deflate_outstream only supports sequential writes");
+			this->position += size;
+			this->size = this->position;
+			while (size) {
+				if (!mp_current)
+					mp_current = take_block();
+				std::size_t n = std::min<std::size_t>(size, m_options.block_size - m_fill);
+				memcpy(mp_current->in.data() + m_fill, buf, n);
+				m_fill += n;
+				buf += n;
+				size -= (uint32)n;
+				if (m_fill == m_options.block_size)
+					submit(false);
+			}
+		}
+
+		//compresses what is left, waits for all blocks and writes the trailer
+		void finish() {
+			if (m_finished)
+				return;
+			if (!mp_current)
+				mp_current = take_block();
+			submit(true);
+			while (!m_pending.empty())
+				write_front();
+			write_trailer();
+			m_finished = true;
+		}
+
+		uint64 get_compressed_size() const {
+			return m_written;
+		}
+
+	protected:
+
+		void grow(uint64 dest_size) override {
+			this->size = dest_size;//only reached by seeking, which the next write refuses
+		}
+
+	private:
+
+		struct block {
+			std::vector<uint8> in;
+			std::vector<uint8> dict;//tail of the previous block
+			std::vector<uint8> out;
+			std::size_t size;
+			uLong check;
+			bool last;
+			bool done;
+			std::exception_ptr error;
+		};
+
+		//one deflate state per thread, reset between blocks
+		struct compressor {
+			z_stream m_stream;
+
+			explicit compressor(int level) {
+				memset(&m_stream, 0, sizeof(m_stream));
+				if (deflateInit2(&m_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+					throw exception("deflateInit failed");
+			}
+
+			~compressor() {
+				deflateEnd(&m_stream);
+			}
+
+			void run(block& b, bool gzip) {
+				deflateReset(&m_stream);
+				if (!b.dict.empty() && deflateSetDictionary(&m_stream, b.dict.data(), (uInt)b.dict.size()) != Z_OK)
+					throw exception("deflateSetDictionary failed");
+				b.out.resize(deflateBound(&m_stream, (uLong)b.size) + 16);//room for the sync flush marker
+				m_stream.next_in = b.in.data();
+				m_stream.avail_in = (uInt)b.size;
+				std::size_t produced = 0;
+				for (;;) {
+					m_stream.next_out = b.out.data() + produced;
+					m_stream.avail_out = (uInt)(b.out.size() - produced);
+					int stat = deflate(&m_stream, b.last ? Z_FINISH : Z_SYNC_FLUSH);
+					produced = b.out.size() - m_stream.avail_out;
+					if (stat == Z_STREAM_ERROR)
+						throw exception("deflate failed");
+					if (b.last ? stat == Z_STREAM_END : (m_stream.avail_in == 0 && m_stream.avail_out != 0))
+						break;
+					b.out.resize(b.out.size() * 2);
+				}
+				b.out.resize(produced);
+				b.check = gzip ? crc32(crc32(0, Z_NULL, 0), b.in.data(), (uInt)b.size) : adler32(adler32(0, Z_NULL, 0), b.in.data(), (uInt)b.size);
+			}
+		};
+
+		block* take_block() {
+			block* b;
+			if (!m_spare.empty()) {
+				b = m_spare.back().release();
+				m_spare.pop_back();
+			}
+			else b = new block();
+			b->in.resize(m_options.block_size);
+			m_fill = 0;
+			return b;
+		}
+
+		void submit(bool last) {
+			block* b = mp_current;
+			mp_current = NULL;
+			b->size = m_fill;
+			b->last = last;
+			b->done = false;
+			b->error = NULL;
+			b->dict.assign(m_tail.begin(), m_tail.end());
+			std::size_t keep = std::min<std::size_t>(b->size, 0x8000);//the deflate window
+			if (keep == 0x8000)
+				m_tail.assign(b->in.data() + b->size - keep, b->in.data() + b->size);
+			else {
+				m_tail.insert(m_tail.end(), b->in.data(), b->in.data() + keep);
+				if (m_tail.size() > 0x8000)
+					m_tail.erase(m_tail.begin(), m_tail.end() - 0x8000);
+			}
+			if (m_inline) {
+				m_inline->run(*b, m_options.wrapper == deflate_wrapper::gzip);
+				b->done = true;
+				m_pending.emplace_back(b);
+				write_front();
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_pending.emplace_back(b);
+				m_jobs.push_back(b);
+			}
+			m_wake.notify_one();
+			//keep a couple of blocks per thread in flight, memory stays bounded when compression is the bottleneck
+			while (m_pending.size() > 2 * (std::size_t)m_options.threads || (!m_pending.empty() && front_done()))
+				write_front();
+		}
+
+		bool front_done() {
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_pending.front()->done;
+		}
+
+		//waits for the oldest block, appends it to the sink and recycles it
+		void write_front() {
+			block* b = m_pending.front().get();
+			if (!m_inline) {
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_done.wait(lock, [b] { return b->done; });
+			}
+			if (b->error)
+				std::rethrow_exception(b->error);
+			if (!b->out.empty())
+				m_sink.write(b->out.data(), (uint32)b->out.size());
+			m_written += b->out.size();
+			if (m_options.wrapper == deflate_wrapper::gzip)
+				m_check = crc32_combine(m_check, b->check, (z_off_t)b->size);
+			else m_check = adler32_combine(m_check, b->check, (z_off_t)b->size);
+			m_spare.push_back(std::move(m_pending.front()));
+			m_pending.pop_front();
+		}
+
+		void work() {
+			std::unique_ptr<compressor> z;
+			bool gzip = m_options.wrapper == deflate_wrapper::gzip;
+			for (;;) {
+				block* b;
+				{
+					std::unique_lock<std::mutex> lock(m_lock);
+					m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+					if (m_stop)
+						return;
+					b = m_jobs.front();
+					m_jobs.pop_front();
+				}
+				std::exception_ptr error;
+				try {
+					if (!z)
+						z.reset(new compressor(m_options.level));
+					z->run(*b, gzip);
+				}
+				catch (...) {
+					error = std::current_exception();
+				}
+				{
+					std::lock_guard<std::mutex> lock(m_lock);
+					b->error = error;
+					b->done = true;
+				}
+				m_done.notify_all();
+			}
+		}
+
+		void write_header() {
+			m_written = 0;
+			if (m_options.wrapper == deflate_wrapper::gzip) {
+				const uint8 header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };//no name, no mtime, unknown os
+				m_sink.write(header, sizeof(header));
+				m_written += sizeof(header);
+			}
+			else {
+				int level = m_options.level;
+				uint8 flevel = level == 0 || level == 1 ? 0 : level < 6 && level > 0 ? 1 : level == 6 || level < 0 ? 2 : 3;
+				uint8 header[2] = { 0x78, (uint8)(flevel << 6) };
+				header[1] += 31 - (header[0] * 256 + header[1]) % 31;
+				m_sink.write(header, sizeof(header));
+				m_written += sizeof(header);
+			}
+		}
+
+		void write_trailer() {
+			if (m_options.wrapper == deflate_wrapper::gzip) {
+				m_sink.write_le<std::uint32_t>((std::uint32_t)m_check);
+				m_sink.write_le<std::uint32_t>((std::uint32_t)this->position);//size mod 2^32
+			}
+			else m_sink.write_be<std::uint32_t>((std::uint32_t)m_check);
+			m_written += m_options.wrapper == deflate_wrapper::gzip ? 8 : 4;
+		}
+
+		byteoutstream& m_sink;
+		deflate_options m_options;
+		block* mp_current;
+		std::size_t m_fill;
+		std::vector<uint8> m_tail;
+		std::deque<std::unique_ptr<block>> m_pending;//submitted, in stream order
+		std::vector<std::unique_ptr<block>> m_spare;
+		std::unique_ptr<compressor> m_inline;
+		uLong m_check;
+		uint64 m_written;
+
+		std::vector<std::thread> m_workers;
+		std::deque<block*> m_jobs;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		bool m_stop;
+		bool m_finished;
+	};
+
+	//root tag encoded in fmt, compressed into output with the given options
+	inline void write_tag(byteoutstream& output, base* input, format fmt, const deflate_options& options) {
+		deflate_outstream compressed(output, options);
+		write_tag(compressed, input, fmt);
+		compressed.finish();
+	}
+
+}
+#endif
+
+#endif
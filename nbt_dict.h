@@ -0,0 +1,303 @@
+#ifndef _NBT_DICT
+#define _NBT_DICT
+
+#include "nbt.h"
+#include <unordered_set>
+#include <algorithm>
+
+#ifndef _NBT_NO_COMPRESS
+namespace nbt {
+
+	//preset dictionary for compressing small messages. id goes into every frame compressed with it, 0 is
+	//reserved for frames without one
+	struct dictionary {
+		std::uint32_t id;
+		std::string data;//at most 32k is used, the deflate window
+	};
+
+	//dictionaries a receiver knows, by id
+	class dictionary_set {
+	public:
+
+		void add(const dictionary& dict) {
+			if (!dict.id)
+				throw exception("dictionary id 0 is reserved");
+			m_dicts[dict.id] = dict;
+		}
+
+		const dictionary* find(std::uint32_t id) const {
+			auto it = m_dicts.find(id);
+			return it == m_dicts.end() ? NULL : &it->second;
+		}
+
+	private:
+		std::unordered_map<std::uint32_t, dictionary> m_dicts;
+	};
+
+	namespace dict_detail {
+
+		static constexpr std::size_t window = 0x8000;
+		static constexpr std::size_t max_frame = 0x200000;//default cap on what one frame may inflate to
+
+		inline const uint8* trimmed(const dictionary& dict, uInt& size) {
+			size = (uInt)std::min(dict.data.size(), window);
+			return (const uint8*)dict.data.data() + (dict.data.size() - size);//deflate only reaches back a window
+		}
+
+		inline void put_varuint(std::vector<uint8>& out, std::uint64_t v) {
+			while (v >= 0x80) {
+				out.push_back((uint8)v | 0x80);
+				v >>= 7;
+			}
+			out.push_back((uint8)v);
+		}
+
+		inline std::uint64_t get_varuint(const uint8*& p, const uint8* end) {
+			std::uint64_t v = 0;
+			for (int shift = 0; p < end && shift < 64; shift += 7) {
+				uint8 b = *p++;
+				v |= (std::uint64_t)(b & 0x7F) << shift;
+				if (!(b & 0x80))
+					return v;
+			}
+			throw exception("truncated frame header");
+		}
+
+		inline std::uint64_t kmer(const uint8* p, std::size_t k) {
+			std::uint64_t v = 0;
+			memcpy(&v, p, k);
+			return v;
+		}
+
+	}
+
+	//compresses messages into frames: varuint dictionary id, varuint uncompressed size, raw deflate. the deflate
+	//state is kept between messages and only reset, which is most of the cost of compressing something small
+	class frame_compressor {
+	public:
+
+		//dict may be NULL, it must outlive the compressor
+		explicit frame_compressor(const dictionary* dict = NULL, int level = 6) : mp_dict(dict) {
+			memset(&m_stream, 0, sizeof(m_stream));
+			if (deflateInit2(&m_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw exception("deflateInit failed");
+		}
+
+		frame_compressor(const frame_compressor&) = delete;
+		frame_compressor& operator=(const frame_compressor&) = delete;
+
+		~frame_compressor() {
+			deflateEnd(&m_stream);
+		}
+
+		//replaces out with the frame
+		void compress(const uint8* data, std::size_t size, std::vector<uint8>& out) {
+			if (size > std::numeric_limits<uInt>::max())
+				throw exception("message too big for one frame");
+			out.clear();
+			dict_detail::put_varuint(out, mp_dict ? mp_dict->id : 0);
+			dict_detail::put_varuint(out, size);
+			std::size_t header = out.size();
+			deflateReset(&m_stream);
+			if (mp_dict) {
+				uInt dict_size;
+				const uint8* dict = dict_detail::trimmed(*mp_dict, dict_size);
+				if (deflateSetDictionary(&m_stream, dict, dict_size) != Z_OK)
+					throw exception("deflateSetDictionary failed");
+			}
+			uLong bound = deflateBound(&m_stream, (uLong)size);
+			out.resize(header + bound);
+			m_stream.next_in = (Bytef*)data;
+			m_stream.avail_in = (uInt)size;
+			m_stream.next_out = out.data() + header;
+			m_stream.avail_out = (uInt)bound;
+			if (deflate(&m_stream, Z_FINISH) != Z_STREAM_END)
+				throw exception("deflate failed");
+			out.resize(header + (bound - m_stream.avail_out));
+		}
+
+		//the tree encoded in fmt, then compressed
+		void compress(base* tag, format fmt, std::vector<uint8>& out) {
+			m_raw.seek_beg(0);
+			write_tag(m_raw, tag, fmt);
+			compress(m_raw.get_buffer(), (std::size_t)m_raw.get_position(), out);
+		}
+
+		const dictionary* get_dictionary() const {
+			return mp_dict;
+		}
+
+	private:
+		const dictionary* mp_dict;
+		z_stream m_stream;
+		byteoutstream m_raw;
+	};
+
+	//opens frames made by frame_compressor, looking their dictionary up by id
+	class frame_decompressor {
+	public:
+
+		//dicts may be NULL if only frames without a dictionary are expected, it must outlive the decompressor
+		explicit frame_decompressor(const dictionary_set* dicts = NULL) : mp_dicts(dicts) {
+			memset(&m_stream, 0, sizeof(m_stream));
+			if (inflateInit2(&m_stream, -15) != Z_OK)
+				throw exception("inflateInit failed");
+		}
+
+		frame_decompressor(const frame_decompressor&) = delete;
+		frame_decompressor& operator=(const frame_decompressor&) = delete;
+
+		~frame_decompressor() {
+			inflateEnd(&m_stream);
+		}
+
+		//replaces out with the message. frames claiming more than max_size bytes are refused before inflating
+		void decompress(const uint8* data, std::size_t size, std::vector<uint8>& out, std::size_t max_size = dict_detail::max_frame) {
+			const uint8* p = data;
+			const uint8* end = data + size;
+			std::uint64_t id = dict_detail::get_varuint(p, end);
+			std::uint64_t length = dict_detail::get_varuint(p, end);
+			if (length > max_size || length > std::numeric_limits<uInt>::max())
+				throw exception("frame too big");
+			_NBT_STATS_TIMER(inflate_start);
+			inflateReset(&m_stream);
+			if (id) {
+				const dictionary* dict = mp_dicts && id <= std::numeric_limits<std::uint32_t>::max() ? mp_dicts->find((std::uint32_t)id) : NULL;
+				if (!dict)
+					throw exception("frame uses an unknown dictionary");
+				uInt dict_size;
+				const uint8* bytes = dict_detail::trimmed(*dict, dict_size);
+				if (inflateSetDictionary(&m_stream, bytes, dict_size) != Z_OK)
+					throw exception("inflateSetDictionary failed");
+			}
+			out.resize((std::size_t)length);
+			uint8 spare;//lets inflate see the end of the stream when the output is exactly full
+			m_stream.next_in = (Bytef*)p;
+			m_stream.avail_in = (uInt)(end - p);
+			m_stream.next_out = length ? out.data() : &spare;
+			m_stream.avail_out = (uInt)length;
+			int stat = inflate(&m_stream, Z_FINISH);
+			if (stat != Z_STREAM_END || m_stream.total_out != length || m_stream.avail_in)
+				throw exception("bad compressed frame");
+			_NBT_STATS_ELAPSED(inflate_ns, inflate_start);
+			_NBT_STATS_ADD(inflated_bytes, length);
+		}
+
+		//decompresses into a buffer kept for the next frame and decodes the root tag in fmt. caller owns the result
+		base* read(const uint8* data, std::size_t size, size_tracker& tracker, format fmt, std::size_t max_size = dict_detail::max_frame) {
+			decompress(data, size, m_buffer, max_size);
+			if (m_buffer.empty())
+				throw exception("empty frame");
+			bytestream input(m_buffer.data(), m_buffer.size());
+			input.keep_buffer(true);
+			try {
+				return read_tag_uncompressed(input, tracker, fmt);
+			}
+			catch (const char* msg) {//short reads in the stream
+				throw exception(msg);
+			}
+		}
+
+	private:
+		const dictionary_set* mp_dicts;
+		z_stream m_stream;
+		std::vector<uint8> m_buffer;
+	};
+
+	//builds a dictionary from sample messages (uncompressed, as they go on the wire). substrings of k bytes are
+	//counted once per sample they occur in, then every epoch (a slice of the concatenated samples) gives the
+	//segment whose not yet covered substrings are shared by the most samples. picked substrings stop counting,
+	//so a key name that is everywhere is taken once. the segments are sorted by score, the best last, nearest the data, where
+	//deflate's distance codes are cheapest. every frame pays for loading the dictionary (about linear in its
+	//size), past a few k the ratio on small messages barely improves
+	inline dictionary train_dictionary(const std::vector<std::vector<uint8>>& samples, std::uint32_t id, std::size_t max_size = 0x1000, std::size_t segment = 64) {
+		constexpr std::size_t k = 6;
+		if (!id)
+			throw exception("dictionary id 0 is reserved");
+		max_size = std::min(max_size, dict_detail::window);
+		segment = std::max(segment, k);
+
+		std::unordered_map<std::uint64_t, std::uint32_t> freq;
+		std::unordered_set<std::uint64_t> seen;
+		std::vector<uint8> corpus;
+		for (const std::vector<uint8>& sample : samples) {
+			if (sample.size() < k)
+				continue;
+			seen.clear();
+			for (std::size_t i = 0; i + k <= sample.size(); i++)
+				if (seen.insert(dict_detail::kmer(sample.data() + i, k)).second)
+					freq[dict_detail::kmer(sample.data() + i, k)]++;
+			corpus.insert(corpus.end(), sample.begin(), sample.end());
+		}
+		for (auto it = freq.begin(); it != freq.end();) {//only substrings that repeat across samples are worth a place
+			if (it->second < 2)
+				it = freq.erase(it);
+			else it++;
+		}
+
+		dictionary dict;
+		dict.id = id;
+		std::vector<std::pair<std::uint64_t, std::string>> picked;//score, segment
+		std::size_t total = 0;
+		std::size_t epochs = std::max<std::size_t>(1, max_size / segment);
+		std::size_t epoch = corpus.size() / epochs;
+		if (epoch < segment) {
+			epoch = segment;
+			epochs = corpus.size() / segment;
+		}
+		auto score = [&](std::size_t pos) -> std::uint64_t {
+			auto it = freq.find(dict_detail::kmer(corpus.data() + pos, k));
+			return it == freq.end() ? 0 : it->second;
+		};
+		for (std::size_t e = 0; e < epochs && total < max_size; e++) {
+			std::size_t begin = e * epoch;
+			std::size_t end = std::min(corpus.size(), begin + epoch);
+			if (end - begin < segment)
+				break;
+			std::uint64_t sum = 0, best = 0;
+			std::size_t best_at = begin;
+			std::size_t width = segment - k + 1;//substrings starting inside a segment
+			for (std::size_t i = begin; i < begin + width; i++)
+				sum += score(i);
+			best = sum;
+			for (std::size_t at = begin + 1; at + segment <= end; at++) {
+				sum += score(at + width - 1);
+				sum -= score(at - 1);
+				if (sum > best) {
+					best = sum;
+					best_at = at;
+				}
+			}
+			if (!best)
+				continue;
+			for (std::size_t i = best_at; i < best_at + width; i++)
+				freq.erase(dict_detail::kmer(corpus.data() + i, k));
+			std::size_t take = std::min(segment, max_size - total);
+			picked.emplace_back(best, std::string((const char*)corpus.data() + best_at, take));
+			total += take;
+		}
+		std::stable_sort(picked.begin(), picked.end(), [](const std::pair<std::uint64_t, std::string>& a, const std::pair<std::uint64_t, std::string>& b) {
+			return a.first < b.first;//highest score last
+		});
+		for (const auto& p : picked)
+			dict.data += p.second;
+		return dict;
+	}
+
+	//same, from trees encoded in fmt
+	inline dictionary train_dictionary(const std::vector<base*>& samples, format fmt, std::uint32_t id, std::size_t max_size = 0x1000, std::size_t segment = 64) {
+		std::vector<std::vector<uint8>> encoded;
+		encoded.reserve(samples.size());
+		byteoutstream raw;
+		for (base* tag : samples) {
+			raw.seek_beg(0);
+			write_tag(raw, tag, fmt);
+			encoded.emplace_back(raw.get_buffer(), raw.get_buffer() + raw.get_position());
+		}
+		return train_dictionary(encoded, id, max_size, segment);
+	}
+
+}
+#endif
+
+#endif
@@ -0,0 +1,707 @@
+#ifndef _NBT_DIFF
+#define _NBT_DIFF
+
+#include "nbt.h"
+#include "nbt_visit.h"
+
+namespace nbt {
+
+	//encoded changes that turn one tree into another, see make_patch and apply_patch. empty when the trees are equal
+	typedef std::vector<uint8> tree_patch;
+
+	namespace diff_detail {
+
+		//a patch is the op for the root: replace (id + payload) or edit (ops for the root container). edits are a
+		//sequence of ops ended by op_end. keys and counts are varuints, tag payloads are java encoded and array
+		//elements little endian
+		enum op : uint8 {
+			op_end,
+			op_set,//compound: key, id, payload. adds or replaces
+			op_remove,//compound: key
+			op_edit,//compound: key, then the ops for that child
+			op_splice,//list: index, removed, inserted, then the element id and payloads if inserted
+			op_edit_at,//list: index, then the ops for that element
+			op_range,//array: offset, removed, inserted, then the elements
+			op_replace,//root only: id, payload
+			op_list_type,//list: element id, only for a list that ends up empty
+		};
+
+		inline std::uint64_t mix(std::uint64_t h) {
+			h ^= h >> 30;
+			h *= 0xbf58476d1ce4e5b9ull;
+			h ^= h >> 27;
+			h *= 0x94d049bb133111ebull;
+			return h ^ (h >> 31);
+		}
+
+		inline std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t h) {
+			const uint8* p = (const uint8*)data;
+			h ^= size * 0x9e3779b97f4a7c15ull;
+			for (; size >= 8; p += 8, size -= 8) {
+				std::uint64_t w;
+				memcpy(&w, p, 8);
+				h = mix(h ^ w);
+			}
+			std::uint64_t tail = 0;
+			if (size)
+				memcpy(&tail, p, size);
+			return mix(h ^ tail);
+		}
+
+		inline bool is_container(std::int8_t id) {
+			return id == 7 || id >= 9;
+		}
+
+		template<class T>
+		inline bool same_array(const T* a, const T* b) {
+			if (a->m_dataSize != b->m_dataSize)
+				return false;
+			if (a->mp_data == b->mp_data || !a->m_dataSize)//shared with a clone
+				return true;
+			return !memcmp(a->mp_data, b->mp_data, sizeof(*a->mp_data) * (std::size_t)a->m_dataSize);
+		}
+
+		template<class T>
+		inline bool same_bits(const base* a, const base* b) {
+			auto x = tag_cast<T>(a)->m_data;
+			auto y = tag_cast<T>(b)->m_data;
+			return !memcmp(&x, &y, sizeof(x));
+		}
+
+	}
+
+	//deep equality. floating point values compare by their bits, so a NaN equals itself and -0 differs from 0.
+	//empty lists compare their element type, which is written out with them
+	inline bool equal(const base* a, const base* b) {
+		if (a == b)
+			return true;
+		if (!a || !b || a->get_id() != b->get_id())
+			return false;
+		switch (a->get_id()) {
+		case 1: return diff_detail::same_bits<tag_byte>(a, b);
+		case 2: return diff_detail::same_bits<tag_short>(a, b);
+		case 3: return diff_detail::same_bits<tag_int>(a, b);
+		case 4: return diff_detail::same_bits<tag_long>(a, b);
+		case 5: return diff_detail::same_bits<tag_float>(a, b);
+		case 6: return diff_detail::same_bits<tag_double>(a, b);
+		case 7: return diff_detail::same_array(tag_cast<tag_bytearray>(a), tag_cast<tag_bytearray>(b));
+		case 8: return static_cast<const tag_string*>(a)->m_data == static_cast<const tag_string*>(b)->m_data;
+		case 9: {
+			const std::vector<base*>& x = static_cast<const tag_list*>(a)->get_tags();
+			const std::vector<base*>& y = static_cast<const tag_list*>(b)->get_tags();
+			if (x.size() != y.size() || (x.empty() && static_cast<const tag_list*>(a)->get_tag_type() != static_cast<const tag_list*>(b)->get_tag_type()))
+				return false;
+			for (std::size_t i = 0; i < x.size(); i++)
+				if (!equal(x[i], y[i]))
+					return false;
+			return true;
+		}
+		case 10: {
+			const tag_compound* x = static_cast<const tag_compound*>(a);
+			const tag_compound* y = static_cast<const tag_compound*>(b);
+			if (x->m_tagMap.size() != y->m_tagMap.size())
+				return false;
+			for (auto it = x->m_tagMap.begin(); it != x->m_tagMap.end(); it++) {
+				auto other = y->m_tagMap.find(it->first);
+				if (other == y->m_tagMap.end() || !equal(it->second, other->second))
+					return false;
+			}
+			return true;
+		}
+		case 11: return diff_detail::same_array(tag_cast<tag_intarray>(a), tag_cast<tag_intarray>(b));
+		case 12: return diff_detail::same_array(tag_cast<tag_longarray>(a), tag_cast<tag_longarray>(b));
+		default:
+			return true;
+		}
+	}
+
+	//structural hash, equal trees hash equal. compound entries are combined order independently
+	inline std::uint64_t hash_tree(const base* tag) {
+		using diff_detail::mix;
+		using diff_detail::hash_bytes;
+		std::int8_t id = tag->get_id();
+		std::uint64_t h = mix(0x6e6274ull + (std::uint64_t)id);
+		switch (id) {
+		case 1: return mix(h ^ (std::uint8_t)tag_cast<tag_byte>(tag)->m_data);
+		case 2: return mix(h ^ (std::uint16_t)tag_cast<tag_short>(tag)->m_data);
+		case 3: return mix(h ^ (std::uint32_t)tag_cast<tag_int>(tag)->m_data);
+		case 4: return mix(h ^ (std::uint64_t)tag_cast<tag_long>(tag)->m_data);
+		case 5: return hash_bytes(&tag_cast<tag_float>(tag)->m_data, sizeof(float), h);
+		case 6: return hash_bytes(&tag_cast<tag_double>(tag)->m_data, sizeof(double), h);
+		case 7: {
+			const tag_bytearray* t = tag_cast<tag_bytearray>(tag);
+			return hash_bytes(t->mp_data, (std::size_t)t->m_dataSize, h);
+		}
+		case 8: {
+			const std::string& s = static_cast<const tag_string*>(tag)->m_data;
+			return hash_bytes(s.data(), s.size(), h);
+		}
+		case 9: {
+			for (const base* child : static_cast<const tag_list*>(tag)->get_tags())
+				h = mix(h ^ hash_tree(child));
+			return h;
+		}
+		case 10: {
+			const tag_compound* t = static_cast<const tag_compound*>(tag);
+			std::uint64_t sum = 0;
+			for (auto it = t->m_tagMap.begin(); it != t->m_tagMap.end(); it++)
+				sum += mix(hash_bytes(it->first.data(), it->first.size(), 0) ^ hash_tree(it->second));
+			return mix(h ^ sum ^ t->m_tagMap.size());
+		}
+		case 11: {
+			const tag_intarray* t = tag_cast<tag_intarray>(tag);
+			return hash_bytes(t->mp_data, sizeof(std::int32_t) * (std::size_t)t->m_dataSize, h);
+		}
+		case 12: {
+			const tag_longarray* t = tag_cast<tag_longarray>(tag);
+			return hash_bytes(t->mp_data, sizeof(std::int64_t) * (std::size_t)t->m_dataSize, h);
+		}
+		default:
+			return h;
+		}
+	}
+
+	//walks two trees side by side and writes the ops that turn the first into the second. unchanged subtrees
+	//are left out, with shared array buffers and identical pointers skipped without looking at their contents
+	class patch_writer {
+	public:
+
+		tree_patch diff(const base* from, const base* to) {
+			m_output.seek_beg(0);
+			if (from->get_id() == to->get_id() && diff_detail::is_container(to->get_id())) {
+				put(diff_detail::op_edit);
+				if (!edit(from, to))
+					return tree_patch();
+			}
+			else if (!equal(from, to)) {
+				put(diff_detail::op_replace);
+				payload(to);
+			}
+			else return tree_patch();
+			uint8* data = m_output.get_buffer();
+			return tree_patch(data, data + m_output.get_position());
+		}
+
+	private:
+
+		//ops for a container of the same type in both trees, ended by op_end. writes nothing and returns false
+		//when there are no changes
+		bool edit(const base* from, const base* to) {
+			if (from == to)
+				return false;
+			uint64 start = m_output.get_position();
+			switch (to->get_id()) {
+			case 7:
+				array(tag_cast<tag_bytearray>(from), tag_cast<tag_bytearray>(to));
+				break;
+			case 9:
+				list(static_cast<const tag_list*>(from), static_cast<const tag_list*>(to));
+				break;
+			case 10:
+				compound(static_cast<const tag_compound*>(from), static_cast<const tag_compound*>(to));
+				break;
+			case 11:
+				array(tag_cast<tag_intarray>(from), tag_cast<tag_intarray>(to));
+				break;
+			case 12:
+				array(tag_cast<tag_longarray>(from), tag_cast<tag_longarray>(to));
+				break;
+			default:
+				break;
+			}
+			if (m_output.get_position() == start)
+				return false;
+			put(diff_detail::op_end);
+			return true;
+		}
+
+		void compound(const tag_compound* from, const tag_compound* to) {
+			for (auto it = to->m_tagMap.begin(); it != to->m_tagMap.end(); it++) {
+				auto old = from->m_tagMap.find(it->first);
+				const base* value = it->second;
+				if (old != from->m_tagMap.end() && old->second->get_id() == value->get_id()) {
+					if (diff_detail::is_container(value->get_id())) {
+						uint64 mark = m_output.get_position();
+						put(diff_detail::op_edit);
+						key(it->first);
+						if (!edit(old->second, value))
+							m_output.seek_beg(mark);
+						continue;
+					}
+					if (equal(old->second, value))
+						continue;
+				}
+				put(diff_detail::op_set);
+				key(it->first);
+				payload(value);
+			}
+			for (auto it = from->m_tagMap.begin(); it != from->m_tagMap.end(); it++) {
+				if (to->m_tagMap.find(it->first) == to->m_tagMap.end()) {
+					put(diff_detail::op_remove);
+					key(it->first);
+				}
+			}
+		}
+
+		//common ends are trimmed first. in between, the elements are matched up by a shortest edit script over
+		//their hashes (myers), so a moved element costs its own payload and not everything it passed. the
+		//removed and inserted runs between matches are paired up front to front: containers of the same type
+		//are edited in place, the rest spliced. the target index of every op is where the old list would be
+		//after the ops before it, i.e. prefix + elements of the new list handled so far
+		void list(const tag_list* from, const tag_list* to) {
+			const std::vector<base*>& a = from->get_tags();
+			const std::vector<base*>& b = to->get_tags();
+			if (b.empty() && from->get_tag_type() != to->get_tag_type()) {//the type of an empty list is kept too
+				if (!a.empty())
+					splice(0, a.size(), NULL, 0);
+				put(diff_detail::op_list_type);
+				put((uint8)to->get_tag_type());
+				return;
+			}
+			if (!a.empty() && !b.empty() && from->get_tag_type() != to->get_tag_type()) {
+				splice(0, a.size(), b.data(), b.size());
+				return;
+			}
+			std::size_t prefix = 0;
+			while (prefix < a.size() && prefix < b.size() && equal(a[prefix], b[prefix]))
+				prefix++;
+			std::size_t suffix = 0;
+			while (suffix < a.size() - prefix && suffix < b.size() - prefix && equal(a[a.size() - 1 - suffix], b[b.size() - 1 - suffix]))
+				suffix++;
+			std::size_t end_a = a.size() - suffix, end_b = b.size() - suffix;
+			if (prefix == end_a || prefix == end_b) {//pure insert or removal
+				if (prefix != end_a || prefix != end_b)
+					splice(prefix, end_a - prefix, b.data() + prefix, end_b - prefix);
+				return;
+			}
+
+			std::vector<bool> kept_a, kept_b;
+			match(a.data() + prefix, end_a - prefix, b.data() + prefix, end_b - prefix, kept_a, kept_b);
+			std::size_t i = prefix, j = prefix;
+			while (i < end_a || j < end_b) {
+				if (i < end_a && j < end_b && kept_a[i - prefix] && kept_b[j - prefix]) {
+					i++;
+					j++;
+					continue;
+				}
+				std::size_t gap_a = i, gap_b = j;
+				while (gap_a < end_a && !kept_a[gap_a - prefix])
+					gap_a++;
+				while (gap_b < end_b && !kept_b[gap_b - prefix])
+					gap_b++;
+				std::size_t pending_at = j, removed = 0, inserted = 0;
+				for (; i < gap_a && j < gap_b; i++, j++) {
+					if (a[i]->get_id() == b[j]->get_id() && diff_detail::is_container(b[j]->get_id())) {
+						if (removed || inserted)
+							splice(pending_at, removed, b.data() + pending_at, inserted);
+						removed = inserted = 0;
+						uint64 mark = m_output.get_position();
+						put(diff_detail::op_edit_at);
+						varuint(j);
+						if (!edit(a[i], b[j]))
+							m_output.seek_beg(mark);
+						pending_at = j + 1;
+					}
+					else {
+						removed++;
+						inserted++;
+					}
+				}
+				removed += gap_a - i;
+				inserted += gap_b - j;
+				if (removed || inserted)
+					splice(pending_at, removed, b.data() + pending_at, inserted);
+				i = gap_a;
+				j = gap_b;
+			}
+		}
+
+		//marks the elements of the longest common subsequence of a and b, compared by hash and then equal.
+		//myers' greedy search keeps one diagonal frontier per edit, so it is quick when the lists are mostly
+		//the same. past max_edits it gives up and matches nothing, every element is then paired or spliced
+		void match(base* const* a, std::size_t n, base* const* b, std::size_t m, std::vector<bool>& kept_a, std::vector<bool>& kept_b) {
+			const std::ptrdiff_t max_edits = 1024;//the trace below grows with its square, 4M at most
+			kept_a.assign(n, false);
+			kept_b.assign(m, false);
+			std::vector<std::uint64_t> hash_a(n), hash_b(m);
+			for (std::size_t i = 0; i < n; i++)
+				hash_a[i] = hash_tree(a[i]);
+			for (std::size_t j = 0; j < m; j++)
+				hash_b[j] = hash_tree(b[j]);
+			auto same = [&](std::ptrdiff_t x, std::ptrdiff_t y) {
+				return hash_a[x] == hash_b[y] && equal(a[x], b[y]);
+			};
+
+			const std::ptrdiff_t N = (std::ptrdiff_t)n, M = (std::ptrdiff_t)m;
+			const std::ptrdiff_t limit = N + M < max_edits ? N + M : max_edits;
+			std::vector<std::ptrdiff_t> v(2 * limit + 3, 0);
+			const std::ptrdiff_t off = limit + 1;
+			std::vector<std::int32_t> trace;//v[-d..d] after every round d, back to back. list sizes are int32
+			std::ptrdiff_t found = -1;
+			for (std::ptrdiff_t d = 0; d <= limit && found < 0; d++) {
+				for (std::ptrdiff_t k = -d; k <= d; k += 2) {
+					std::ptrdiff_t x = k == -d || (k != d && v[off + k - 1] < v[off + k + 1]) ? v[off + k + 1] : v[off + k - 1] + 1;
+					std::ptrdiff_t y = x - k;
+					while (x < N && y < M && same(x, y)) {
+						x++;
+						y++;
+					}
+					v[off + k] = x;
+					if (x >= N && y >= M)
+						found = d;
+				}
+				trace.insert(trace.end(), v.begin() + off - d, v.begin() + off + d + 1);
+			}
+			if (found < 0)
+				return;
+
+			//walk back from the end, marking the diagonal runs (the snakes) between edits
+			std::ptrdiff_t x = N, y = M;
+			for (std::ptrdiff_t d = found; d > 0; d--) {
+				const std::int32_t* prev = trace.data() + (d - 1) * (d - 1) + (d - 1);//v[0] of round d - 1
+				std::ptrdiff_t k = x - y;
+				std::ptrdiff_t prev_k = k == -d || (k != d && prev[k - 1] < prev[k + 1]) ? k + 1 : k - 1;
+				std::ptrdiff_t prev_x = prev[prev_k];
+				std::ptrdiff_t prev_y = prev_x - prev_k;
+				std::ptrdiff_t snake_x = prev_k == k + 1 ? prev_x : prev_x + 1;//where the edit leaves off
+				for (; x > snake_x; x--, y--) {
+					kept_a[x - 1] = true;
+					kept_b[y - 1] = true;
+				}
+				x = prev_x;
+				y = prev_y;
+			}
+			for (; x > 0; x--, y--) {
+				kept_a[x - 1] = true;
+				kept_b[y - 1] = true;
+			}
+		}
+
+		void splice(std::size_t at, std::size_t removed, base* const* tags, std::size_t inserted) {
+			put(diff_detail::op_splice);
+			varuint(at);
+			varuint(removed);
+			varuint(inserted);
+			if (inserted) {
+				put((uint8)tags[0]->get_id());
+				for (std::size_t i = 0; i < inserted; i++)
+					const_cast<base*>(tags[i])->write_as<be_codec>(m_output);
+			}
+		}
+
+		//equal sized arrays get one range per run of changed elements, runs closer than a range header are
+		//merged. a resize is a single range between the common ends
+		template<class T>
+		void array(const T* from, const T* to) {
+			if (diff_detail::same_array(from, to))
+				return;
+			typedef std::remove_pointer_t<decltype(to->mp_data)> E;
+			const E* a = from->mp_data;
+			const E* b = to->mp_data;
+			std::size_t na = (std::size_t)from->m_dataSize, nb = (std::size_t)to->m_dataSize;
+			if (na != nb) {
+				std::size_t prefix = 0, suffix = 0;
+				while (prefix < na && prefix < nb && a[prefix] == b[prefix])
+					prefix++;
+				while (suffix < na - prefix && suffix < nb - prefix && a[na - 1 - suffix] == b[nb - 1 - suffix])
+					suffix++;
+				range(prefix, na - prefix - suffix, b + prefix, nb - prefix - suffix);
+				return;
+			}
+			constexpr std::size_t gap = (8 + sizeof(E) - 1) / sizeof(E);
+			std::size_t i = 0;
+			while (i < na) {
+				if (a[i] == b[i]) {
+					i++;
+					continue;
+				}
+				std::size_t start = i, last = i;
+				for (i++; i < na && i - last <= gap; i++)
+					if (a[i] != b[i])
+						last = i;
+				range(start, last + 1 - start, b + start, last + 1 - start);
+				i = last + 1;
+			}
+		}
+
+		template<class E>
+		void range(std::size_t at, std::size_t removed, const E* data, std::size_t inserted) {
+			put(diff_detail::op_range);
+			varuint(at);
+			varuint(removed);
+			varuint(inserted);
+			if (inserted)
+				m_output.write_array<endian_little>(data, (uint32)inserted);
+		}
+
+		//writing doesnt modify the tag, write_as just isnt const
+		void payload(const base* tag) {
+			put((uint8)tag->get_id());
+			const_cast<base*>(tag)->write_as<be_codec>(m_output);
+		}
+
+		void key(const std::string& name) {
+			varuint(name.size());
+			if (!name.empty())
+				m_output.write((const uint8*)name.data(), (uint32)name.size());
+		}
+
+		void put(uint8 b) {
+			m_output.write(&b, 1);
+		}
+
+		void varuint(std::size_t v) {
+			m_output.write_varuint((std::uint64_t)v);
+		}
+
+		byteoutstream m_output;
+	};
+
+	inline tree_patch make_patch(const base* from, const base* to) {
+		if (!from || !to)
+			throw exception("null tag passed to make_patch");
+		return patch_writer().diff(from, to);
+	}
+
+	//applies the ops of a patch made against an equal tree. root may be replaced if the patch changes its type.
+	//throws nbt::exception if the patch is malformed or doesnt fit the tree, which may then be partly patched:
+	//apply to a clone when the patch comes from somewhere untrusted
+	class patch_reader {
+	public:
+
+		patch_reader(const uint8* data, std::size_t size, std::int64_t max_bytes)
+			: m_input((uint8*)data, size), m_tracker(max_bytes) {
+			m_input.keep_buffer(true);
+		}
+
+		void apply(base*& root) {
+			try {
+				uint8 op = m_input.read();
+				if (op == diff_detail::op_replace) {
+					base* tag = payload(m_input.read(), 0);
+					delete root;
+					root = tag;
+				}
+				else if (op == diff_detail::op_edit)
+					edit(root, 0);
+				else throw exception("bad patch op");
+				if (m_input.get_position() != m_input.get_stream_size())
+					throw exception("trailing bytes after patch");
+			}
+			catch (const char* msg) {//short reads in the stream
+				throw exception(msg);
+			}
+		}
+
+	private:
+
+		void edit(base* tag, int depth) {
+			if (depth > 0x200)
+				throw exception("patch nested too deep");
+			switch (tag->get_id()) {
+			case 7:
+				array(tag_cast<tag_bytearray>(tag));
+				break;
+			case 9:
+				list(static_cast<tag_list*>(tag), depth);
+				break;
+			case 10:
+				compound(static_cast<tag_compound*>(tag), depth);
+				break;
+			case 11:
+				array(tag_cast<tag_intarray>(tag));
+				break;
+			case 12:
+				array(tag_cast<tag_longarray>(tag));
+				break;
+			default:
+				throw exception("patch edits a tag that is not a container");
+			}
+		}
+
+		void compound(tag_compound* tag, int depth) {
+			for (;;) {
+				uint8 op = m_input.read();
+				switch (op) {
+				case diff_detail::op_end:
+					return;
+				case diff_detail::op_set: {
+					std::string name = key();
+					base* value = payload(m_input.read(), depth + 1);
+					auto it = tag->m_tagMap.find(name);
+					if (it != tag->m_tagMap.end()) {
+						delete it->second;
+						it->second = value;
+					}
+					else tag->m_tagMap.emplace(std::move(name), value);
+					break;
+				}
+				case diff_detail::op_remove: {
+					auto it = tag->m_tagMap.find(key());
+					if (it == tag->m_tagMap.end())
+						throw exception("patch removes a missing key");
+					delete it->second;
+					tag->m_tagMap.erase(it);
+					break;
+				}
+				case diff_detail::op_edit: {
+					auto it = tag->m_tagMap.find(key());
+					if (it == tag->m_tagMap.end())
+						throw exception("patch edits a missing key");
+					edit(it->second, depth + 1);
+					break;
+				}
+				default:
+					throw exception("bad patch op for a compound");
+				}
+			}
+		}
+
+		void list(tag_list* tag, int depth) {
+			for (;;) {
+				uint8 op = m_input.read();
+				switch (op) {
+				case diff_detail::op_end:
+					return;
+				case diff_detail::op_splice: {
+					std::uint64_t at = varuint(), removed = varuint(), inserted = varuint();
+					if (at > tag->size() || removed > tag->size() - at)
+						throw exception("patch splice out of range");
+					tag->erase_tags((std::size_t)at, (std::size_t)removed);
+					if (inserted) {
+						if (inserted > m_input.get_stream_size() - m_input.get_position())
+							throw exception("patch splice longer than the patch");
+						std::int8_t id = m_input.read();
+						if (!id)//append_tag would drop it
+							throw exception("bad list element id in patch");
+						for (std::uint64_t i = 0; i < inserted; i++) {
+							base* element = create(id);
+							try {
+								element->read_as<be_codec>(m_input, depth + 1, m_tracker);
+								tag->insert_tag((std::size_t)(at + i), element);
+							}
+							catch (...) {
+								delete element;
+								throw;
+							}
+						}
+					}
+					break;
+				}
+				case diff_detail::op_list_type: {
+					std::int8_t id = m_input.read();
+					if (id < 0 || id > 12)
+						throw exception("bad list element id in patch");
+					tag->set_tag_type(id);//throws unless the list is empty by now
+					break;
+				}
+				case diff_detail::op_edit_at: {
+					std::uint64_t at = varuint();
+					if (at >= tag->size())
+						throw exception("patch edits a missing list element");
+					edit(tag->get_tags()[(std::size_t)at], depth + 1);
+					break;
+				}
+				default:
+					throw exception("bad patch op for a list");
+				}
+			}
+		}
+
+		template<class T>
+		void array(T* tag) {
+			typedef std::remove_pointer_t<decltype(tag->mp_data)> E;
+			for (;;) {
+				uint8 op = m_input.read();
+				if (op == diff_detail::op_end)
+					return;
+				if (op != diff_detail::op_range)
+					throw exception("bad patch op for an array");
+				std::uint64_t at = varuint(), removed = varuint(), inserted = varuint();
+				std::uint64_t size = (std::uint64_t)tag->m_dataSize;
+				if (at > size || removed > size - at)
+					throw exception("patch range out of bounds");
+				if (inserted > (m_input.get_stream_size() - m_input.get_position()) / sizeof(E))
+					throw exception("patch range longer than the patch");
+				std::uint64_t result = size - removed + inserted;
+				if (result > (std::uint64_t)std::numeric_limits<std::int32_t>::max())
+					throw exception("patched array too long");
+				if (removed == inserted) {
+					if (inserted) {
+						tag->unshare();
+						m_input.read_array<endian_little>(tag->mp_data + at, (uint32)inserted);
+					}
+					continue;
+				}
+				m_tracker.read(8ull * sizeof(E) * inserted);
+				E* data = result ? new E[(std::size_t)result] : NULL;
+				try {
+					if (inserted)
+						m_input.read_array<endian_little>(data + at, (uint32)inserted);
+				}
+				catch (...) {
+					delete[] data;
+					throw;
+				}
+				if (at)
+					memcpy(data, tag->mp_data, sizeof(E) * (std::size_t)at);
+				if (size - at - removed)
+					memcpy(data + at + inserted, tag->mp_data + at + removed, sizeof(E) * (std::size_t)(size - at - removed));
+				tag->clear_buffer();
+				tag->mp_data = data;
+				tag->m_dataSize = (int)result;
+			}
+		}
+
+		base* payload(std::int8_t id, int depth) {
+			base* tag = create(id);
+			try {
+				tag->read_as<be_codec>(m_input, depth, m_tracker);
+			}
+			catch (...) {
+				delete tag;
+				throw;
+			}
+			return tag;
+		}
+
+		static base* create(std::int8_t id) {
+			base* tag = (std::uint8_t)id < 13 ? base::create(id) : NULL;
+			if (!tag)
+				throw exception("bad tag id in patch");
+			return tag;
+		}
+
+		std::string key() {
+			std::uint64_t size = varuint();
+			if (size > m_input.get_stream_size() - m_input.get_position())
+				throw exception("patch key longer than the patch");
+			std::string name((std::size_t)size, '\0');
+			if (size)
+				m_input.read_to((uint8*)&name[0], (uint32)size);
+			return name;
+		}
+
+		std::uint64_t varuint() {
+			return m_input.read_varuint<std::uint64_t>();
+		}
+
+		bytestream m_input;
+		size_tracker m_tracker;
+	};
+
+	inline void apply_patch(base*& root, const uint8* data, std::size_t size, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max()) {
+		if (!size)
+			return;
+		if (!root)
+			throw exception("null tag passed to apply_patch");
+		patch_reader(data, size, max_bytes).apply(root);
+	}
+
+	inline void apply_patch(base*& root, const tree_patch& patch, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max()) {
+		apply_patch(root, patch.data(), patch.size(), max_bytes);
+	}
+
+}
+
+#endif
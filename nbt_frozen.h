@@ -0,0 +1,608 @@
+#ifndef _NBT_FROZEN
+#define _NBT_FROZEN
+
+#include "nbt.h"
+#include <algorithm>
+#include <string_view>
+
+namespace nbt {
+
+	//read only image of a tree that is used in place, e.g. straight out of a memory mapped file.
+	//everything is native byte order and 8 aligned, references are 32 bit offsets from the start of the
+	//image, so the same bytes work at any address and in any process. children always come before
+	//their parent, the root last
+	namespace frozen_layout {
+
+		static constexpr char magic[4] = { 'N', 'B', 'T', 'F' };
+		static constexpr std::uint8_t version = 1;
+
+		struct header {
+			char magic[4];
+			std::uint8_t version;
+			std::uint8_t endian;//endian_native of the writer, images dont travel between byte orders
+			std::int8_t root_type;
+			std::uint8_t pad;
+			std::uint64_t size;//whole image
+			std::uint64_t root;//value cell of the root
+		};
+
+		//strings (8 byte block, bytes, 0), arrays (block, T[count]), lists (block with the element type,
+		//then T[count] for numeric elements or uint32 offsets) and compounds (block, entry[count])
+		struct block {
+			std::uint32_t count;
+			std::int8_t type;
+			std::uint8_t pad[3];
+		};
+
+		//compound entries are sorted by key bytes. identical keys and strings are stored once
+		struct entry {
+			std::uint32_t key;
+			std::int8_t type;
+			std::uint8_t pad[3];
+			std::uint64_t value;//numbers inline, anything else an offset
+		};
+
+		static_assert(sizeof(header) == 24 && sizeof(block) == 8 && sizeof(entry) == 16, "frozen layout must not have implicit padding");
+
+		inline bool inline_type(std::int8_t type) {
+			return type >= 1 && type <= 6;
+		}
+
+		inline std::size_t inline_size(std::int8_t type) {
+			static const std::uint8_t sizes[7] = { 0, 1, 2, 4, 8, 4, 8 };
+			return sizes[type];
+		}
+
+	}
+
+	class frozen_compound;
+	class frozen_list;
+
+	template<class T>
+	struct frozen_array {
+		const T* data;
+		std::size_t size;
+
+		const T* begin() const { return data; }
+		const T* end() const { return data + size; }
+		const T& operator[](std::size_t i) const { return data[i]; }
+	};
+
+	//one value inside an image. cheap to copy, only valid while the image is
+	class frozen_value {
+	public:
+
+		frozen_value() : mp_base(NULL), m_type(0), m_cell(0) {}
+		frozen_value(const uint8* base, std::int8_t type, std::uint64_t cell) : mp_base(base), m_type(type), m_cell(cell) {}
+
+		inline std::int8_t get_id() const {
+			return m_type;
+		}
+
+		//false for lookups that found nothing
+		inline bool valid() const {
+			return mp_base != NULL;
+		}
+
+		template<class T>
+		inline T get() const {
+			static_assert(std::is_arithmetic<T>::value, "get<T> is for numeric tags");
+			if (!frozen_layout::inline_type(m_type) || frozen_layout::inline_size(m_type) != sizeof(T)
+				|| std::is_floating_point<T>::value != (m_type == 5 || m_type == 6))
+				throw exception("frozen value type mismatch");
+			T v;
+			memcpy(&v, &m_cell, sizeof(T));
+			return v;
+		}
+
+		//any integer tag widened, like base::get_long
+		inline std::int64_t get_long() const {
+			switch (m_type) {
+			case 1: return get<std::int8_t>();
+			case 2: return get<std::int16_t>();
+			case 3: return get<std::int32_t>();
+			case 4: return get<std::int64_t>();
+			default: throw exception("frozen value type mismatch");
+			}
+		}
+
+		inline std::string_view get_string() const {
+			expect(8);
+			const frozen_layout::block* b = block();
+			return std::string_view((const char*)(b + 1), b->count);
+		}
+
+		template<class T>
+		inline frozen_array<T> get_array() const {
+			expect(std::is_same<T, std::int8_t>::value ? 7 : std::is_same<T, std::int32_t>::value ? 11 : std::is_same<T, std::int64_t>::value ? 12 : -1);
+			const frozen_layout::block* b = block();
+			return frozen_array<T>{ (const T*)(b + 1), b->count };
+		}
+
+		inline frozen_compound get_compound() const;
+		inline frozen_list get_list() const;
+
+	protected:
+
+		inline void expect(std::int8_t type) const {
+			if (m_type != type)
+				throw exception("frozen value type mismatch");
+		}
+
+		inline const frozen_layout::block* block() const {
+			return (const frozen_layout::block*)(mp_base + m_cell);
+		}
+
+		const uint8* mp_base;
+		std::int8_t m_type;
+		std::uint64_t m_cell;
+	};
+
+	//mirrors tag_compound lookups, keys are sorted so find is a binary search
+	class frozen_compound {
+	public:
+
+		frozen_compound(const uint8* base, std::uint64_t offset) : mp_base(base), mp_block((const frozen_layout::block*)(base + offset)) {}
+
+		inline std::size_t size() const {
+			return mp_block->count;
+		}
+
+		inline std::string_view key(std::size_t i) const {
+			return string_at(entries()[i].key);
+		}
+
+		inline frozen_value value(std::size_t i) const {
+			const frozen_layout::entry& e = entries()[i];
+			return frozen_value(mp_base, e.type, e.value);
+		}
+
+		//invalid frozen_value when missing
+		frozen_value find(std::string_view name) const {
+			const frozen_layout::entry* first = entries();
+			const frozen_layout::entry* last = first + mp_block->count;
+			const frozen_layout::entry* it = std::lower_bound(first, last, name, [this](const frozen_layout::entry& e, std::string_view n) {
+				return string_at(e.key) < n;
+			});
+			if (it == last || string_at(it->key) != name)
+				return frozen_value();
+			return frozen_value(mp_base, it->type, it->value);
+		}
+
+		inline bool contains(std::string_view name) const {
+			return find(name).valid();
+		}
+
+		//throws when missing
+		frozen_value operator[](std::string_view name) const {
+			frozen_value v = find(name);
+			if (!v.valid())
+				throw exception("no such key in frozen compound");
+			return v;
+		}
+
+	private:
+
+		inline const frozen_layout::entry* entries() const {
+			return (const frozen_layout::entry*)(mp_block + 1);
+		}
+
+		inline std::string_view string_at(std::uint32_t offset) const {
+			const frozen_layout::block* b = (const frozen_layout::block*)(mp_base + offset);
+			return std::string_view((const char*)(b + 1), b->count);
+		}
+
+		const uint8* mp_base;
+		const frozen_layout::block* mp_block;
+	};
+
+	//mirrors tag_list. numeric lists are stored packed and can also be read as a whole with data<T>()
+	class frozen_list {
+	public:
+
+		frozen_list(const uint8* base, std::uint64_t offset) : mp_base(base), mp_block((const frozen_layout::block*)(base + offset)) {}
+
+		inline std::size_t size() const {
+			return mp_block->count;
+		}
+
+		inline std::int8_t get_tag_type() const {
+			return mp_block->type;
+		}
+
+		frozen_value operator[](std::size_t i) const {
+			if (i >= mp_block->count)
+				throw exception("frozen list index out of range");
+			std::int8_t type = mp_block->type;
+			std::uint64_t cell = 0;
+			if (frozen_layout::inline_type(type)) {
+				std::size_t width = frozen_layout::inline_size(type);
+				memcpy(&cell, (const uint8*)(mp_block + 1) + i * width, width);
+			}
+			else cell = ((const std::uint32_t*)(mp_block + 1))[i];
+			return frozen_value(mp_base, type, cell);
+		}
+
+		template<class T>
+		inline frozen_array<T> data() const {
+			if (!frozen_layout::inline_type(mp_block->type) || frozen_layout::inline_size(mp_block->type) != sizeof(T))
+				throw exception("frozen value type mismatch");
+			return frozen_array<T>{ (const T*)(mp_block + 1), mp_block->count };
+		}
+
+	private:
+		const uint8* mp_base;
+		const frozen_layout::block* mp_block;
+	};
+
+	inline frozen_compound frozen_value::get_compound() const {
+		expect(10);
+		return frozen_compound(mp_base, m_cell);
+	}
+
+	inline frozen_list frozen_value::get_list() const {
+		expect(9);
+		return frozen_list(mp_base, m_cell);
+	}
+
+	//a frozen image in memory the caller owns (a mapped file, shared memory, a loaded buffer).
+	//open checks the header, verify additionally checks every offset for images from untrusted places
+	class frozen_tree {
+	public:
+
+		frozen_tree() : mp_data(NULL), m_size(0) {}
+
+		void open(const void* data, std::size_t size) {
+			const frozen_layout::header* h = (const frozen_layout::header*)data;
+			if (((std::uintptr_t)data & 7) != 0)
+				throw exception("frozen image must be 8 byte aligned");
+			if (size < sizeof(frozen_layout::header) || memcmp(h->magic, frozen_layout::magic, 4) != 0)
+				throw exception("not a frozen nbt image");
+			if (h->version != frozen_layout::version)
+				throw exception("unsupported frozen nbt version");
+			if (h->endian != endian_native)
+				throw exception("frozen nbt image has the wrong byte order");
+			if (h->size > size)
+				throw exception("frozen nbt image truncated");
+			mp_data = (const uint8*)data;
+			m_size = (std::size_t)h->size;
+		}
+
+		inline frozen_value root() const {
+			const frozen_layout::header* h = (const frozen_layout::header*)mp_data;
+			return frozen_value(mp_data, h->root_type, h->root);
+		}
+
+		inline std::size_t size() const {
+			return m_size;
+		}
+
+		//true if every offset, count and string stays inside the image, children precede parents and no block
+		//but a string is reached twice. the time it takes is linear in the image size
+		bool verify() const {
+			const frozen_layout::header* h = (const frozen_layout::header*)mp_data;
+			if (h->root_type < 0 || h->root_type > 12)
+				return false;
+			std::uint64_t lower = sizeof(frozen_layout::header);
+			return verify_value(h->root_type, h->root, lower, m_size, 0);
+		}
+
+	private:
+
+		bool verify_block(std::uint64_t offset, std::uint64_t limit, std::uint64_t width, const frozen_layout::block*& b) const {
+			if (offset < sizeof(frozen_layout::header) || (offset & 7) || offset + sizeof(frozen_layout::block) > limit)
+				return false;
+			b = (const frozen_layout::block*)(mp_data + offset);
+			return block_end(offset, b, width) <= limit;
+		}
+
+		static inline std::uint64_t block_end(std::uint64_t offset, const frozen_layout::block* b, std::uint64_t width) {
+			return offset + sizeof(frozen_layout::block) + (std::uint64_t)b->count * width;
+		}
+
+		inline std::string_view string_at(std::uint64_t offset) const {
+			const frozen_layout::block* b = (const frozen_layout::block*)(mp_data + offset);
+			return std::string_view((const char*)(b + 1), b->count);
+		}
+
+		bool verify_string(std::uint64_t offset) const {
+			const frozen_layout::block* b;
+			if (!verify_block(offset, m_size, 1, b))
+				return false;
+			return offset + sizeof(frozen_layout::block) + b->count < m_size && mp_data[offset + sizeof(frozen_layout::block) + b->count] == 0;
+		}
+
+		//limit is the parents own offset and lower the end of the block written before, so the children of a
+		//container lie between its previous sibling and itself, as the writer puts them. every subtree then has
+		//a range of its own: a walk always ends and never visits a block twice, sharing siblings would make
+		//it exponential. strings are interned and may sit anywhere before their user. on success lower is
+		//moved past the value's block
+		bool verify_value(std::int8_t type, std::uint64_t cell, std::uint64_t& lower, std::uint64_t limit, int depth) const {
+			const frozen_layout::block* b;
+			std::uint64_t width;
+			switch (type) {
+			case 0: case 1: case 2: case 3: case 4: case 5: case 6:
+				return true;
+			case 8:
+				return cell < limit && verify_string(cell);
+			case 7: case 11: case 12:
+				width = type == 7 ? 1 : type == 11 ? 4 : 8;
+				if (cell < lower || !verify_block(cell, limit, width, b))
+					return false;
+				break;
+			case 9: {
+				if (depth > 0x200 || cell < lower || !verify_block(cell, limit, 1, b) || b->type < 0 || b->type > 12 || (b->type == 0 && b->count))
+					return false;
+				width = frozen_layout::inline_type(b->type) ? frozen_layout::inline_size(b->type) : 4;
+				if (!verify_block(cell, limit, width, b))
+					return false;
+				if (frozen_layout::inline_type(b->type))
+					break;
+				const std::uint32_t* items = (const std::uint32_t*)(b + 1);
+				std::uint64_t child = lower;
+				for (std::uint32_t i = 0; i < b->count; i++)
+					if (!verify_value(b->type, items[i], child, cell, depth + 1))
+						return false;
+				break;
+			}
+			case 10: {
+				width = sizeof(frozen_layout::entry);
+				if (depth > 0x200 || cell < lower || !verify_block(cell, limit, width, b))
+					return false;
+				const frozen_layout::entry* e = (const frozen_layout::entry*)(b + 1);
+				std::uint64_t child = lower;
+				for (std::uint32_t i = 0; i < b->count; i++) {
+					if (e[i].type <= 0 || e[i].type > 12 || !verify_string(e[i].key))
+						return false;
+					if (i && !(string_at(e[i - 1].key) < string_at(e[i].key)))//sorted and unique, find relies on it
+						return false;
+					if (!verify_value(e[i].type, e[i].value, child, cell, depth + 1))
+						return false;
+				}
+				break;
+			}
+			default:
+				return false;
+			}
+			lower = block_end(cell, b, width);
+			return true;
+		}
+
+		const uint8* mp_data;
+		std::size_t m_size;
+	};
+
+	//writes the frozen image of a tree. children go out before their parent, so every offset is known
+	//by the time it is written and nothing gets patched except the header
+	class frozen_writer {
+	public:
+
+		explicit frozen_writer(byteoutstream& output) : m_output(output), m_start(output.get_position()) {}
+
+		void write(base* root) {
+			frozen_layout::header h;
+			memset(&h, 0, sizeof(h));
+			m_output.write((const uint8*)&h, sizeof(h));
+			h.root = cell(root);
+			memcpy(h.magic, frozen_layout::magic, 4);
+			h.version = frozen_layout::version;
+			h.endian = endian_native;
+			h.root_type = root->get_id();
+			uint64 end = m_output.get_position();
+			h.size = end - m_start;
+			m_output.seek_beg(m_start);//through the stream, file streams have no buffer to patch
+			m_output.write((const uint8*)&h, sizeof(h));
+			m_output.seek_beg(end);
+		}
+
+	private:
+
+		inline std::uint64_t position() const {
+			return m_output.get_position() - m_start;
+		}
+
+		void align() {
+			static const uint8 zeros[8] = { 0 };
+			std::uint64_t pad = (8 - (position() & 7)) & 7;
+			if (pad)
+				m_output.write(zeros, (uint32)pad);
+		}
+
+		std::uint32_t begin_block(std::uint32_t count, std::int8_t type = 0) {
+			align();
+			std::uint64_t at = position();
+			if (at > 0xFFFFFFFFull)
+				throw exception("frozen nbt image over 4gb");
+			frozen_layout::block b;
+			memset(&b, 0, sizeof(b));
+			b.count = count;
+			b.type = type;
+			m_output.write((const uint8*)&b, sizeof(b));
+			return (std::uint32_t)at;
+		}
+
+		std::uint32_t string(const std::string& str) {
+			auto it = m_strings.find(str);
+			if (it != m_strings.end())
+				return it->second;
+			std::uint32_t at = begin_block((std::uint32_t)str.size());
+			m_output.write((const uint8*)str.data(), (uint32)str.size() + 1);//with the terminator
+			m_strings.emplace(str, at);
+			return at;
+		}
+
+		template<class T>
+		std::uint32_t array(const T* data, int size) {
+			std::uint32_t at = begin_block(data ? (std::uint32_t)size : 0);
+			if (data && size)
+				m_output.write((const uint8*)data, (uint32)(sizeof(T) * size));
+			return at;
+		}
+
+		//inline bits for numbers, for everything else the offset of what was just written
+		std::uint64_t cell(base* tag) {
+			std::uint64_t v = 0;
+			switch (tag->get_id()) {
+			case 1: memcpy(&v, &dynamic_cast<tag_byte*>(tag)->m_data, 1); return v;
+			case 2: memcpy(&v, &dynamic_cast<tag_short*>(tag)->m_data, 2); return v;
+			case 3: memcpy(&v, &dynamic_cast<tag_int*>(tag)->m_data, 4); return v;
+			case 4: memcpy(&v, &dynamic_cast<tag_long*>(tag)->m_data, 8); return v;
+			case 5: memcpy(&v, &dynamic_cast<tag_float*>(tag)->m_data, 4); return v;
+			case 6: memcpy(&v, &dynamic_cast<tag_double*>(tag)->m_data, 8); return v;
+			case 7: {
+				tag_bytearray* a = dynamic_cast<tag_bytearray*>(tag);
+				return array(a->mp_data, a->m_dataSize);
+			}
+			case 8:
+				return string(dynamic_cast<tag_string*>(tag)->m_data);
+			case 9:
+				return list(dynamic_cast<tag_list*>(tag));
+			case 10:
+				return compound(dynamic_cast<tag_compound*>(tag));
+			case 11: {
+				tag_intarray* a = dynamic_cast<tag_intarray*>(tag);
+				return array(a->mp_data, a->m_dataSize);
+			}
+			case 12: {
+				tag_longarray* a = dynamic_cast<tag_longarray*>(tag);
+				return array(a->mp_data, a->m_dataSize);
+			}
+			default:
+				return 0;
+			}
+		}
+
+		std::uint32_t list(tag_list* list) {
+			const std::vector<base*>& tags = list->get_tags();
+			std::int8_t type = tags.empty() ? 0 : list->get_tag_type();
+			std::vector<std::uint64_t> cells(tags.size());
+			for (std::size_t i = 0; i < tags.size(); i++)
+				cells[i] = cell(tags[i]);
+			std::uint32_t at = begin_block((std::uint32_t)tags.size(), type);
+			if (frozen_layout::inline_type(type)) {
+				std::size_t width = frozen_layout::inline_size(type);
+				for (std::uint64_t c : cells)
+					m_output.write((const uint8*)&c, (uint32)width);//the leading bytes of the cell, where get<T> reads them
+			}
+			else {
+				for (std::uint64_t c : cells) {
+					std::uint32_t offset = (std::uint32_t)c;
+					m_output.write((const uint8*)&offset, sizeof(offset));
+				}
+			}
+			return at;
+		}
+
+		//children are written in key order too, so equal trees give byte identical images
+		std::uint32_t compound(tag_compound* compound) {
+			std::vector<std::pair<const std::string*, base*>> sorted;
+			sorted.reserve(compound->m_tagMap.size());
+			for (auto it = compound->m_tagMap.begin(); it != compound->m_tagMap.end(); it++) {
+				if (it->second->get_id() != 0)//never written to nbt either
+					sorted.emplace_back(&it->first, it->second);
+			}
+			std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string*, base*>& a, const std::pair<const std::string*, base*>& b) {
+				return *a.first < *b.first;
+			});
+			std::vector<frozen_layout::entry> entries(sorted.size());//value initialised, padding included
+			for (std::size_t i = 0; i < sorted.size(); i++) {
+				entries[i].key = string(*sorted[i].first);
+				entries[i].type = sorted[i].second->get_id();
+				entries[i].value = cell(sorted[i].second);
+			}
+			std::uint32_t at = begin_block((std::uint32_t)entries.size());
+			if (!entries.empty())
+				m_output.write((const uint8*)entries.data(), (uint32)(entries.size() * sizeof(frozen_layout::entry)));
+			return at;
+		}
+
+		byteoutstream& m_output;
+		std::uint64_t m_start;
+		std::unordered_map<std::string, std::uint32_t> m_strings;
+	};
+
+	inline void write_frozen(byteoutstream& output, base* root) {
+		if (!root)
+			throw exception("null tag passed to write_frozen");
+		frozen_writer(output).write(root);
+	}
+
+	//back to regular tags, caller owns the result
+	inline base* thaw(const frozen_value& value) {
+		base* tag = base::create(value.get_id());
+		if (!tag)
+			throw exception("tag not created (invalid/out of mem)");
+		try {
+			switch (value.get_id()) {
+			case 1: dynamic_cast<tag_byte*>(tag)->m_data = value.get<std::int8_t>(); break;
+			case 2: dynamic_cast<tag_short*>(tag)->m_data = value.get<std::int16_t>(); break;
+			case 3: dynamic_cast<tag_int*>(tag)->m_data = value.get<std::int32_t>(); break;
+			case 4: dynamic_cast<tag_long*>(tag)->m_data = value.get<std::int64_t>(); break;
+			case 5: dynamic_cast<tag_float*>(tag)->m_data = value.get<float>(); break;
+			case 6: dynamic_cast<tag_double*>(tag)->m_data = value.get<double>(); break;
+			case 7: {
+				frozen_array<std::int8_t> a = value.get_array<std::int8_t>();
+				tag_bytearray* t = dynamic_cast<tag_bytearray*>(tag);
+				if (a.size) {
+					t->mp_data = new std::int8_t[a.size];
+					t->m_dataSize = (int)a.size;
+					memcpy(t->mp_data, a.data, a.size);
+				}
+				break;
+			}
+			case 8: {
+				std::string_view s = value.get_string();
+				dynamic_cast<tag_string*>(tag)->m_data.assign(s.data(), s.size());
+				break;
+			}
+			case 9: {
+				frozen_list l = value.get_list();
+				tag_list* t = dynamic_cast<tag_list*>(tag);
+				for (std::size_t i = 0; i < l.size(); i++)
+					t->append_tag(thaw(l[i]));
+				break;
+			}
+			case 10: {
+				frozen_compound c = value.get_compound();
+				tag_compound* t = dynamic_cast<tag_compound*>(tag);
+				t->m_tagMap.reserve(c.size());
+				for (std::size_t i = 0; i < c.size(); i++) {
+					base* child = thaw(c.value(i));
+					std::string_view key = c.key(i);
+					if (!t->m_tagMap.emplace(std::string(key.data(), key.size()), child).second)
+						delete child;
+				}
+				break;
+			}
+			case 11: {
+				frozen_array<std::int32_t> a = value.get_array<std::int32_t>();
+				tag_intarray* t = dynamic_cast<tag_intarray*>(tag);
+				if (a.size) {
+					t->mp_data = new std::int32_t[a.size];
+					t->m_dataSize = (int)a.size;
+					memcpy(t->mp_data, a.data, a.size * sizeof(std::int32_t));
+				}
+				break;
+			}
+			case 12: {
+				frozen_array<std::int64_t> a = value.get_array<std::int64_t>();
+				tag_longarray* t = dynamic_cast<tag_longarray*>(tag);
+				if (a.size) {
+					t->mp_data = new std::int64_t[a.size];
+					t->m_dataSize = (int)a.size;
+					memcpy(t->mp_data, a.data, a.size * sizeof(std::int64_t));
+				}
+				break;
+			}
+			}
+		}
+		catch (...) {
+			delete tag;
+			throw;
+		}
+		return tag;
+	}
+
+}
+
+#endif
@@ -0,0 +1,553 @@
+#ifndef _NBT_INDEX
+#define _NBT_INDEX
+
+#include "nbt.h"
+#include "nbt_cache.h"
+#include "nbt_io.h"
+#include "nbt_parallel.h"
+#include "nbt_visit.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <filesystem>
+
+#ifndef _NBT_NO_COMPRESS
+namespace nbt {
+
+	//what one world_index::update did
+	struct index_update {
+		std::size_t regions_read = 0;
+		std::size_t regions_skipped = 0;//same size and modification time as last time
+		std::size_t regions_removed = 0;
+		std::size_t regions_failed = 0;//could not be read, tried again next update
+		std::size_t chunks_indexed = 0;
+		std::size_t chunks_kept = 0;//timestamp unchanged in a region that was read
+		std::size_t chunks_failed = 0;//corrupt or unsupported compression, left out
+	};
+
+	namespace index_detail {
+
+		constexpr char magic[4] = { 'N', 'B', 'T', 'I' };
+		constexpr std::uint8_t version = 1;
+		constexpr std::size_t sector = 0x1000;
+
+		//index key: field number, then 'i' and the value as an int64 (any integer tag), or 's' and the string
+		inline std::string key(std::size_t field, char kind, const void* data, std::size_t size) {
+			std::string k;
+			k.reserve(3 + size);
+			k.push_back((char)(field & 0xFF));
+			k.push_back((char)(field >> 8));
+			k.push_back(kind);
+			k.append((const char*)data, size);
+			return k;
+		}
+
+		inline std::string key(std::size_t field, std::int64_t v) {
+			v = to_endian<endian_little>(v);//keys are saved
+			return key(field, 'i', &v, sizeof(v));
+		}
+
+		inline std::string key(std::size_t field, const std::string& v) {
+			return key(field, 's', v.data(), v.size());
+		}
+
+		//keys of the values path reaches below at, path_step::each going into every list element
+		inline void collect(const base* at, const field_path& path, std::size_t step, std::size_t field, std::vector<std::string>& out) {
+			if (step == path.size()) {
+				switch (at->get_id()) {
+				case 1: out.push_back(key(field, (std::int64_t)tag_cast<tag_byte>(at)->m_data)); break;
+				case 2: out.push_back(key(field, (std::int64_t)tag_cast<tag_short>(at)->m_data)); break;
+				case 3: out.push_back(key(field, (std::int64_t)tag_cast<tag_int>(at)->m_data)); break;
+				case 4: out.push_back(key(field, (std::int64_t)tag_cast<tag_long>(at)->m_data)); break;
+				case 8: out.push_back(key(field, static_cast<const tag_string*>(at)->m_data)); break;
+				}
+				return;
+			}
+			const path_step& s = path[step];
+			if (s.index == -1) {
+				if (at->get_id() != 10)
+					return;
+				const tag_compound* compound = static_cast<const tag_compound*>(at);
+				auto it = compound->m_tagMap.find(s.key);
+				if (it != compound->m_tagMap.end())
+					collect(it->second, path, step + 1, field, out);
+			}
+			else if (at->get_id() == 9) {
+				const std::vector<base*>& tags = static_cast<const tag_list*>(at)->get_tags();
+				if (s.index == path_step::each) {
+					for (const base* tag : tags)
+						collect(tag, path, step + 1, field, out);
+				}
+				else if (s.index >= 0 && (std::uint64_t)s.index < tags.size())
+					collect(tags[(std::size_t)s.index], path, step + 1, field, out);
+			}
+		}
+
+		inline std::uint32_t be32(const uint8* p) {
+			return (std::uint32_t)p[0] << 24 | (std::uint32_t)p[1] << 16 | (std::uint32_t)p[2] << 8 | p[3];
+		}
+
+		//region file name r.<x>.<z>.mca
+		inline bool region_name(const std::string& name, std::int32_t& x, std::int32_t& z) {
+			int n = 0;
+			if (sscanf(name.c_str(), "r.%d.%d.mca%n", &x, &z, &n) != 2)
+				return false;
+			return (std::size_t)n == name.size();
+		}
+
+		inline std::int64_t mtime(const std::filesystem::directory_entry& entry) {
+			std::error_code ec;
+			return (std::int64_t)entry.last_write_time(ec).time_since_epoch().count();
+		}
+
+	}
+
+	//inverted index from (field, value) to the chunks holding it, over the region files (.mca) of a world's
+	//directories (region, entities, DIM-1/region, ...). fields are paths from the chunk root, path_step::each
+	//going into every element of a list, e.g. { "block_entities", path_step::each, "id" }. integer and string
+	//values are indexed, other tags are passed over. update() only reads region files whose size or
+	//modification time changed, and only decodes the chunks in them whose timestamp changed
+	class world_index {
+	public:
+
+		world_index(std::vector<field_path> fields, std::vector<std::string> directories)
+			: m_fields(std::move(fields)), m_directories(std::move(directories)) {
+			if (m_fields.size() > 0xFFFF)
+				throw exception("too many indexed fields");
+			for (const field_path& path : m_fields)
+				if (path.empty())
+					throw exception("empty field path");
+		}
+
+		const std::vector<field_path>& fields() const {
+			return m_fields;
+		}
+
+		//chunk_key::region of the results is an index into these
+		const std::vector<std::string>& directories() const {
+			return m_directories;
+		}
+
+		//chunks where field (an index into fields()) has value, ordered by region then slot
+		std::vector<chunk_key> find(std::size_t field, std::int64_t value) const {
+			return lookup(index_detail::key(field, value));
+		}
+
+		std::vector<chunk_key> find(std::size_t field, const std::string& value) const {
+			return lookup(index_detail::key(field, value));
+		}
+
+		std::vector<chunk_key> find(std::size_t field, const char* value) const {
+			return lookup(index_detail::key(field, std::string(value)));
+		}
+
+		//brings the index up to date with the region files on disk, one task per changed file on pool
+		index_update update(task_pool& pool) {
+			index_update stats;
+			std::vector<job> jobs;
+			std::vector<bool> seen(m_regions.size());
+			for (std::uint32_t dir = 0; dir < m_directories.size(); dir++) {
+				std::error_code ec;
+				for (std::filesystem::directory_iterator it(m_directories[dir], ec), end; !ec && it != end; it.increment(ec)) {
+					std::int32_t x, z;
+					if (!it->is_regular_file(ec) || !index_detail::region_name(it->path().filename().string(), x, z))
+						continue;
+					std::uint32_t r = region_of(dir, x, z);
+					seen.resize(m_regions.size());
+					seen[r] = true;
+					std::int64_t mtime = index_detail::mtime(*it);
+					std::uint64_t size = it->file_size(ec);
+					if (m_regions[r].mtime == mtime && m_regions[r].size == size) {
+						stats.regions_skipped++;
+						continue;
+					}
+					jobs.emplace_back();
+					jobs.back().region = r;
+					jobs.back().path = it->path().string();
+					jobs.back().mtime = mtime;
+					jobs.back().size = size;
+				}
+			}
+
+			{
+				task_pool::group group(pool);
+				for (job& j : jobs)
+					group.run([this, &j] { scan(j); });
+				group.wait();
+			}
+
+			//chunks whose postings go: everything in regions that are gone, what changed in the ones read
+			std::vector<bool> stale(m_regions.size() * 1024);
+			bool any = false;
+			for (std::uint32_t r = 0; r < m_regions.size(); r++) {
+				if (!m_regions[r].used || seen[r])
+					continue;
+				for (std::size_t slot = 0; slot < 1024; slot++)
+					if (m_regions[r].indexed[slot])
+						stale[r * 1024 + slot] = any = true;
+				m_lookup.erase(chunk_key{ m_regions[r].dir, m_regions[r].x, m_regions[r].z });
+				m_regions[r] = region();
+				m_free.push_back(r);
+				stats.regions_removed++;
+			}
+			for (job& j : jobs) {
+				if (j.error) {
+					stats.regions_failed++;
+					continue;
+				}
+				region& reg = m_regions[j.region];
+				for (std::size_t slot = 0; slot < 1024; slot++)
+					if (reg.indexed[slot] && !j.kept[slot])
+						stale[j.region * 1024 + slot] = any = true;
+			}
+			if (any) {
+				for (auto it = m_postings.begin(); it != m_postings.end();) {
+					std::vector<std::uint32_t>& ids = it->second;
+					ids.erase(std::remove_if(ids.begin(), ids.end(), [&stale](std::uint32_t id) { return stale[id]; }), ids.end());
+					if (ids.empty())
+						it = m_postings.erase(it);
+					else it++;
+				}
+			}
+
+			std::vector<std::vector<std::uint32_t>*> touched;
+			for (job& j : jobs) {
+				if (j.error)
+					continue;
+				region& reg = m_regions[j.region];
+				reg.mtime = j.mtime;
+				reg.size = j.size;
+				reg.stamps = j.stamps;
+				reg.indexed = j.kept;
+				for (auto& chunk : j.chunks) {
+					reg.indexed[chunk.first] = true;
+					for (const std::string& k : chunk.second) {
+						std::vector<std::uint32_t>& ids = m_postings[k];
+						ids.push_back(j.region * 1024 + chunk.first);
+						touched.push_back(&ids);
+					}
+				}
+				stats.regions_read++;
+				stats.chunks_indexed += j.chunks.size();
+				stats.chunks_kept += j.kept.count();
+				stats.chunks_failed += j.failed;
+			}
+			std::sort(touched.begin(), touched.end());
+			touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+			for (std::vector<std::uint32_t>* ids : touched)
+				std::sort(ids->begin(), ids->end());
+			return stats;
+		}
+
+		//fields and directories, then per region its file state and chunk timestamps, then the keys in order,
+		//each with its chunks delta coded as varints. written to path.tmp and renamed over path
+		void save(const std::string& path) const {
+			byteoutstream out;
+			out.write((const uint8*)index_detail::magic, 4);
+			out.write_le<std::uint8_t>(index_detail::version);
+			write_config(out);
+			std::uint32_t used = 0;
+			for (const region& reg : m_regions)
+				used += reg.used;
+			out.write_varuint<std::uint32_t>(used);
+			std::vector<std::uint32_t> renumber(m_regions.size());
+			used = 0;
+			for (std::uint32_t r = 0; r < m_regions.size(); r++) {
+				const region& reg = m_regions[r];
+				if (!reg.used)
+					continue;
+				renumber[r] = used++;
+				out.write_varuint<std::uint32_t>(reg.dir);
+				out.write_le<std::int32_t>(reg.x);
+				out.write_le<std::int32_t>(reg.z);
+				out.write_le<std::int64_t>(reg.mtime);
+				out.write_le<std::uint64_t>(reg.size);
+				out.write_varuint<std::uint32_t>((std::uint32_t)reg.indexed.count());
+				for (std::uint32_t slot = 0; slot < 1024; slot++) {
+					if (!reg.indexed[slot])
+						continue;
+					out.write_le<std::uint16_t>((std::uint16_t)slot);
+					out.write_le<std::uint32_t>(reg.stamps[slot]);
+				}
+			}
+			std::vector<const std::pair<const std::string, std::vector<std::uint32_t>>*> keys;
+			keys.reserve(m_postings.size());
+			for (const auto& entry : m_postings)
+				keys.push_back(&entry);
+			std::sort(keys.begin(), keys.end(), [](auto* a, auto* b) { return a->first < b->first; });
+			out.write_varuint<std::uint64_t>(keys.size());
+			for (auto* entry : keys) {
+				out.write_varuint<std::uint32_t>((std::uint32_t)entry->first.size());
+				out.write((const uint8*)entry->first.data(), (uint32)entry->first.size());
+				out.write_varuint<std::uint32_t>((std::uint32_t)entry->second.size());
+				std::uint32_t last = 0;
+				for (std::uint32_t id : entry->second) {//removed regions leave gaps, still in order after renumbering
+					id = renumber[id / 1024] * 1024 + id % 1024;
+					out.write_varuint<std::uint32_t>(id - last);
+					last = id;
+				}
+			}
+			std::string tmp = path + ".tmp";
+			if (int err = io_detail::write_file(tmp.c_str(), out.get_buffer(), (std::size_t)out.get_position()))
+				throw exception(err == ENOSPC ? "no space left for the index" : "could not write the index");
+			std::error_code ec;
+			std::filesystem::rename(tmp, path, ec);
+			if (ec)
+				throw exception("could not replace the index");
+		}
+
+		//replaces the index with the one saved at path. false, leaving it empty, if there is no file or it was
+		//made for other fields or directories: update() then indexes everything. throws on a corrupt file
+		bool load(const std::string& path) {
+			clear();
+			uint8* data;
+			std::size_t size;
+			if (io_detail::read_file(path.c_str(), data, size))
+				return false;
+			bytestream input(data, size);//owns data
+			if (size < 5 || memcmp(data, index_detail::magic, 4) != 0 || data[4] != index_detail::version)
+				throw exception("not an nbt world index");
+			input.seek_beg(5);
+			try {
+				byteoutstream expected;
+				write_config(expected);
+				uint64 config = expected.get_position();
+				if (config > size - 5 || memcmp(data + 5, expected.get_buffer(), (std::size_t)config) != 0)
+					return false;
+				input.seek_cur(config);
+				std::uint32_t regions = input.read_varuint<std::uint32_t>();
+				if (regions > size / 26)//smallest entry
+					throw exception("corrupt nbt world index");
+				m_regions.resize(regions);
+				for (std::uint32_t r = 0; r < regions; r++) {
+					region& reg = m_regions[r];
+					reg.used = true;
+					reg.dir = input.read_varuint<std::uint32_t>();
+					reg.x = input.read_le<std::int32_t>();
+					reg.z = input.read_le<std::int32_t>();
+					reg.mtime = input.read_le<std::int64_t>();
+					reg.size = input.read_le<std::uint64_t>();
+					if (reg.dir >= m_directories.size() || !m_lookup.emplace(chunk_key{ reg.dir, reg.x, reg.z }, r).second)
+						throw exception("corrupt nbt world index");
+					std::uint32_t chunks = input.read_varuint<std::uint32_t>();
+					for (std::uint32_t i = 0; i < chunks; i++) {
+						std::uint16_t slot = input.read_le<std::uint16_t>();
+						if (slot >= 1024)
+							throw exception("corrupt nbt world index");
+						reg.indexed[slot] = true;
+						reg.stamps[slot] = input.read_le<std::uint32_t>();
+					}
+				}
+				std::uint64_t keys = input.read_varuint<std::uint64_t>();
+				m_postings.reserve((std::size_t)std::min<std::uint64_t>(keys, size));
+				std::uint64_t limit = (std::uint64_t)regions * 1024;
+				for (std::uint64_t i = 0; i < keys; i++) {
+					std::uint32_t length = input.read_varuint<std::uint32_t>();
+					if (length > input.get_stream_size() - input.get_position())
+						throw exception("corrupt nbt world index");
+					std::string k((const char*)data + input.get_position(), length);
+					input.seek_cur(length);
+					std::uint32_t count = input.read_varuint<std::uint32_t>();
+					if (count > input.get_stream_size() - input.get_position())
+						throw exception("corrupt nbt world index");
+					std::vector<std::uint32_t>& ids = m_postings[std::move(k)];
+					ids.resize(count);
+					std::uint64_t id = 0;
+					for (std::uint32_t n = 0; n < count; n++) {
+						id += input.read_varuint<std::uint32_t>();
+						if (id >= limit || (n && id == ids[n - 1]))
+							throw exception("corrupt nbt world index");
+						ids[n] = (std::uint32_t)id;
+					}
+				}
+			}
+			catch (const char* msg) {//short reads in the stream
+				clear();
+				throw exception(msg);
+			}
+			catch (...) {
+				clear();
+				throw;
+			}
+			return true;
+		}
+
+		void clear() {
+			m_regions.clear();
+			m_free.clear();
+			m_lookup.clear();
+			m_postings.clear();
+		}
+
+	private:
+
+		struct region {
+			bool used = false;
+			std::uint32_t dir = 0;
+			std::int32_t x = 0;
+			std::int32_t z = 0;
+			std::int64_t mtime = -1;
+			std::uint64_t size = 0;
+			std::array<std::uint32_t, 1024> stamps = {};
+			std::bitset<1024> indexed;
+		};
+
+		//one region file to read, filled in by a task
+		struct job {
+			std::uint32_t region;
+			std::string path;
+			std::int64_t mtime;
+			std::uint64_t size;
+			int error = 0;
+			std::array<std::uint32_t, 1024> stamps = {};
+			std::bitset<1024> kept;
+			std::vector<std::pair<std::uint16_t, std::vector<std::string>>> chunks;//slot, keys
+			std::size_t failed = 0;
+		};
+
+		std::uint32_t region_of(std::uint32_t dir, std::int32_t x, std::int32_t z) {
+			auto it = m_lookup.find(chunk_key{ dir, x, z });
+			if (it != m_lookup.end())
+				return it->second;
+			std::uint32_t r;
+			if (!m_free.empty()) {
+				r = m_free.back();
+				m_free.pop_back();
+			}
+			else {
+				r = (std::uint32_t)m_regions.size();
+				if (r >= std::numeric_limits<std::uint32_t>::max() / 1024)
+					throw exception("too many region files");
+				m_regions.emplace_back();
+			}
+			region& reg = m_regions[r];
+			reg.used = true;
+			reg.dir = dir;
+			reg.x = x;
+			reg.z = z;
+			m_lookup.emplace(chunk_key{ dir, x, z }, r);
+			return r;
+		}
+
+		//reads a region file. header: 1024 big endian (sector offset << 8 | sector count), then 1024 timestamps.
+		//a chunk is a big endian length, a compression byte (1 gzip, 2 zlib, 3 none, +128 when it is in a
+		//c.<x>.<z>.mca file next to the region) and the compressed nbt
+		void scan(job& j) const {
+			uint8* data;
+			std::size_t size;
+			if ((j.error = io_detail::read_file(j.path.c_str(), data, size)))
+				return;
+			bytestream file(data, size);//owns data
+			if (size < 2 * index_detail::sector) {
+				j.failed += size != 0;
+				return;
+			}
+			const region& old = m_regions[j.region];
+			tag_compound tree;//decoded over, so a region's chunks reuse each other's nodes
+			std::vector<std::string> keys;
+			for (std::uint16_t slot = 0; slot < 1024; slot++) {
+				std::uint32_t location = index_detail::be32(data + slot * 4);
+				if (!(location >> 8) || !(location & 0xFF))
+					continue;
+				std::uint32_t stamp = index_detail::be32(data + index_detail::sector + slot * 4);
+				j.stamps[slot] = stamp;
+				if (old.indexed[slot] && old.stamps[slot] == stamp) {
+					j.kept[slot] = true;
+					continue;
+				}
+				try {
+					read_chunk(j, data, size, (std::size_t)(location >> 8) * index_detail::sector, slot, tree);
+					keys.clear();
+					for (std::size_t f = 0; f < m_fields.size(); f++)
+						index_detail::collect(&tree, m_fields[f], 0, f, keys);
+					std::sort(keys.begin(), keys.end());
+					keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+					j.chunks.emplace_back(slot, keys);
+				}
+				catch (const exception&) {
+					j.failed++;
+				}
+				catch (const char*) {//short reads in the stream
+					j.failed++;
+				}
+			}
+		}
+
+		void read_chunk(const job& j, const uint8* data, std::size_t size, std::size_t at, std::uint16_t slot, tag_compound& tree) const {
+			if (at + 5 > size)
+				throw exception("chunk is past the end of the region file");
+			std::uint32_t length = index_detail::be32(data + at);
+			uint8 compression = data[at + 4];
+			if (!length || length - 1 > size - at - 5)
+				throw exception("chunk is past the end of the region file");
+			bytestream payload((uint8*)data + at + 5, length - 1);
+			payload.keep_buffer(true);
+			uint8* external = NULL;
+			std::size_t external_size = 0;
+			if (compression & 0x80) {
+				compression &= 0x7F;
+				const region& reg = m_regions[j.region];
+				std::filesystem::path mcc = std::filesystem::path(j.path).parent_path() / ("c." + std::to_string(reg.x * 32 + slot % 32) + "." + std::to_string(reg.z * 32 + slot / 32) + ".mcc");
+				if (io_detail::read_file(mcc.string().c_str(), external, external_size))
+					throw exception("missing external chunk file");
+			}
+			bytestream outside(external, external_size);//owns external
+			bytestream& compressed = external ? outside : payload;
+			if (compression == 3) {
+				reread_tag_compound(compressed, tree);
+				return;
+			}
+			if (compression != 1 && compression != 2)
+				throw exception("unsupported chunk compression");
+			uint64 inflated_size;
+			uint8* inflated = inflate_remaining(compressed, inflated_size);
+			bytestream input(inflated, inflated_size);
+			reread_tag_compound(input, tree);
+		}
+
+		std::vector<chunk_key> lookup(const std::string& k) const {
+			std::vector<chunk_key> found;
+			auto it = m_postings.find(k);
+			if (it == m_postings.end())
+				return found;
+			found.reserve(it->second.size());
+			for (std::uint32_t id : it->second) {
+				const region& reg = m_regions[id / 1024];
+				std::uint32_t slot = id % 1024;
+				found.push_back(chunk_key{ reg.dir, reg.x * 32 + (std::int32_t)(slot % 32), reg.z * 32 + (std::int32_t)(slot / 32) });
+			}
+			return found;
+		}
+
+		//what an index file must match to be loaded
+		void write_config(byteoutstream& out) const {
+			out.write_varuint<std::uint32_t>((std::uint32_t)m_fields.size());
+			for (const field_path& path : m_fields) {
+				out.write_varuint<std::uint32_t>((std::uint32_t)path.size());
+				for (const path_step& step : path) {
+					out.write_le<std::int64_t>(step.index);
+					if (step.index == -1) {
+						out.write_varuint<std::uint32_t>((std::uint32_t)step.key.size());
+						out.write((const uint8*)step.key.data(), (uint32)step.key.size());
+					}
+				}
+			}
+			out.write_varuint<std::uint32_t>((std::uint32_t)m_directories.size());
+			for (const std::string& dir : m_directories) {
+				out.write_varuint<std::uint32_t>((std::uint32_t)dir.size());
+				out.write((const uint8*)dir.data(), (uint32)dir.size());
+			}
+		}
+
+		std::vector<field_path> m_fields;
+		std::vector<std::string> m_directories;
+		std::vector<region> m_regions;//chunk ids are region * 1024 + slot (z % 32 * 32 + x % 32)
+		std::vector<std::uint32_t> m_free;//regions whose file went away
+		std::unordered_map<chunk_key, std::uint32_t, chunk_key_hash> m_lookup;//(directory, region x, region z)
+		std::unordered_map<std::string, std::vector<std::uint32_t>> m_postings;//key to sorted chunk ids
+	};
+
+}
+#endif
+
+#endif
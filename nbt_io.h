@@ -0,0 +1,644 @@
+#ifndef _NBT_IO
+#define _NBT_IO
+
+#include "nbt.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <cerrno>
+
+//io_uring is used on linux when the kernel allows it (5.6+, not blocked by seccomp), everything else gets the
+//thread pool. predefine '_NBT_NO_IO_URING' to always use the thread pool
+#if defined(__linux__) && !defined(_NBT_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define _NBT_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef IORING_FEAT_RW_CUR_POS//headers older than 5.6
+#undef _NBT_IO_URING
+#endif
+#endif
+#endif
+
+namespace nbt {
+
+	//one file of a batch. reads fill data (malloc'd, owned by whoever takes it, e.g. a bytestream) and size.
+	//writes take data and size from the caller and leave them alone. error is 0 or an errno value
+	struct file_buffer {
+		std::string path;
+		uint8* data;
+		std::size_t size;
+		int error;
+	};
+
+	namespace io_detail {
+
+		//whole file with stdio, what the thread pool backend does per file
+		inline int read_file(const char* path, uint8*& data, std::size_t& size) {
+			data = NULL;
+			size = 0;
+			FILE* f = NULL;
+			fopen_s(&f, path, "rb");
+			if (!f)
+				return errno ? errno : ENOENT;
+			int err = 0;
+			long len = -1;
+			if (fseek(f, 0, SEEK_END) == 0)
+				len = ftell(f);
+			if (len < 0 || fseek(f, 0, SEEK_SET) != 0)
+				err = EIO;
+			else if (len > 0) {
+				data = (uint8*)malloc((std::size_t)len);
+				if (!data)
+					err = ENOMEM;
+				else {
+					size = fread(data, 1, (std::size_t)len, f);
+					if (size != (std::size_t)len && ferror(f))
+						err = EIO;
+				}
+			}
+			fclose(f);
+			if (err) {
+				free(data);
+				data = NULL;
+				size = 0;
+			}
+			return err;
+		}
+
+		inline int write_file(const char* path, const uint8* data, std::size_t size) {
+			FILE* f = NULL;
+			fopen_s(&f, path, "wb");
+			if (!f)
+				return errno ? errno : EACCES;
+			int err = 0;
+			if (size && fwrite(data, 1, size, f) != size)
+				err = EIO;
+			if (fclose(f) != 0 && !err)
+				err = EIO;
+			return err;
+		}
+
+#ifdef _NBT_IO_URING
+		//the few io_uring calls needed here over the raw syscalls, so there is no liburing dependency
+		class uring {
+		public:
+
+			uring() : m_fd(-1), m_sq(MAP_FAILED), m_cq(MAP_FAILED), m_sqes((io_uring_sqe*)MAP_FAILED) {}
+
+			uring(const uring&) = delete;
+			uring& operator=(const uring&) = delete;
+
+			~uring() {
+				if (m_sqes != MAP_FAILED)
+					munmap(m_sqes, m_sqesSize);
+				if (m_cq != MAP_FAILED && m_cq != m_sq)
+					munmap(m_cq, m_cqSize);
+				if (m_sq != MAP_FAILED)
+					munmap(m_sq, m_sqSize);
+				if (m_fd >= 0)
+					close(m_fd);
+			}
+
+			//false if the kernel has no (usable) io_uring, the caller then falls back to the pool
+			bool open(unsigned entries) {
+				io_uring_params p;
+				memset(&p, 0, sizeof(p));
+				m_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+				if (m_fd < 0)
+					return false;
+				if (!(p.features & IORING_FEAT_RW_CUR_POS))//no openat/read/write ops before 5.6
+					return false;
+				m_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+				m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+				bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+				if (single)
+					m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+				m_sq = mmap(NULL, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+				if (m_sq == MAP_FAILED)
+					return false;
+				m_cq = single ? m_sq : mmap(NULL, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+				if (m_cq == MAP_FAILED)
+					return false;
+				m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+				m_sqes = (io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+				if (m_sqes == MAP_FAILED)
+					return false;
+				uint8* sq = (uint8*)m_sq;
+				uint8* cq = (uint8*)m_cq;
+				m_sqTail = (unsigned*)(sq + p.sq_off.tail);
+				m_sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+				m_sqArray = (unsigned*)(sq + p.sq_off.array);
+				m_cqHead = (unsigned*)(cq + p.cq_off.head);
+				m_cqTail = (unsigned*)(cq + p.cq_off.tail);
+				m_cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+				m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+				m_entries = p.sq_entries;
+				m_pending = 0;
+				m_unsent = 0;
+				return true;
+			}
+
+			unsigned entries() const {
+				return m_entries;
+			}
+
+			//the caller never has more than entries() requests queued, so the ring cannot be full
+			io_uring_sqe* next() {
+				unsigned tail = *m_sqTail + m_pending;
+				io_uring_sqe* sqe = &m_sqes[tail & m_sqMask];
+				memset(sqe, 0, sizeof(*sqe));
+				m_sqArray[tail & m_sqMask] = tail & m_sqMask;
+				m_pending++;
+				return sqe;
+			}
+
+			//hands queued requests to the kernel and waits for at least one completion. requests the kernel did
+			//not take (it returned an error or took only some) stay queued for the next call or unqueue. 0 or -errno
+			int submit_and_wait() {
+				if (m_pending) {
+					__atomic_store_n(m_sqTail, *m_sqTail + m_pending, __ATOMIC_RELEASE);
+					m_unsent += m_pending;
+					m_pending = 0;
+				}
+				for (;;) {
+					int res = (int)syscall(__NR_io_uring_enter, m_fd, m_unsent, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+					if (res >= 0) {
+						m_unsent -= (unsigned)res;
+						return 0;
+					}
+					if (errno != EINTR)
+						return -errno;
+				}
+			}
+
+			//waits for a completion without submitting anything. 0 or -errno
+			int wait() {
+				for (;;) {
+					if ((int)syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+						return 0;
+					if (errno != EINTR)
+						return -errno;
+				}
+			}
+
+			//takes back the requests the kernel has not taken yet, f gets the user data of each
+			template<class F>
+			void unqueue(F f) {
+				unsigned tail = *m_sqTail;
+				for (unsigned i = tail - m_unsent; i != tail; i++)
+					f(m_sqes[m_sqArray[i & m_sqMask]].user_data);
+				__atomic_store_n(m_sqTail, tail - m_unsent, __ATOMIC_RELEASE);
+				m_unsent = 0;
+			}
+
+			bool peek(std::uint64_t& user, std::int32_t& res) {
+				unsigned head = *m_cqHead;
+				if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+					return false;
+				const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+				user = cqe.user_data;
+				res = cqe.res;
+				__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+
+		private:
+			int m_fd;
+			void* m_sq;
+			void* m_cq;
+			io_uring_sqe* m_sqes;
+			std::size_t m_sqSize, m_cqSize, m_sqesSize;
+			unsigned* m_sqTail;
+			unsigned* m_sqArray;
+			unsigned m_sqMask;
+			unsigned* m_cqHead;
+			unsigned* m_cqTail;
+			unsigned m_cqMask;
+			io_uring_cqe* m_cqes;
+			unsigned m_entries;
+			unsigned m_pending;//written, tail not moved yet
+			unsigned m_unsent;//past the tail, not taken by the kernel yet
+		};
+#endif
+
+	}
+
+	//loads and saves batches of files with many requests in flight. the calling thread keeps the disk busy
+	//(io_uring, or a set of blocking reader threads), finished files go to a pool of worker threads that
+	//run the callback, typically decoding. read_files/write_files return once every callback has run
+	class file_io {
+	public:
+
+		//workers == 0 picks the hardware concurrency. depth is how many files are in flight at once
+		explicit file_io(unsigned workers = 0, unsigned depth = 64)
+			: m_depth(std::max(1u, depth)), m_stop(false), m_ring(false) {
+#ifdef _NBT_IO_URING
+			m_ring = m_uring.open(m_depth);
+			if (m_ring)
+				m_depth = std::min(m_depth, m_uring.entries());
+#endif
+			if (!workers)
+				workers = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned i = 0; i < workers; i++)
+				m_workers.emplace_back(&file_io::work, this);
+		}
+
+		file_io(const file_io&) = delete;
+		file_io& operator=(const file_io&) = delete;
+
+		~file_io() {
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& t : m_workers)
+				t.join();
+		}
+
+		bool uses_io_uring() const {
+			return m_ring;
+		}
+
+		//reads whole files, one batch at a time per file_io. on_read runs on a worker for every path, failed ones included (error set, data NULL),
+		//and owns the buffer. the first exception thrown by a callback is rethrown here once the batch is done
+		void read_files(const std::string* paths, std::size_t n, const std::function<void(file_buffer&)>& on_read) {
+			batch b(on_read);
+#ifdef _NBT_IO_URING
+			if (m_ring) {
+				try {
+					drive<false>(b, n, [paths](std::size_t i, file_buffer& f) { f.path = paths[i]; f.data = NULL; f.size = 0; f.error = 0; });
+				}
+				catch (...) {
+					settle(b);
+					throw;
+				}
+				finish(b);
+				return;
+			}
+#endif
+			pool_run(n, [&](std::size_t i) {
+				file_buffer f;
+				f.path = paths[i];
+				f.error = io_detail::read_file(f.path.c_str(), f.data, f.size);
+				post(b, f);
+			});
+			finish(b);
+		}
+
+		void read_files(const std::vector<std::string>& paths, const std::function<void(file_buffer&)>& on_read) {
+			read_files(paths.data(), paths.size(), on_read);
+		}
+
+		//writes (creates or truncates) files[i].path with its data. sets error and then runs on_written on a
+		//worker, where the buffer can be freed. files must stay alive until this returns
+		void write_files(file_buffer* files, std::size_t n, const std::function<void(file_buffer&)>& on_written) {
+			batch b(on_written);
+			b.files = files;
+#ifdef _NBT_IO_URING
+			if (m_ring) {
+				try {
+					drive<true>(b, n, [](std::size_t, file_buffer& f) { f.error = 0; });
+				}
+				catch (...) {
+					settle(b);
+					throw;
+				}
+				finish(b);
+				return;
+			}
+#endif
+			pool_run(n, [&](std::size_t i) {
+				file_buffer& f = files[i];
+				f.error = io_detail::write_file(f.path.c_str(), f.data, f.size);
+				post_index(b, i);
+			});
+			finish(b);
+		}
+
+		//runs fn(i) for i in [0, n) on the workers, e.g. to encode trees before a write_files
+		void for_each(std::size_t n, const std::function<void(std::size_t)>& fn) {
+			std::function<void(file_buffer&)> none;
+			batch b(none);
+			b.each = &fn;
+			for (std::size_t i = 0; i < n; i++)
+				post_index(b, i);
+			finish(b);
+		}
+
+	private:
+
+		//one read_files/write_files/for_each call
+		struct batch {
+			const std::function<void(file_buffer&)>& fn;
+			const std::function<void(std::size_t)>* each;
+			file_buffer* files;//writes complete in place
+			std::size_t outstanding;
+			std::exception_ptr error;
+			explicit batch(const std::function<void(file_buffer&)>& f) : fn(f), each(NULL), files(NULL), outstanding(0) {}
+		};
+
+		struct job {
+			batch* owner;
+			file_buffer file;
+		};
+
+		unsigned m_depth;
+		std::vector<std::thread> m_workers;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		std::deque<job> m_queue;
+		bool m_stop;
+		bool m_ring;
+#ifdef _NBT_IO_URING
+		io_detail::uring m_uring;
+#endif
+
+		void post(batch& b, file_buffer& f) {
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				b.outstanding++;
+				m_queue.push_back(job{ &b, std::move(f) });
+			}
+			m_wake.notify_one();
+		}
+
+		//writes and for_each only pass the index along, in size
+		void post_index(batch& b, std::size_t i) {
+			file_buffer f;
+			f.data = NULL;
+			f.size = i;
+			f.error = 0;
+			post(b, f);
+		}
+
+		//waits until every callback of b has run
+		void settle(batch& b) {
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_done.wait(lock, [&] { return b.outstanding == 0; });
+		}
+
+		void finish(batch& b) {
+			settle(b);
+			if (b.error)
+				std::rethrow_exception(b.error);
+		}
+
+		void work() {
+			for (;;) {
+				job j;
+				{
+					std::unique_lock<std::mutex> lock(m_lock);
+					m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+					if (m_queue.empty())
+						return;
+					j = std::move(m_queue.front());
+					m_queue.pop_front();
+				}
+				batch& b = *j.owner;
+				std::exception_ptr error;
+				try {
+					if (b.each)
+						(*b.each)(j.file.size);
+					else if (b.files)
+						b.fn(b.files[j.file.size]);
+					else b.fn(j.file);
+				}
+				catch (...) {
+					error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(m_lock);
+				if (error && !b.error)
+					b.error = error;
+				if (--b.outstanding == 0)
+					m_done.notify_all();
+			}
+		}
+
+		//thread pool backend: up to depth blocking i/o threads, each handing its files to the workers
+		void pool_run(std::size_t n, const std::function<void(std::size_t)>& io) {
+			std::atomic<std::size_t> next(0);
+			auto run = [&] {
+				std::size_t i;
+				while ((i = next.fetch_add(1, std::memory_order_relaxed)) < n)
+					io(i);
+			};
+			std::size_t threads = std::min<std::size_t>(std::min<std::size_t>(m_depth, 32), n);
+			std::vector<std::thread> readers;
+			for (std::size_t t = 1; t < threads; t++)
+				readers.emplace_back(run);
+			run();
+			for (std::thread& t : readers)
+				t.join();
+		}
+
+#ifdef _NBT_IO_URING
+		//per file state while it is in flight
+		struct slot {
+			file_buffer file;
+			std::size_t index;
+			int fd;
+			std::size_t done;//bytes read or written
+		};
+
+		//open, then read or write until done (short transfers are resubmitted), then close. at most depth
+		//files are in flight, each with one request queued, so the ring never overflows
+		template<bool Write, class Init>
+		void drive(batch& b, std::size_t n, Init init) {
+			std::vector<slot> slots(m_depth);
+			std::vector<unsigned> free_slots;
+			for (unsigned i = m_depth; i-- > 0;)
+				free_slots.push_back(i);
+			std::size_t next = 0;
+			unsigned inflight = 0;
+			auto transfer = [&](unsigned s) {
+				slot& sl = slots[s];
+				io_uring_sqe* sqe = m_uring.next();
+				std::size_t left = sl.file.size - sl.done;
+				sqe->opcode = Write ? IORING_OP_WRITE : IORING_OP_READ;
+				sqe->fd = sl.fd;
+				sqe->addr = (std::uint64_t)(sl.file.data + sl.done);
+				sqe->len = (std::uint32_t)std::min<std::size_t>(left, 1u << 30);
+				sqe->off = sl.done;
+				sqe->user_data = s;
+			};
+			auto complete = [&](unsigned s) {
+				slot& sl = slots[s];
+				if (sl.fd >= 0)
+					close(sl.fd);
+				if (sl.file.error && !Write) {
+					free(sl.file.data);
+					sl.file.data = NULL;
+					sl.file.size = 0;
+				}
+				if (Write) {
+					b.files[sl.index].error = sl.file.error;
+					post_index(b, sl.index);
+				}
+				else post(b, sl.file);
+				free_slots.push_back(s);
+				inflight--;
+			};
+			while (next < n || inflight) {
+				while (next < n && !free_slots.empty()) {
+					unsigned s = free_slots.back();
+					free_slots.pop_back();
+					slot& sl = slots[s];
+					sl.index = next;
+					sl.fd = -1;
+					sl.done = 0;
+					if (Write) {
+						sl.file.data = b.files[next].data;
+						sl.file.size = b.files[next].size;
+					}
+					init(next, sl.file);
+					io_uring_sqe* sqe = m_uring.next();
+					sqe->opcode = IORING_OP_OPENAT;
+					sqe->fd = AT_FDCWD;
+					sqe->addr = (std::uint64_t)(Write ? b.files[next].path.c_str() : sl.file.path.c_str());
+					sqe->open_flags = Write ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+					sqe->len = 0644;
+					sqe->user_data = s;
+					next++;
+					inflight++;
+				}
+				std::uint64_t user;
+				std::int32_t r;
+				int res = m_uring.submit_and_wait();
+				if (res == -EAGAIN || res == -EBUSY)//short of memory or completions to reap: reap, then go again
+					std::this_thread::yield();
+				else if (res < 0) {
+					//nothing queued reached the kernel, those files end here. the ones it has are waited out, so
+					//no fd, buffer or completion outlives the batch
+					m_uring.unqueue([&](std::uint64_t s) {
+						slots[s].file.error = -res;
+						complete((unsigned)s);
+					});
+					while (inflight && m_uring.wait() == 0) {
+						while (m_uring.peek(user, r)) {
+							slot& sl = slots[user];
+							if (sl.fd < 0 && r >= 0)
+								sl.fd = r;//opened, complete closes it
+							sl.file.error = -res;
+							complete((unsigned)user);
+						}
+					}
+					if (inflight)
+						m_ring = false;//cannot even wait on the ring. what is left in it is abandoned, later batches use the pool
+					throw exception("io_uring_enter failed");
+				}
+				while (m_uring.peek(user, r)) {
+					unsigned s = (unsigned)user;
+					slot& sl = slots[s];
+					if (r < 0) {
+						sl.file.error = -r;
+						complete(s);
+						continue;
+					}
+					if (sl.fd < 0) {//opened
+						sl.fd = r;
+						if (!Write) {
+							struct stat st;
+							if (fstat(sl.fd, &st) != 0) {
+								sl.file.error = errno;
+								complete(s);
+								continue;
+							}
+							sl.file.size = (std::size_t)st.st_size;
+							if (sl.file.size) {
+								sl.file.data = (uint8*)malloc(sl.file.size);
+								if (!sl.file.data) {
+									sl.file.error = ENOMEM;
+									complete(s);
+									continue;
+								}
+							}
+						}
+					}
+					else if (r == 0) {
+						if (Write) {//no progress, resubmitting would spin forever
+							sl.file.error = EIO;
+							complete(s);
+							continue;
+						}
+						sl.file.size = sl.done;//file got shorter since fstat
+					}
+					else sl.done += (std::size_t)r;
+					if (sl.done < sl.file.size)
+						transfer(s);
+					else complete(s);
+				}
+			}
+		}
+#endif
+	};
+
+	//reads and decodes many nbt files (gzip/zlib detected) with file_io. on_loaded runs on the worker threads
+	//and owns the tree, or gets NULL and the error (an errno string or the decoder's message)
+	inline void load_nbt_files(file_io& io, const std::vector<std::string>& paths, const std::function<void(const std::string&, base*, const char*)>& on_loaded,
+		format fmt = format::java, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max()) {
+		io.read_files(paths, [&](file_buffer& f) {
+			if (f.error) {
+				on_loaded(f.path, NULL, strerror(f.error));
+				return;
+			}
+			base* tag = NULL;
+			std::string error;
+			try {
+				if (!f.size)
+					throw exception("empty nbt file");
+				bytestream input(f.data, f.size);//takes the buffer
+				f.data = NULL;
+				size_tracker tracker(max_bytes);
+				tag = read_tag(input, tracker, fmt);
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+			catch (const char* msg) {//short reads in the streams
+				error = msg;
+			}
+			free(f.data);
+			on_loaded(f.path, tag, tag ? NULL : error.c_str());
+		});
+	}
+
+	//encodes trees on the workers and writes them with file_io, uncompressed. errors[i] gets 0 or an errno value
+	inline void save_nbt_files(file_io& io, const std::vector<std::string>& paths, base* const* tags, std::vector<int>& errors, format fmt = format::java) {
+		std::vector<file_buffer> files(paths.size());
+		io.for_each(paths.size(), [&](std::size_t i) {
+			byteoutstream out(0);
+			out.keep_buffer(true);
+			try {
+				write_tag(out, tags[i], fmt);
+			}
+			catch (...) {
+				free(out.get_buffer());
+				throw;
+			}
+			files[i].path = paths[i];
+			files[i].data = out.get_buffer();
+			files[i].size = (std::size_t)out.get_position();
+			files[i].error = 0;
+		});
+		io.write_files(files.data(), files.size(), [](file_buffer& f) {
+			free(f.data);
+			f.data = NULL;
+		});
+		errors.resize(files.size());
+		for (std::size_t i = 0; i < files.size(); i++)
+			errors[i] = files[i].error;
+	}
+
+}
+
+#endif
@@ -0,0 +1,486 @@
+#ifndef _NBT_JSON
+#define _NBT_JSON
+
+#include "nbt_stream.h"
+#include <charconv>
+#include <cmath>
+
+namespace nbt {
+
+	enum class json_arrays : std::uint8_t {
+		plain,//[1,2,3]
+		tagged,//{"type":"int[]","values":[1,2,3]}
+	};
+
+	enum class json_longs : std::uint8_t {
+		number,//always a json number, readers using doubles lose precision past 2^53
+		string,//always "123"
+		string_if_unsafe,//a string only when the value doesnt fit a double exactly
+	};
+
+	struct json_options {
+		format fmt = format::java;
+		json_arrays arrays = json_arrays::plain;
+		json_longs longs = json_longs::string_if_unsafe;
+		bool base64_bytes = false;//byte[] as a base64 string instead of numbers
+	};
+
+	//fixed size output buffer, flushed to a byteoutstream whenever it fills up
+	class json_writer {
+	public:
+
+		static constexpr std::size_t buffer_size = 0x10000;
+
+		explicit json_writer(byteoutstream& output) : m_output(output), m_len(0), m_written(0) {
+			m_buf = (char*)malloc(buffer_size);
+			if (!m_buf)
+				throw exception("out of memory");
+		}
+
+		json_writer(const json_writer&) = delete;
+		json_writer& operator=(const json_writer&) = delete;
+
+		~json_writer() {
+			free(m_buf);
+		}
+
+		inline void put(char c) {
+			if (m_len == buffer_size)
+				flush();
+			m_buf[m_len++] = c;
+		}
+
+		inline void put(const char* s, std::size_t n) {
+			while (n) {
+				if (m_len == buffer_size)
+					flush();
+				std::size_t take = std::min(n, buffer_size - m_len);
+				memcpy(m_buf + m_len, s, take);
+				m_len += take;
+				s += take;
+				n -= take;
+			}
+		}
+
+		//at least n contiguous bytes to format into, commit with advance()
+		inline char* reserve(std::size_t n) {
+			if (buffer_size - m_len < n)
+				flush();
+			return m_buf + m_len;
+		}
+
+		inline void advance(std::size_t n) {
+			m_len += n;
+		}
+
+		template<class T>
+		inline void put_integer(T v) {
+			char* p = reserve(24);
+			advance(std::to_chars(p, p + 24, v).ptr - p);
+		}
+
+		//shortest round trip form, nan and infinities have no json spelling and become null
+		template<class T>
+		inline void put_floating(T v) {
+			if (!std::isfinite(v)) {
+				put("null", 4);
+				return;
+			}
+			char* p = reserve(40);
+			advance(std::to_chars(p, p + 40, v).ptr - p);
+		}
+
+		//string body without the quotes. nbt strings are modified utf-8: standard sequences pass through, the
+		//two byte NUL (C0 80) and surrogates encoded one by one (ED A0-BF xx) become \u escapes, so a pair
+		//still decodes to its character, and any other invalid byte becomes \ufffd. the output is valid utf-8.
+		//with more set the string goes on past n: a sequence cut off at the end is left unwritten and the
+		//number of its bytes returned, for the caller to finish
+		inline std::size_t put_escaped(const uint8* p, std::size_t n, bool more = false) {
+			const uint8* end = p + n;
+			while (p != end) {
+				const uint8* run = p;
+				while (p != end) {
+					if (*p < 0x80) {
+						if (*p < 0x20 || *p == '"' || *p == '\\')
+							break;
+						p++;
+					}
+					else if (std::size_t len = utf8_length(p, end))
+						p += len;
+					else break;
+				}
+				put((const char*)run, p - run);
+				if (p == end)
+					break;
+				if (more && *p >= 0xC0 && (std::size_t)(end - p) < lead_length(*p))
+					return end - p;
+				uint8 c = *p++;
+				switch (c) {
+				case '"': put("\\\"", 2); break;
+				case '\\': put("\\\\", 2); break;
+				case '\n': put("\\n", 2); break;
+				case '\r': put("\\r", 2); break;
+				case '\t': put("\\t", 2); break;
+				case '\b': put("\\b", 2); break;
+				case '\f': put("\\f", 2); break;
+				default:
+					if (c < 0x80)
+						put_unit(c);
+					else if (c == 0xC0 && p != end && *p == 0x80) {
+						put_unit(0);
+						p++;
+					}
+					else if (c == 0xED && end - p >= 2 && p[0] >= 0xA0 && p[0] <= 0xBF && (p[1] & 0xC0) == 0x80) {
+						put_unit(0xD000 | (p[0] & 0x3F) << 6 | (p[1] & 0x3F));
+						p += 2;
+					}
+					else put_unit(0xFFFD);
+					break;
+				}
+			}
+			return 0;
+		}
+
+		//bytes in the sequence a lead byte (>= 0xC0) starts
+		static inline std::size_t lead_length(uint8 c) {
+			return c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+		}
+
+		//\uXXXX
+		inline void put_unit(unsigned u) {
+			static const char hex[] = "0123456789abcdef";
+			char esc[6] = { '\\', 'u', hex[u >> 12 & 0xF], hex[u >> 8 & 0xF], hex[u >> 4 & 0xF], hex[u & 0xF] };
+			put(esc, 6);
+		}
+
+		//length of the standard utf-8 sequence at p, 0 if it is not one (overlong, surrogate, cut off)
+		static inline std::size_t utf8_length(const uint8* p, const uint8* end) {
+			std::size_t left = end - p;
+			uint8 c = p[0];
+			if (c >= 0xC2 && c <= 0xDF)
+				return left >= 2 && (p[1] & 0xC0) == 0x80 ? 2 : 0;
+			if (c >= 0xE0 && c <= 0xEF) {
+				if (left < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+					return 0;
+				if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] >= 0xA0))
+					return 0;
+				return 3;
+			}
+			if (c >= 0xF0 && c <= 0xF4) {
+				if (left < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80)
+					return 0;
+				if ((c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] >= 0x90))
+					return 0;
+				return 4;
+			}
+			return 0;
+		}
+
+		void flush() {
+			if (m_len) {
+				m_output.write((const uint8*)m_buf, (uint32)m_len);
+				m_written += m_len;
+				m_len = 0;
+			}
+		}
+
+		uint64 get_written() const {
+			return m_written + m_len;
+		}
+
+	private:
+		byteoutstream& m_output;
+		char* m_buf;
+		std::size_t m_len;
+		uint64 m_written;
+	};
+
+	//transcodes binary nbt to json without building tags. memory is the reader and writer windows
+	//plus a fixed 513 entry container stack, so input size doesnt matter
+	template<format F>
+	class json_transcoder {
+	public:
+
+		json_transcoder(stream_reader& input, json_writer& output, const json_options& options) : m_in(input), m_out(output), m_options(options), m_depth(0) {}
+
+		void run() {
+			std::int8_t id = read_int<std::int8_t>();
+			if (id == 0) {
+				m_out.put("null", 4);
+				return;
+			}
+			m_in.skip(read_string_length());//root name
+			value(id);
+			while (m_depth) {
+				frame& top = m_stack[m_depth - 1];
+				if (top.type == 10) {
+					std::int8_t child = read_int<std::int8_t>();
+					if (child == 0) {
+						m_depth--;
+						m_out.put('}');
+						continue;
+					}
+					if (!top.first)
+						m_out.put(',');
+					top.first = false;
+					m_out.put('"');
+					string_body(read_string_length());
+					m_out.put("\":", 2);
+					value(child);
+				}
+				else {
+					if (top.remaining == 0) {
+						m_depth--;
+						m_out.put(']');
+						continue;
+					}
+					if (!top.first)
+						m_out.put(',');
+					top.first = false;
+					top.remaining--;
+					value(top.element);
+				}
+			}
+		}
+
+	private:
+
+		struct frame {
+			std::int8_t type;//9 or 10
+			std::int8_t element;//list element type
+			bool first;
+			std::uint32_t remaining;//list elements left
+		};
+
+		template<class T>
+		inline T read_int() {
+			if constexpr (F == format::bedrock_network && std::is_same<T, std::int32_t>::value)
+				return varint_codec::unzigzag(m_in.read_varuint<std::uint32_t>());
+			else if constexpr (F == format::bedrock_network && std::is_same<T, std::int64_t>::value)
+				return varint_codec::unzigzag(m_in.read_varuint<std::uint64_t>());
+			else
+				return m_in.read_fixed<F == format::java ? endian_big : endian_little, T>();
+		}
+
+		inline std::uint32_t read_string_length() {
+			if constexpr (F == format::bedrock_network)
+				return m_in.read_varuint<std::uint32_t>();
+			else
+				return (std::uint16_t)read_int<std::int16_t>();
+		}
+
+		inline std::uint32_t read_length() {
+			std::int32_t len = read_int<std::int32_t>();
+			if (len < 0)
+				throw exception("negative array length. corrupt tag?");
+			return (std::uint32_t)len;
+		}
+
+		inline void string_body(std::uint32_t len) {
+			std::size_t got;
+			while (len) {
+				const uint8* p = m_in.next(len, got);
+				len -= (std::uint32_t)got;
+				if (std::size_t cut = m_out.put_escaped(p, got, len != 0)) {//a sequence split by the window
+					uint8 seq[4];
+					memcpy(seq, p + got - cut, cut);
+					std::size_t rest = std::min<std::size_t>(json_writer::lead_length(seq[0]) - cut, len);
+					m_in.read(seq + cut, rest);
+					len -= (std::uint32_t)rest;
+					m_out.put_escaped(seq, cut + rest);
+				}
+			}
+		}
+
+		inline void put_long(std::int64_t v) {
+			const std::int64_t safe = 1ll << 53;
+			bool quote = m_options.longs == json_longs::string || (m_options.longs == json_longs::string_if_unsafe && (v > safe || v < -safe));
+			if (quote)
+				m_out.put('"');
+			m_out.put_integer(v);
+			if (quote)
+				m_out.put('"');
+		}
+
+		inline void array_head(const char* const type) {
+			if (m_options.arrays == json_arrays::tagged) {
+				m_out.put("{\"type\":\"", 9);
+				m_out.put(type, strlen(type));
+				m_out.put("\",\"values\":", 11);
+			}
+		}
+
+		inline void array_tail() {
+			if (m_options.arrays == json_arrays::tagged)
+				m_out.put('}');
+		}
+
+		void base64_body(std::uint32_t len) {
+			static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			uint8 carry[3];
+			int held = 0;
+			std::size_t got;
+			while (len) {
+				const uint8* p = m_in.next(len, got);
+				len -= (std::uint32_t)got;
+				for (std::size_t i = 0; i < got; i++) {
+					carry[held++] = p[i];
+					if (held == 3) {
+						char* o = m_out.reserve(4);
+						o[0] = table[carry[0] >> 2];
+						o[1] = table[((carry[0] & 3) << 4) | (carry[1] >> 4)];
+						o[2] = table[((carry[1] & 0xF) << 2) | (carry[2] >> 6)];
+						o[3] = table[carry[2] & 0x3F];
+						m_out.advance(4);
+						held = 0;
+					}
+				}
+			}
+			if (held) {
+				char o[4] = { table[carry[0] >> 2], '=', '=', '=' };
+				if (held == 1) {
+					o[1] = table[(carry[0] & 3) << 4];
+				}
+				else {
+					o[1] = table[((carry[0] & 3) << 4) | (carry[1] >> 4)];
+					o[2] = table[(carry[1] & 0xF) << 2];
+				}
+				m_out.put(o, 4);
+			}
+		}
+
+		void push(std::int8_t type, std::int8_t element, std::uint32_t remaining) {
+			if (m_depth > 0x200)
+				throw exception("Tried to read NBT with too high complexity, depth > 512");
+			frame& f = m_stack[m_depth++];
+			f.type = type;
+			f.element = element;
+			f.first = true;
+			f.remaining = remaining;
+		}
+
+		void value(std::int8_t id) {
+			switch (id) {
+			case 1:
+				m_out.put_integer(read_int<std::int8_t>());
+				break;
+			case 2:
+				m_out.put_integer(read_int<std::int16_t>());
+				break;
+			case 3:
+				m_out.put_integer(read_int<std::int32_t>());
+				break;
+			case 4:
+				put_long(read_int<std::int64_t>());
+				break;
+			case 5:
+				m_out.put_floating(read_int<float>());
+				break;
+			case 6:
+				m_out.put_floating(read_int<double>());
+				break;
+			case 7: {
+				std::uint32_t len = read_length();
+				array_head("byte[]");
+				if (m_options.base64_bytes) {
+					m_out.put('"');
+					base64_body(len);
+					m_out.put('"');
+				}
+				else {
+					m_out.put('[');
+					for (std::uint32_t i = 0; i < len; i++) {
+						if (i)
+							m_out.put(',');
+						m_out.put_integer(read_int<std::int8_t>());
+					}
+					m_out.put(']');
+				}
+				array_tail();
+				break;
+			}
+			case 8:
+				m_out.put('"');
+				string_body(read_string_length());
+				m_out.put('"');
+				break;
+			case 9: {
+				std::int8_t element = read_int<std::int8_t>();
+				std::uint32_t len = read_length();
+				if (element == 0 && len > 0)
+					throw exception("missing type on list tag");
+				m_out.put('[');
+				push(9, element, len);
+				break;
+			}
+			case 10:
+				m_out.put('{');
+				push(10, 0, 0);
+				break;
+			case 11: {
+				std::uint32_t len = read_length();
+				array_head("int[]");
+				m_out.put('[');
+				for (std::uint32_t i = 0; i < len; i++) {
+					if (i)
+						m_out.put(',');
+					m_out.put_integer(read_int<std::int32_t>());
+				}
+				m_out.put(']');
+				array_tail();
+				break;
+			}
+			case 12: {
+				std::uint32_t len = read_length();
+				array_head("long[]");
+				m_out.put('[');
+				for (std::uint32_t i = 0; i < len; i++) {
+					if (i)
+						m_out.put(',');
+					put_long(read_int<std::int64_t>());
+				}
+				m_out.put(']');
+				array_tail();
+				break;
+			}
+			default:
+				throw exception("error reading compound tag: tag id invalid. corrupt tag?");
+			}
+		}
+
+		stream_reader& m_in;
+		json_writer& m_out;
+		const json_options& m_options;
+		int m_depth;
+		frame m_stack[0x202];
+	};
+
+	//streams the nbt at the current position of input (gzip/zlib detected) into output as json.
+	//returns the number of json bytes written
+	inline uint64 nbt_to_json(bytestream& input, byteoutstream& output, const json_options& options = json_options()) {
+		stream_reader reader(input);
+		json_writer writer(output);
+		switch (options.fmt) {
+		case format::bedrock: {
+			json_transcoder<format::bedrock> t(reader, writer, options);
+			t.run();
+			break;
+		}
+		case format::bedrock_network: {
+			json_transcoder<format::bedrock_network> t(reader, writer, options);
+			t.run();
+			break;
+		}
+		default: {
+			json_transcoder<format::java> t(reader, writer, options);
+			t.run();
+			break;
+		}
+		}
+		writer.flush();
+		return writer.get_written();
+	}
+
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef _NBT_PALETTE
+#define _NBT_PALETTE
+
+#include "nbt.h"
+#include <utility>
+
+//predefine '_NBT_NO_SIMD' to force the scalar kernels
+#if !defined(_NBT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define _NBT_PALETTE_SSE2
+#endif
+
+namespace nbt {
+
+	//layout of palette indices bit packed into a long array (chunk section BlockStates, biomes)
+	enum class packing : std::uint8_t {
+		padded,//1.16+, entries never span two longs, the high bits of each long are unused
+		spanning,//before 1.16, entries are packed back to back across long boundaries
+	};
+
+	//bits per entry for a palette. block states use at least 4, biomes 1. a palette of one entry
+	//needs no bits at all, then the data array is left out
+	inline int bits_for_palette(std::size_t palette_size, int min_bits = 4) {
+		if (palette_size <= 1)
+			return 0;
+		int bits = 0;
+		while (((std::size_t)1 << bits) < palette_size)
+			bits++;
+		return bits < min_bits ? min_bits : bits;
+	}
+
+	//longs needed for count entries
+	inline std::size_t packed_size(int bits, packing p, std::size_t count = 4096) {
+		if (bits <= 0)
+			return 0;
+		if (p == packing::padded) {
+			std::size_t per = 64 / bits;
+			return (count + per - 1) / per;
+		}
+		return (count * bits + 63) / 64;
+	}
+
+	namespace palette_kernels {
+
+		typedef void (*unpack_fn)(const std::uint64_t*, std::uint16_t*, std::size_t);
+		typedef void (*pack_fn)(const std::uint16_t*, std::uint64_t*, std::size_t);
+
+		//bits is a template parameter and the per long / per group loops are expanded with index
+		//sequences, so every shift and mask is a constant and nothing is left to loop over
+		template<int B, int... J>
+		inline void unpack_long(std::uint64_t v, std::uint16_t* out, std::integer_sequence<int, J...>) {
+			((out[J] = (std::uint16_t)((v >> (J * B)) & ((1ull << B) - 1))), ...);
+		}
+
+		template<int B, int... J>
+		inline std::uint64_t pack_long(const std::uint16_t* in, std::integer_sequence<int, J...>) {
+			return ((((std::uint64_t)in[J] & ((1ull << B) - 1)) << (J * B)) | ...);
+		}
+
+		template<int B, int J>
+		inline void unpack_one(const std::uint64_t* data, std::uint16_t* out) {
+			constexpr int w = (J * B) >> 6, off = (J * B) & 63;
+			std::uint64_t v = data[w] >> off;
+			if constexpr (off + B > 64)
+				v |= data[w + 1] << (64 - off);
+			out[J] = (std::uint16_t)(v & ((1ull << B) - 1));
+		}
+
+		template<int B, int J>
+		inline void pack_one(const std::uint16_t* in, std::uint64_t* data) {
+			constexpr int w = (J * B) >> 6, off = (J * B) & 63;
+			std::uint64_t v = in[J] & ((1ull << B) - 1);
+			data[w] |= v << off;
+			if constexpr (off + B > 64)
+				data[w + 1] |= v >> (64 - off);
+		}
+
+		template<int B, int... J>
+		inline void unpack_group(const std::uint64_t* data, std::uint16_t* out, std::integer_sequence<int, J...>) {
+			(unpack_one<B, J>(data, out), ...);
+		}
+
+		template<int B, int... J>
+		inline void pack_group(const std::uint16_t* in, std::uint64_t* data, std::integer_sequence<int, J...>) {
+			(pack_one<B, J>(in, data), ...);
+		}
+
+		template<int B>
+		inline void unpack_padded(const std::uint64_t* data, std::uint16_t* out, std::size_t count) {
+			constexpr int per = 64 / B;
+			constexpr std::uint64_t mask = (1ull << B) - 1;
+			std::size_t full = count / per;
+			for (std::size_t i = 0; i < full; i++)
+				unpack_long<B>(data[i], out + i * per, std::make_integer_sequence<int, per>());
+			std::size_t rest = count - full * per;
+			for (std::size_t j = 0; j < rest; j++)
+				out[full * per + j] = (std::uint16_t)((data[full] >> (j * B)) & mask);
+		}
+
+		template<int B>
+		inline void pack_padded(const std::uint16_t* in, std::uint64_t* data, std::size_t count) {
+			constexpr int per = 64 / B;
+			constexpr std::uint64_t mask = (1ull << B) - 1;
+			std::size_t full = count / per;
+			for (std::size_t i = 0; i < full; i++)
+				data[i] = pack_long<B>(in + i * per, std::make_integer_sequence<int, per>());
+			std::size_t rest = count - full * per;
+			if (rest) {
+				std::uint64_t v = 0;
+				for (std::size_t j = 0; j < rest; j++)
+					v |= (in[full * per + j] & mask) << (j * B);
+				data[full] = v;
+			}
+		}
+
+		//64 entries take exactly B longs, so whole groups have a fixed bit pattern
+		template<int B>
+		inline void unpack_spanning(const std::uint64_t* data, std::uint16_t* out, std::size_t count) {
+			constexpr std::uint64_t mask = (1ull << B) - 1;
+			std::size_t i = 0;
+			for (; i + 64 <= count; i += 64, data += B)
+				unpack_group<B>(data, out + i, std::make_integer_sequence<int, 64>());
+			for (std::size_t j = 0; i < count; i++, j++) {
+				std::size_t bit = j * B, w = bit >> 6, off = bit & 63;
+				std::uint64_t v = data[w] >> off;
+				if (off + B > 64)
+					v |= data[w + 1] << (64 - off);
+				out[i] = (std::uint16_t)(v & mask);
+			}
+		}
+
+		template<int B>
+		inline void pack_spanning(const std::uint16_t* in, std::uint64_t* data, std::size_t count) {
+			constexpr std::uint64_t mask = (1ull << B) - 1;
+			memset(data, 0, ((count * B + 63) / 64) * sizeof(std::uint64_t));
+			std::size_t i = 0;
+			for (; i + 64 <= count; i += 64, data += B)
+				pack_group<B>(in + i, data, std::make_integer_sequence<int, 64>());
+			for (std::size_t j = 0; i < count; i++, j++) {
+				std::size_t bit = j * B, w = bit >> 6, off = bit & 63;
+				std::uint64_t v = in[i] & mask;
+				data[w] |= v << off;
+				if (off + B > 64)
+					data[w + 1] |= v >> (64 - off);
+			}
+		}
+
+#ifdef _NBT_PALETTE_SSE2
+		//4 and 8 bit entries are byte aligned in memory on little endian hosts (all sse2 ones are),
+		//so 16 bytes unpack with byte shuffles instead of shifts. the tail goes to the scalar kernel
+		inline void unpack_4(const std::uint64_t* data, std::uint16_t* out, std::size_t count) {
+			const __m128i low = _mm_set1_epi8(0x0F), zero = _mm_setzero_si128();
+			std::size_t vecs = count / 32;
+			for (std::size_t i = 0; i < vecs; i++) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + i * 2));
+				__m128i lo = _mm_and_si128(v, low);
+				__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+				__m128i a = _mm_unpacklo_epi8(lo, hi);
+				__m128i b = _mm_unpackhi_epi8(lo, hi);
+				__m128i* o = (__m128i*)(out + i * 32);
+				_mm_storeu_si128(o, _mm_unpacklo_epi8(a, zero));
+				_mm_storeu_si128(o + 1, _mm_unpackhi_epi8(a, zero));
+				_mm_storeu_si128(o + 2, _mm_unpacklo_epi8(b, zero));
+				_mm_storeu_si128(o + 3, _mm_unpackhi_epi8(b, zero));
+			}
+			unpack_padded<4>(data + vecs * 2, out + vecs * 32, count - vecs * 32);
+		}
+
+		inline void pack_4(const std::uint16_t* in, std::uint64_t* data, std::size_t count) {
+			const __m128i mask = _mm_set1_epi16(0x0F), high = _mm_set1_epi16(0xF0);
+			std::size_t vecs = count / 32;
+			for (std::size_t i = 0; i < vecs; i++) {
+				const __m128i* p = (const __m128i*)(in + i * 32);
+				//one byte per entry, then fold each pair of bytes into one
+				__m128i a = _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(p), mask), _mm_and_si128(_mm_loadu_si128(p + 1), mask));
+				__m128i b = _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(p + 2), mask), _mm_and_si128(_mm_loadu_si128(p + 3), mask));
+				a = _mm_or_si128(_mm_and_si128(a, mask), _mm_and_si128(_mm_srli_epi16(a, 4), high));
+				b = _mm_or_si128(_mm_and_si128(b, mask), _mm_and_si128(_mm_srli_epi16(b, 4), high));
+				_mm_storeu_si128((__m128i*)(data + i * 2), _mm_packus_epi16(a, b));
+			}
+			pack_padded<4>(in + vecs * 32, data + vecs * 2, count - vecs * 32);
+		}
+
+		inline void unpack_8(const std::uint64_t* data, std::uint16_t* out, std::size_t count) {
+			const __m128i zero = _mm_setzero_si128();
+			std::size_t vecs = count / 16;
+			for (std::size_t i = 0; i < vecs; i++) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + i * 2));
+				__m128i* o = (__m128i*)(out + i * 16);
+				_mm_storeu_si128(o, _mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128(o + 1, _mm_unpackhi_epi8(v, zero));
+			}
+			unpack_padded<8>(data + vecs * 2, out + vecs * 16, count - vecs * 16);
+		}
+
+		inline void pack_8(const std::uint16_t* in, std::uint64_t* data, std::size_t count) {
+			const __m128i mask = _mm_set1_epi16(0xFF);
+			std::size_t vecs = count / 16;
+			for (std::size_t i = 0; i < vecs; i++) {
+				const __m128i* p = (const __m128i*)(in + i * 16);
+				__m128i v = _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(p), mask), _mm_and_si128(_mm_loadu_si128(p + 1), mask));
+				_mm_storeu_si128((__m128i*)(data + i * 2), v);
+			}
+			pack_padded<8>(in + vecs * 16, data + vecs * 2, count - vecs * 16);
+		}
+#endif
+
+		//bits that divide 64 pack the same in both layouts, they all go through the padded kernels
+		inline unpack_fn unpacker(int bits, packing p) {
+			static const unpack_fn padded[17] = { NULL,
+				unpack_padded<1>, unpack_padded<2>, unpack_padded<3>,
+#ifdef _NBT_PALETTE_SSE2
+				unpack_4,
+#else
+				unpack_padded<4>,
+#endif
+				unpack_padded<5>, unpack_padded<6>, unpack_padded<7>,
+#ifdef _NBT_PALETTE_SSE2
+				unpack_8,
+#else
+				unpack_padded<8>,
+#endif
+				unpack_padded<9>, unpack_padded<10>, unpack_padded<11>, unpack_padded<12>,
+				unpack_padded<13>, unpack_padded<14>, unpack_padded<15>, unpack_padded<16> };
+			static const unpack_fn spanning[17] = { NULL,
+				padded[1], padded[2], unpack_spanning<3>, padded[4],
+				unpack_spanning<5>, unpack_spanning<6>, unpack_spanning<7>, padded[8],
+				unpack_spanning<9>, unpack_spanning<10>, unpack_spanning<11>, unpack_spanning<12>,
+				unpack_spanning<13>, unpack_spanning<14>, unpack_spanning<15>, padded[16] };
+			return p == packing::padded ? padded[bits] : spanning[bits];
+		}
+
+		inline pack_fn packer(int bits, packing p) {
+			static const pack_fn padded[17] = { NULL,
+				pack_padded<1>, pack_padded<2>, pack_padded<3>,
+#ifdef _NBT_PALETTE_SSE2
+				pack_4,
+#else
+				pack_padded<4>,
+#endif
+				pack_padded<5>, pack_padded<6>, pack_padded<7>,
+#ifdef _NBT_PALETTE_SSE2
+				pack_8,
+#else
+				pack_padded<8>,
+#endif
+				pack_padded<9>, pack_padded<10>, pack_padded<11>, pack_padded<12>,
+				pack_padded<13>, pack_padded<14>, pack_padded<15>, pack_padded<16> };
+			static const pack_fn spanning[17] = { NULL,
+				padded[1], padded[2], pack_spanning<3>, padded[4],
+				pack_spanning<5>, pack_spanning<6>, pack_spanning<7>, padded[8],
+				pack_spanning<9>, pack_spanning<10>, pack_spanning<11>, pack_spanning<12>,
+				pack_spanning<13>, pack_spanning<14>, pack_spanning<15>, padded[16] };
+			return p == packing::padded ? padded[bits] : spanning[bits];
+		}
+
+	}
+
+	//bits == 0 (single entry palette) yields all zeros. throws if data holds fewer longs than the layout needs
+	inline void unpack_indices(const std::int64_t* data, std::size_t longs, int bits, packing p, std::uint16_t* out, std::size_t count = 4096) {
+		if (bits < 0 || bits > 16)
+			throw exception("bits per entry out of range");
+		if (bits == 0) {
+			memset(out, 0, count * sizeof(std::uint16_t));
+			return;
+		}
+		if (longs < packed_size(bits, p, count))
+			throw exception("packed index array too short");
+		palette_kernels::unpacker(bits, p)((const std::uint64_t*)data, out, count);
+	}
+
+	//data must hold packed_size(bits, p, count) longs. indices are masked to bits
+	inline void pack_indices(const std::uint16_t* in, std::size_t count, int bits, packing p, std::int64_t* data) {
+		if (bits < 0 || bits > 16)
+			throw exception("bits per entry out of range");
+		if (bits == 0)
+			return;
+		palette_kernels::packer(bits, p)(in, (std::uint64_t*)data, count);
+	}
+
+	inline void unpack_indices(const tag_longarray& arr, int bits, packing p, std::uint16_t* out, std::size_t count = 4096) {
+		unpack_indices(arr.mp_data, arr.mp_data ? (std::size_t)arr.m_dataSize : 0, bits, p, out, count);
+	}
+
+	//replaces the array contents, reallocating only if the packed size changes
+	inline void pack_indices(tag_longarray& arr, const std::uint16_t* in, int bits, packing p, std::size_t count = 4096) {
+		std::size_t longs = packed_size(bits, p, count);
+		arr.unshare();
+		if ((std::size_t)arr.m_dataSize != longs || (longs && !arr.mp_data)) {
+			arr.clear_buffer();
+			if (longs) {
+				arr.mp_data = new std::int64_t[longs];
+				arr.m_dataSize = (int)longs;
+			}
+		}
+		pack_indices(in, count, bits, p, arr.mp_data);
+	}
+
+	//rewrites arr from old_bits to new_bits entries. remap, if given, maps every old index to its new one
+	//(for palettes that were reordered or shrunk) and has remap_size entries, the old palette length. an
+	//index past it (a corrupt chunk) throws and leaves arr as it was. returns false when nothing had to change
+	inline bool repack_indices(tag_longarray& arr, int old_bits, int new_bits, packing p, const std::uint16_t* remap = NULL, std::size_t remap_size = 0, std::size_t count = 4096) {
+		if (old_bits == new_bits && !remap)
+			return false;
+		std::uint16_t local[4096];
+		std::vector<std::uint16_t> heap;
+		std::uint16_t* indices = local;
+		if (count > 4096) {
+			heap.resize(count);
+			indices = heap.data();
+		}
+		unpack_indices(arr, old_bits, p, indices, count);
+		if (remap) {
+			for (std::size_t i = 0; i < count; i++) {
+				if (indices[i] >= remap_size)
+					throw exception("palette index out of range");
+				indices[i] = remap[indices[i]];
+			}
+		}
+		pack_indices(arr, indices, new_bits, p, count);
+		return true;
+	}
+
+	//call after the palette grew or shrank from old_palette to new_palette entries, repacks arr only if
+	//the bits per entry changed. returns the bits per entry arr now uses
+	inline int repack_for_palette(tag_longarray& arr, std::size_t old_palette, std::size_t new_palette, packing p, int min_bits = 4, std::size_t count = 4096) {
+		int old_bits = bits_for_palette(old_palette, min_bits);
+		int new_bits = bits_for_palette(new_palette, min_bits);
+		repack_indices(arr, old_bits, new_bits, p, NULL, 0, count);
+		return new_bits;
+	}
+
+	//drops palette entries no index refers to. rewrites indices in place and fills remap (palette_size
+	//entries) with the new position of every kept entry, 0xFFFF for dropped ones. returns the new palette size
+	inline std::size_t compact_palette(std::uint16_t* indices, std::size_t count, std::size_t palette_size, std::uint16_t* remap) {
+		for (std::size_t i = 0; i < palette_size; i++)
+			remap[i] = 0xFFFF;
+		for (std::size_t i = 0; i < count; i++) {
+			if (indices[i] < palette_size)
+				remap[indices[i]] = 0;
+		}
+		std::size_t used = 0;
+		for (std::size_t i = 0; i < palette_size; i++) {
+			if (remap[i] == 0)
+				remap[i] = (std::uint16_t)used++;
+		}
+		for (std::size_t i = 0; i < count; i++) {
+			if (indices[i] < palette_size)
+				indices[i] = remap[indices[i]];
+		}
+		return used;
+	}
+
+}
+
+#endif
@@ -0,0 +1,448 @@
+#ifndef _NBT_PARALLEL
+#define _NBT_PARALLEL
+
+#include "nbt.h"
+#include "nbt_visit.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace nbt {
+
+	//fork join pool. every thread has its own deque of tasks: it runs the newest of its own first and steals
+	//the oldest from the others when it runs dry. a thread waiting on a group runs queued tasks meanwhile, so
+	//groups nest without tying up threads
+	class task_pool {
+	public:
+
+		//threads counts the thread calling wait too: 0 picks the hardware concurrency, 1 runs everything there
+		explicit task_pool(unsigned threads = 0) : m_queued(0), m_stop(false) {
+			if (!threads)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			m_workerCount = threads - 1;
+			m_queues.reset(new queue[m_workerCount + 1]);//the last one is shared by threads outside the pool
+			for (unsigned i = 0; i < m_workerCount; i++)
+				m_workers.emplace_back(&task_pool::work, this, i);
+		}
+
+		task_pool(const task_pool&) = delete;
+		task_pool& operator=(const task_pool&) = delete;
+
+		~task_pool() {
+			{
+				std::lock_guard<std::mutex> lock(m_sleepLock);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& t : m_workers)
+				t.join();
+		}
+
+		unsigned size() const {
+			return m_workerCount + 1;
+		}
+
+		//tasks run on the pool, wait for all of them. a task that throws stops none of the others, wait rethrows
+		//the first exception once they are all done
+		class group {
+		public:
+
+			explicit group(task_pool& pool) : m_pool(pool), m_pending(0) {}
+
+			group(const group&) = delete;
+			group& operator=(const group&) = delete;
+
+			~group() {
+				try {
+					wait();
+				}
+				catch (...) {}
+			}
+
+			template<class Fn>
+			void run(Fn&& fn) {
+				m_pending.fetch_add(1, std::memory_order_relaxed);
+				m_pool.push(new task{ std::function<void()>(std::forward<Fn>(fn)), this });
+			}
+
+			void wait() {
+				while (m_pending.load(std::memory_order_acquire)) {
+					if (task* t = m_pool.take(m_pool.slot())) {
+						m_pool.execute(t);
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(m_pool.m_sleepLock);
+					m_pool.m_wake.wait(lock, [this] {
+						return !m_pending.load(std::memory_order_acquire) || m_pool.m_queued.load(std::memory_order_acquire);
+					});
+				}
+				if (m_error) {
+					std::exception_ptr error = m_error;
+					m_error = NULL;
+					std::rethrow_exception(error);
+				}
+			}
+
+		private:
+			friend class task_pool;
+
+			task_pool& m_pool;
+			std::atomic<std::size_t> m_pending;
+			std::mutex m_errorLock;
+			std::exception_ptr m_error;
+		};
+
+	private:
+
+		struct task {
+			std::function<void()> fn;
+			group* owner;
+		};
+
+		struct queue {
+			std::mutex lock;
+			std::deque<task*> tasks;
+		};
+
+		//index of the calling thread's queue
+		unsigned slot() {
+			if (current_pool() == this)
+				return current_slot();
+			return m_workerCount;
+		}
+
+		void push(task* t) {
+			queue& q = m_queues[slot()];
+			{
+				std::lock_guard<std::mutex> lock(q.lock);
+				q.tasks.push_back(t);
+			}
+			m_queued.fetch_add(1, std::memory_order_release);
+			{
+				std::lock_guard<std::mutex> lock(m_sleepLock);
+			}
+			m_wake.notify_one();
+		}
+
+		//own queue from the back, then the others from the front
+		task* take(unsigned index) {
+			unsigned n = m_workerCount + 1;
+			for (unsigned k = 0; k < n; k++) {
+				queue& q = m_queues[(index + k) % n];
+				std::lock_guard<std::mutex> lock(q.lock);
+				if (q.tasks.empty())
+					continue;
+				task* t;
+				if (!k) {
+					t = q.tasks.back();
+					q.tasks.pop_back();
+				}
+				else {
+					t = q.tasks.front();
+					q.tasks.pop_front();
+				}
+				m_queued.fetch_sub(1, std::memory_order_relaxed);
+				return t;
+			}
+			return NULL;
+		}
+
+		void execute(task* t) {
+			group* owner = t->owner;
+			try {
+				t->fn();
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(owner->m_errorLock);
+				if (!owner->m_error)
+					owner->m_error = std::current_exception();
+			}
+			delete t;
+			if (owner->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				std::lock_guard<std::mutex> lock(m_sleepLock);
+				m_wake.notify_all();
+			}
+		}
+
+		void work(unsigned index) {
+			current_pool() = this;
+			current_slot() = index;
+			for (;;) {
+				if (task* t = take(index)) {
+					execute(t);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(m_sleepLock);
+				m_wake.wait(lock, [this] { return m_stop || m_queued.load(std::memory_order_acquire); });
+				if (m_stop)
+					return;
+			}
+		}
+
+		static task_pool*& current_pool() {
+			thread_local task_pool* pool = NULL;
+			return pool;
+		}
+
+		static unsigned& current_slot() {
+			thread_local unsigned index = 0;
+			return index;
+		}
+
+		unsigned m_workerCount;
+		std::unique_ptr<queue[]> m_queues;
+		std::vector<std::thread> m_workers;
+		std::atomic<std::size_t> m_queued;
+		std::mutex m_sleepLock;
+		std::condition_variable m_wake;
+		bool m_stop;
+	};
+
+	//sizes are in tags, estimated from a container's children and their own child counts
+	struct parallel_options {
+		std::size_t cutoff = 0x2000;//containers estimated smaller than this are walked on the current task
+		std::size_t grain = 0x800;//roughly how much of a split container goes into one task
+	};
+
+	namespace parallel_detail {
+
+		inline std::size_t fanout(const base* tag) {
+			switch (tag->get_id()) {
+			case 9:
+				return static_cast<const tag_list*>(tag)->size();
+			case 10:
+				return static_cast<const tag_compound*>(tag)->m_tagMap.size();
+			default:
+				return 0;
+			}
+		}
+
+		//list elements share a type, the first one stands for the rest
+		inline std::size_t weight(const tag_list& list) {
+			return list.size() ? list.size() * (1 + fanout(list.get_tags()[0])) : 0;
+		}
+
+		//stops counting at limit, most compounds are far below it
+		inline std::size_t weight(const tag_compound& compound, std::size_t limit) {
+			std::size_t w = compound.m_tagMap.size();
+			for (auto it = compound.m_tagMap.begin(); it != compound.m_tagMap.end() && w < limit; it++)
+				w += fanout(it->second);
+			return w;
+		}
+
+		//calls fn(begin, end) over [0, n) in slices of about grain tags, each element weighing per
+		template<class Fn>
+		inline void split(task_pool& pool, std::size_t n, std::size_t per, const parallel_options& options, Fn fn) {
+			std::size_t step = std::max<std::size_t>(1, options.grain / std::max<std::size_t>(1, per));
+			task_pool::group g(pool);
+			for (std::size_t begin = 0; begin < n; begin += step) {
+				std::size_t end = std::min(n, begin + step);
+				g.run([&fn, begin, end] { fn(begin, end); });
+			}
+			g.wait();
+		}
+
+		template<class F>
+		struct walker {
+			task_pool& pool;
+			F& f;
+			const parallel_options& options;
+			std::atomic<bool> stopped;
+
+			void any(base* tag) {
+				visit(tag, [this](auto& t) { as(t); });
+			}
+
+			template<class T>
+			void as(T& tag) {
+				if (stopped.load(std::memory_order_relaxed))
+					return;
+				walk w = visit_detail::apply(f, tag);
+				if (w == walk::stop)
+					stopped.store(true, std::memory_order_relaxed);
+				if (w != walk::next)
+					return;
+				if constexpr (std::is_same<T, tag_compound>::value) {
+					if (weight(tag, options.cutoff) < options.cutoff) {
+						for (auto& entry : tag.m_tagMap)
+							any(entry.second);
+						return;
+					}
+					std::vector<base*> children;
+					children.reserve(tag.m_tagMap.size());
+					for (auto& entry : tag.m_tagMap)
+						children.push_back(entry.second);
+					std::size_t per = weight(tag, (std::size_t)-1) / children.size();
+					split(pool, children.size(), per, options, [this, &children](std::size_t begin, std::size_t end) {
+						for (std::size_t i = begin; i < end; i++)
+							any(children[i]);
+					});
+				}
+				else if constexpr (std::is_same<T, tag_list>::value)
+					list(tag, std::make_index_sequence<13>());
+			}
+
+			template<class E>
+			void elements(tag_list& list) {
+				if constexpr (std::is_invocable<F&, E&>::value || visit_detail::is_container<E>) {
+					const std::vector<base*>& tags = list.get_tags();
+					if (weight(list) < options.cutoff) {
+						for (base* tag : tags)
+							as(*tag_cast<E>(tag));
+						return;
+					}
+					split(pool, tags.size(), 1 + fanout(tags[0]), options, [this, &tags](std::size_t begin, std::size_t end) {
+						for (std::size_t i = begin; i < end; i++)
+							as(*tag_cast<E>(tags[i]));
+					});
+				}
+			}
+
+			template<std::size_t... I>
+			void list(tag_list& list, std::index_sequence<I...>) {
+				static constexpr void(walker::* const table[])(tag_list&) = { &walker::elements<typename tag_type<(std::int8_t)I>::type>... };
+				if (list.size())
+					(this->*table[(std::uint8_t)list.get_tag_type()])(list);
+			}
+		};
+
+		template<class F>
+		struct transformer {
+			task_pool& pool;
+			F& f;
+			const parallel_options& options;
+			std::atomic<bool> failed;
+
+			base* any(base* tag) {
+				return visit(tag, [this](auto& t) { return as(t); });
+			}
+
+			//replaces the value of entry with what its subtree turns into
+			void entry(std::pair<const std::string, base*>& entry) {
+				base* r = any(entry.second);
+				if (r && r != entry.second) {
+					delete entry.second;
+					entry.second = r;
+				}
+			}
+
+			template<class T>
+			void children(T& tag) {
+				if constexpr (std::is_same<T, tag_compound>::value) {
+					if (weight(tag, options.cutoff) < options.cutoff) {
+						for (auto& e : tag.m_tagMap)
+							entry(e);
+						return;
+					}
+					std::vector<std::pair<const std::string, base*>*> entries;
+					entries.reserve(tag.m_tagMap.size());
+					for (auto& e : tag.m_tagMap)
+						entries.push_back(&e);
+					std::size_t per = weight(tag, (std::size_t)-1) / entries.size();
+					split(pool, entries.size(), per, options, [this, &entries](std::size_t begin, std::size_t end) {
+						try {
+							for (std::size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); i++)
+								entry(*entries[i]);
+						}
+						catch (...) {
+							failed.store(true, std::memory_order_relaxed);
+							throw;
+						}
+					});
+				}
+				else if constexpr (std::is_same<T, tag_list>::value)
+					list(tag, std::make_index_sequence<13>());
+			}
+
+			template<class T>
+			base* as(T& tag) {
+				children(tag);
+				if constexpr (std::is_invocable<F&, T&>::value)
+					return f(tag);
+				else return NULL;
+			}
+
+			//every slice fills its own part of out, the list itself only changes once all are done
+			template<class E>
+			void elements(tag_list& list) {
+				if constexpr (std::is_invocable<F&, E&>::value || visit_detail::is_container<E>) {
+					const std::vector<base*>& tags = list.get_tags();
+					std::vector<base*> out;
+					try {
+						if (weight(list) < options.cutoff) {
+							for (std::size_t i = 0; i < tags.size(); i++) {
+								base* r = as(*tag_cast<E>(tags[i]));
+								if (r && r != tags[i]) {
+									out.resize(tags.size());
+									out[i] = r;
+								}
+							}
+						}
+						else {
+							out.resize(tags.size());
+							split(pool, tags.size(), 1 + fanout(tags[0]), options, [this, &tags, &out](std::size_t begin, std::size_t end) {
+								try {
+									for (std::size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); i++) {
+										base* r = as(*tag_cast<E>(tags[i]));
+										if (r != tags[i])
+											out[i] = r;
+									}
+								}
+								catch (...) {
+									failed.store(true, std::memory_order_relaxed);
+									throw;
+								}
+							});
+						}
+					}
+					catch (...) {
+						for (base* r : out)
+							delete r;
+						throw;
+					}
+					for (base* r : out) {
+						if (r) {
+							visit_detail::replace_elements(list, out);
+							return;
+						}
+					}
+				}
+			}
+
+			template<std::size_t... I>
+			void list(tag_list& list, std::index_sequence<I...>) {
+				static constexpr void(transformer::* const table[])(tag_list&) = { &transformer::elements<typename tag_type<(std::int8_t)I>::type>... };
+				if (list.size())
+					(this->*table[(std::uint8_t)list.get_tag_type()])(list);
+			}
+		};
+
+	}
+
+	//for_each (nbt_visit.h) with big lists and compounds split over the pool. f is called from several threads
+	//at once, each tag exactly once, and must only touch the tag it is given. walk::skip works as before,
+	//walk::stop ends the walk as soon as every thread notices, which tags were visited by then is not fixed.
+	//false if f stopped the walk
+	template<class F>
+	inline bool parallel_for_each(task_pool& pool, base* tag, F&& f, const parallel_options& options = parallel_options()) {
+		parallel_detail::walker<F> walker{ pool, f, options, {false} };
+		walker.any(tag);
+		return !walker.stopped.load();
+	}
+
+	//transform (nbt_visit.h) with big lists and compounds split over the pool, same rules for f as
+	//parallel_for_each. the result does not depend on how the work was split: compound values are replaced
+	//in place by whichever thread handles them, list replacements are collected per slot and put in once the
+	//whole list is done. if f throws, the first exception is rethrown after the running tasks finish
+	template<class F>
+	inline void parallel_transform(task_pool& pool, base* root, F&& f, const parallel_options& options = parallel_options()) {
+		parallel_detail::transformer<F> transformer{ pool, f, options, {false} };
+		visit(root, [&transformer](auto& t) { transformer.children(t); });
+	}
+
+}
+
+#endif
@@ -0,0 +1,720 @@
+#ifndef _NBT_PERSISTENT
+#define _NBT_PERSISTENT
+
+#include "nbt.h"
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+
+namespace nbt {
+
+	//immutable trees. every update returns a new version that shares all untouched nodes with the old
+	//one, compounds and lists are balanced trees so an update copies O(log n) nodes per level.
+	//versions are never modified after construction, any number of threads can read them concurrently
+
+	class pvalue;
+	class pcompound;
+	class plist;
+
+	namespace persistent_detail {
+
+		struct node;
+		typedef std::shared_ptr<const node> node_ptr;
+
+	}
+
+	class pvalue {
+	public:
+
+		pvalue() : m_type(0), m_bits(0) {}
+
+		template<class T>
+		static constexpr std::int8_t number_id() {
+			return std::is_same<T, std::int8_t>::value ? 1 : std::is_same<T, std::int16_t>::value ? 2
+				: std::is_same<T, std::int32_t>::value ? 3 : std::is_same<T, std::int64_t>::value ? 4
+				: std::is_same<T, float>::value ? 5 : std::is_same<T, double>::value ? 6 : -1;
+		}
+
+		template<class T>
+		static constexpr std::int8_t array_id() {
+			return std::is_same<T, std::int8_t>::value ? 7 : std::is_same<T, std::int32_t>::value ? 11
+				: std::is_same<T, std::int64_t>::value ? 12 : -1;
+		}
+
+		template<class T>
+		static pvalue number(T v) {
+			static_assert(number_id<T>() > 0, "not an nbt number type");
+			pvalue p;
+			p.m_type = number_id<T>();
+			memcpy(&p.m_bits, &v, sizeof(T));
+			return p;
+		}
+
+		static pvalue string(std::string s) {
+			pvalue p;
+			p.m_type = 8;
+			p.m_payload = std::make_shared<const std::string>(std::move(s));
+			return p;
+		}
+
+		template<class T>
+		static pvalue array(std::vector<T> v) {
+			static_assert(array_id<T>() > 0, "not an nbt array type");
+			pvalue p;
+			p.m_type = array_id<T>();
+			p.m_payload = std::make_shared<const std::vector<T>>(std::move(v));
+			return p;
+		}
+
+		inline pvalue(const pcompound& c);
+		inline pvalue(const plist& l);
+
+		inline std::int8_t get_id() const {
+			return m_type;
+		}
+
+		template<class T>
+		inline T get() const {
+			static_assert(number_id<T>() > 0, "not an nbt number type");
+			if (m_type != number_id<T>())
+				throw exception("persistent value type mismatch");
+			T v;
+			memcpy(&v, &m_bits, sizeof(T));
+			return v;
+		}
+
+		inline const std::string& get_string() const {
+			expect(8);
+			return *std::static_pointer_cast<const std::string>(m_payload);
+		}
+
+		template<class T>
+		inline const std::vector<T>& get_array() const {
+			static_assert(array_id<T>() > 0, "not an nbt array type");
+			expect(array_id<T>());
+			return *std::static_pointer_cast<const std::vector<T>>(m_payload);
+		}
+
+		inline pcompound get_compound() const;
+		inline plist get_list() const;
+
+		//copies a mutable tree in. arrays and strings are copied once and shared from then on
+		static pvalue from_tag(const base* tag);
+
+		//a new mutable tree, caller owns it
+		base* to_tag() const;
+
+		template<class C>
+		void write_as(byteoutstream& output) const;
+
+	private:
+
+		inline void expect(std::int8_t type) const {
+			if (m_type != type)
+				throw exception("persistent value type mismatch");
+		}
+
+		friend class pcompound;
+		friend class plist;
+
+		std::int8_t m_type;
+		std::uint64_t m_bits;//numbers, the element type for lists
+		std::shared_ptr<const void> m_payload;//string, array vector or the root node of a compound/list
+	};
+
+	namespace persistent_detail {
+
+		//avl node, used by key for compounds and by position for lists
+		struct node {
+			node_ptr left;
+			node_ptr right;
+			std::string key;
+			pvalue value;
+			std::uint32_t count;//nodes in this subtree
+			std::int8_t height;
+		};
+
+		inline int height(const node_ptr& n) {
+			return n ? n->height : 0;
+		}
+
+		inline std::uint32_t count(const node_ptr& n) {
+			return n ? n->count : 0;
+		}
+
+		inline node_ptr make(const node_ptr& l, const std::string& key, const pvalue& v, const node_ptr& r) {
+			std::shared_ptr<node> n = std::make_shared<node>();
+			n->left = l;
+			n->right = r;
+			n->key = key;
+			n->value = v;
+			n->count = count(l) + count(r) + 1;
+			n->height = (std::int8_t)(std::max(height(l), height(r)) + 1);
+			return n;
+		}
+
+		//rebuilds one node, rotating if the sides differ by more than one level
+		inline node_ptr balance(const node_ptr& l, const std::string& key, const pvalue& v, const node_ptr& r) {
+			int hl = height(l), hr = height(r);
+			if (hl > hr + 1) {
+				if (height(l->left) >= height(l->right))
+					return make(l->left, l->key, l->value, make(l->right, key, v, r));
+				const node_ptr& lr = l->right;
+				return make(make(l->left, l->key, l->value, lr->left), lr->key, lr->value, make(lr->right, key, v, r));
+			}
+			if (hr > hl + 1) {
+				if (height(r->right) >= height(r->left))
+					return make(make(l, key, v, r->left), r->key, r->value, r->right);
+				const node_ptr& rl = r->left;
+				return make(make(l, key, v, rl->left), rl->key, rl->value, make(rl->right, r->key, r->value, r->right));
+			}
+			return make(l, key, v, r);
+		}
+
+		inline node_ptr erase_min(const node_ptr& n, const node*& min) {
+			if (!n->left) {
+				min = n.get();
+				return n->right;
+			}
+			return balance(erase_min(n->left, min), n->key, n->value, n->right);
+		}
+
+		//joins the two sides of a removed node
+		inline node_ptr join(const node_ptr& l, const node_ptr& r) {
+			if (!l)
+				return r;
+			if (!r)
+				return l;
+			const node* min;
+			node_ptr rest = erase_min(r, min);
+			return balance(l, min->key, min->value, rest);
+		}
+
+		inline node_ptr insert_key(const node_ptr& n, const std::string& key, const pvalue& v) {
+			if (!n)
+				return make(node_ptr(), key, v, node_ptr());
+			int c = key.compare(n->key);
+			if (c < 0)
+				return balance(insert_key(n->left, key, v), n->key, n->value, n->right);
+			if (c > 0)
+				return balance(n->left, n->key, n->value, insert_key(n->right, key, v));
+			return make(n->left, key, v, n->right);
+		}
+
+		inline node_ptr erase_key(const node_ptr& n, const std::string& key, bool& found) {
+			if (!n)
+				return n;
+			int c = key.compare(n->key);
+			if (c < 0) {
+				node_ptr l = erase_key(n->left, key, found);
+				return found ? balance(l, n->key, n->value, n->right) : n;
+			}
+			if (c > 0) {
+				node_ptr r = erase_key(n->right, key, found);
+				return found ? balance(n->left, n->key, n->value, r) : n;
+			}
+			found = true;
+			return join(n->left, n->right);
+		}
+
+		inline const node* find_key(const node* n, const std::string& key) {
+			while (n) {
+				int c = key.compare(n->key);
+				if (c == 0)
+					return n;
+				n = (c < 0 ? n->left : n->right).get();
+			}
+			return NULL;
+		}
+
+		inline const node* at(const node* n, std::uint32_t i) {
+			while (n) {
+				std::uint32_t l = count(n->left);
+				if (i == l)
+					return n;
+				if (i < l)
+					n = n->left.get();
+				else {
+					i -= l + 1;
+					n = n->right.get();
+				}
+			}
+			return NULL;
+		}
+
+		inline node_ptr set_at(const node_ptr& n, std::uint32_t i, const pvalue& v) {
+			std::uint32_t l = count(n->left);
+			if (i < l)
+				return make(set_at(n->left, i, v), n->key, n->value, n->right);
+			if (i > l)
+				return make(n->left, n->key, n->value, set_at(n->right, i - l - 1, v));
+			return make(n->left, n->key, v, n->right);
+		}
+
+		inline node_ptr insert_at(const node_ptr& n, std::uint32_t i, const pvalue& v) {
+			if (!n)
+				return make(node_ptr(), std::string(), v, node_ptr());
+			std::uint32_t l = count(n->left);
+			if (i <= l)
+				return balance(insert_at(n->left, i, v), n->key, n->value, n->right);
+			return balance(n->left, n->key, n->value, insert_at(n->right, i - l - 1, v));
+		}
+
+		inline node_ptr erase_at(const node_ptr& n, std::uint32_t i) {
+			std::uint32_t l = count(n->left);
+			if (i < l)
+				return balance(erase_at(n->left, i), n->key, n->value, n->right);
+			if (i > l)
+				return balance(n->left, n->key, n->value, erase_at(n->right, i - l - 1));
+			return join(n->left, n->right);
+		}
+
+		//perfectly balanced tree over items[begin, end), used when importing
+		template<class F>
+		inline node_ptr build(std::size_t begin, std::size_t end, F& item) {
+			if (begin == end)
+				return node_ptr();
+			std::size_t mid = begin + (end - begin) / 2;
+			node_ptr l = build(begin, mid, item);
+			node_ptr r = build(mid + 1, end, item);
+			std::string key;
+			pvalue v;
+			item(mid, key, v);
+			return make(l, key, v, r);
+		}
+
+		template<class F>
+		inline void in_order(const node* n, F& f) {
+			while (n) {
+				in_order(n->left.get(), f);
+				f(n->key, n->value);
+				n = n->right.get();
+			}
+		}
+
+	}
+
+	//persistent counterpart of tag_compound, entries kept in key order
+	class pcompound {
+	public:
+
+		pcompound() {}
+
+		inline std::size_t size() const {
+			return persistent_detail::count(m_root);
+		}
+
+		//NULL when missing, valid as long as this version is
+		inline const pvalue* find(const std::string& key) const {
+			const persistent_detail::node* n = persistent_detail::find_key(m_root.get(), key);
+			return n ? &n->value : NULL;
+		}
+
+		inline bool contains(const std::string& key) const {
+			return find(key) != NULL;
+		}
+
+		const pvalue& operator[](const std::string& key) const {
+			const pvalue* v = find(key);
+			if (!v)
+				throw exception("no such key in persistent compound");
+			return *v;
+		}
+
+		//new version with key set to value, this one is unchanged
+		pcompound set(const std::string& key, const pvalue& value) const {
+			if (value.get_id() == 0)
+				throw exception("TAG_End cant be stored in a compound");
+			return pcompound(persistent_detail::insert_key(m_root, key, value));
+		}
+
+		pcompound erase(const std::string& key) const {
+			bool found = false;
+			persistent_detail::node_ptr root = persistent_detail::erase_key(m_root, key, found);
+			return found ? pcompound(root) : *this;
+		}
+
+		//f(const std::string& key, const pvalue& value) in key order
+		template<class F>
+		void for_each(F f) const {
+			persistent_detail::in_order(m_root.get(), f);
+		}
+
+	private:
+
+		friend class pvalue;
+
+		explicit pcompound(persistent_detail::node_ptr root) : m_root(std::move(root)) {}
+
+		persistent_detail::node_ptr m_root;
+	};
+
+	//persistent counterpart of tag_list, indexed through subtree counts
+	class plist {
+	public:
+
+		plist() : m_tagType(0) {}
+
+		inline std::size_t size() const {
+			return persistent_detail::count(m_root);
+		}
+
+		inline std::int8_t get_tag_type() const {
+			return m_tagType;
+		}
+
+		const pvalue& operator[](std::size_t i) const {
+			if (i >= size())
+				throw exception("persistent list index out of range");
+			return persistent_detail::at(m_root.get(), (std::uint32_t)i)->value;
+		}
+
+		plist set(std::size_t i, const pvalue& value) const {
+			if (i >= size())
+				throw exception("persistent list index out of range");
+			check(value);
+			return plist(persistent_detail::set_at(m_root, (std::uint32_t)i, value), m_tagType);
+		}
+
+		plist insert(std::size_t i, const pvalue& value) const {
+			if (i > size())
+				throw exception("persistent list index out of range");
+			check(value);
+			return plist(persistent_detail::insert_at(m_root, (std::uint32_t)i, value), value.get_id());
+		}
+
+		inline plist push_back(const pvalue& value) const {
+			return insert(size(), value);
+		}
+
+		plist erase(std::size_t i) const {
+			if (i >= size())
+				throw exception("persistent list index out of range");
+			persistent_detail::node_ptr root = persistent_detail::erase_at(m_root, (std::uint32_t)i);
+			return plist(root, root ? m_tagType : 0);
+		}
+
+		//f(const pvalue& value) in order
+		template<class F>
+		void for_each(F f) const {
+			auto call = [&f](const std::string&, const pvalue& v) { f(v); };
+			persistent_detail::in_order(m_root.get(), call);
+		}
+
+	private:
+
+		friend class pvalue;
+
+		plist(persistent_detail::node_ptr root, std::int8_t type) : m_root(std::move(root)), m_tagType(type) {}
+
+		inline void check(const pvalue& value) const {
+			if (value.get_id() == 0)
+				throw exception("TAG_End cant be stored in a list");
+			if (m_root && value.get_id() != m_tagType)
+				throw exception("trying to add tag of different type to list tag");
+		}
+
+		persistent_detail::node_ptr m_root;
+		std::int8_t m_tagType;
+	};
+
+	inline pvalue::pvalue(const pcompound& c) : m_type(10), m_bits(0), m_payload(c.m_root) {}
+
+	inline pvalue::pvalue(const plist& l) : m_type(9), m_bits((std::uint64_t)(std::uint8_t)l.m_tagType), m_payload(l.m_root) {}
+
+	inline pcompound pvalue::get_compound() const {
+		expect(10);
+		return pcompound(std::static_pointer_cast<const persistent_detail::node>(m_payload));
+	}
+
+	inline plist pvalue::get_list() const {
+		expect(9);
+		return plist(std::static_pointer_cast<const persistent_detail::node>(m_payload), (std::int8_t)m_bits);
+	}
+
+	inline pvalue pvalue::from_tag(const base* tag) {
+		switch (tag->get_id()) {
+		case 1: return number(dynamic_cast<const tag_byte*>(tag)->m_data);
+		case 2: return number(dynamic_cast<const tag_short*>(tag)->m_data);
+		case 3: return number(dynamic_cast<const tag_int*>(tag)->m_data);
+		case 4: return number(dynamic_cast<const tag_long*>(tag)->m_data);
+		case 5: return number(dynamic_cast<const tag_float*>(tag)->m_data);
+		case 6: return number(dynamic_cast<const tag_double*>(tag)->m_data);
+		case 7: {
+			const tag_bytearray* a = dynamic_cast<const tag_bytearray*>(tag);
+			return array(a->mp_data ? std::vector<std::int8_t>(a->mp_data, a->mp_data + a->m_dataSize) : std::vector<std::int8_t>());
+		}
+		case 8:
+			return string(dynamic_cast<const tag_string*>(tag)->m_data);
+		case 9: {
+			const tag_list* l = dynamic_cast<const tag_list*>(tag);
+			const std::vector<base*>& tags = l->get_tags();
+			auto item = [&tags](std::size_t i, std::string&, pvalue& v) { v = from_tag(tags[i]); };
+			return plist(persistent_detail::build(0, tags.size(), item), tags.empty() ? 0 : l->get_tag_type());
+		}
+		case 10: {
+			const tag_compound* c = dynamic_cast<const tag_compound*>(tag);
+			std::vector<std::pair<const std::string*, const base*>> sorted;
+			sorted.reserve(c->m_tagMap.size());
+			for (auto it = c->m_tagMap.begin(); it != c->m_tagMap.end(); it++) {
+				if (it->second->get_id() != 0)
+					sorted.emplace_back(&it->first, it->second);
+			}
+			std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string*, const base*>& a, const std::pair<const std::string*, const base*>& b) {
+				return *a.first < *b.first;
+			});
+			auto item = [&sorted](std::size_t i, std::string& key, pvalue& v) {
+				key = *sorted[i].first;
+				v = from_tag(sorted[i].second);
+			};
+			return pcompound(persistent_detail::build(0, sorted.size(), item));
+		}
+		case 11: {
+			const tag_intarray* a = dynamic_cast<const tag_intarray*>(tag);
+			return array(a->mp_data ? std::vector<std::int32_t>(a->mp_data, a->mp_data + a->m_dataSize) : std::vector<std::int32_t>());
+		}
+		case 12: {
+			const tag_longarray* a = dynamic_cast<const tag_longarray*>(tag);
+			return array(a->mp_data ? std::vector<std::int64_t>(a->mp_data, a->mp_data + a->m_dataSize) : std::vector<std::int64_t>());
+		}
+		default:
+			return pvalue();
+		}
+	}
+
+	inline base* pvalue::to_tag() const {
+		base* tag = base::create(m_type);
+		if (!tag)
+			throw exception("tag not created (invalid/out of mem)");
+		try {
+			switch (m_type) {
+			case 1: dynamic_cast<tag_byte*>(tag)->m_data = get<std::int8_t>(); break;
+			case 2: dynamic_cast<tag_short*>(tag)->m_data = get<std::int16_t>(); break;
+			case 3: dynamic_cast<tag_int*>(tag)->m_data = get<std::int32_t>(); break;
+			case 4: dynamic_cast<tag_long*>(tag)->m_data = get<std::int64_t>(); break;
+			case 5: dynamic_cast<tag_float*>(tag)->m_data = get<float>(); break;
+			case 6: dynamic_cast<tag_double*>(tag)->m_data = get<double>(); break;
+			case 7: {
+				const std::vector<std::int8_t>& a = get_array<std::int8_t>();
+				tag_bytearray* t = dynamic_cast<tag_bytearray*>(tag);
+				if (!a.empty()) {
+					t->mp_data = new std::int8_t[a.size()];
+					t->m_dataSize = (int)a.size();
+					memcpy(t->mp_data, a.data(), a.size());
+				}
+				break;
+			}
+			case 8:
+				dynamic_cast<tag_string*>(tag)->m_data = get_string();
+				break;
+			case 9: {
+				tag_list* t = dynamic_cast<tag_list*>(tag);
+				get_list().for_each([t](const pvalue& v) { t->append_tag(v.to_tag()); });
+				break;
+			}
+			case 10: {
+				tag_compound* t = dynamic_cast<tag_compound*>(tag);
+				pcompound c = get_compound();
+				t->m_tagMap.reserve(c.size());
+				c.for_each([t](const std::string& key, const pvalue& v) { t->m_tagMap.emplace(key, v.to_tag()); });
+				break;
+			}
+			case 11: {
+				const std::vector<std::int32_t>& a = get_array<std::int32_t>();
+				tag_intarray* t = dynamic_cast<tag_intarray*>(tag);
+				if (!a.empty()) {
+					t->mp_data = new std::int32_t[a.size()];
+					t->m_dataSize = (int)a.size();
+					memcpy(t->mp_data, a.data(), a.size() * sizeof(std::int32_t));
+				}
+				break;
+			}
+			case 12: {
+				const std::vector<std::int64_t>& a = get_array<std::int64_t>();
+				tag_longarray* t = dynamic_cast<tag_longarray*>(tag);
+				if (!a.empty()) {
+					t->mp_data = new std::int64_t[a.size()];
+					t->m_dataSize = (int)a.size();
+					memcpy(t->mp_data, a.data(), a.size() * sizeof(std::int64_t));
+				}
+				break;
+			}
+			}
+		}
+		catch (...) {
+			delete tag;
+			throw;
+		}
+		return tag;
+	}
+
+	//payload in codec C, same bytes base::write_as<C> gives for the equivalent mutable tree
+	template<class C>
+	inline void pvalue::write_as(byteoutstream& output) const {
+		switch (m_type) {
+		case 1: C::template write<std::int8_t>(output, get<std::int8_t>()); break;
+		case 2: C::template write<std::int16_t>(output, get<std::int16_t>()); break;
+		case 3: C::template write<std::int32_t>(output, get<std::int32_t>()); break;
+		case 4: C::template write<std::int64_t>(output, get<std::int64_t>()); break;
+		case 5: C::template write<float>(output, get<float>()); break;
+		case 6: C::template write<double>(output, get<double>()); break;
+		case 7: {
+			const std::vector<std::int8_t>& a = get_array<std::int8_t>();
+			C::write_length(output, (std::int32_t)a.size());
+			if (!a.empty())
+				C::write_array(output, a.data(), (std::int32_t)a.size());
+			break;
+		}
+		case 8:
+			tag_string::write_string<C>(output, get_string());
+			break;
+		case 9: {
+			plist l = get_list();
+			C::template write<std::int8_t>(output, l.get_tag_type());
+			C::write_length(output, (std::int32_t)l.size());
+			l.for_each([&output](const pvalue& v) { v.write_as<C>(output); });
+			break;
+		}
+		case 10:
+			get_compound().for_each([&output](const std::string& key, const pvalue& v) {
+				C::template write<std::int8_t>(output, v.get_id());
+				tag_string::write_string<C>(output, key);
+				v.write_as<C>(output);
+			});
+			C::template write<std::int8_t>(output, 0);//end footer
+			break;
+		case 11: {
+			const std::vector<std::int32_t>& a = get_array<std::int32_t>();
+			C::write_length(output, (std::int32_t)a.size());
+			if (!a.empty())
+				C::write_array(output, a.data(), (std::int32_t)a.size());
+			break;
+		}
+		case 12: {
+			const std::vector<std::int64_t>& a = get_array<std::int64_t>();
+			C::write_length(output, (std::int32_t)a.size());
+			if (!a.empty())
+				C::write_array(output, a.data(), (std::int32_t)a.size());
+			break;
+		}
+		}
+	}
+
+	inline void write_tag(byteoutstream& output, const pvalue& input, format fmt = format::java) {
+		auto root = [&](auto codec) {
+			typedef decltype(codec) C;
+			C::template write<std::int8_t>(output, input.get_id());
+			C::write_string_length(output, 0);//empty utf
+			input.write_as<C>(output);
+		};
+		switch (fmt) {
+		case format::java:
+			root(be_codec());
+			break;
+		case format::bedrock:
+			root(le_codec());
+			break;
+		case format::bedrock_network:
+			root(varint_codec());
+			break;
+		}
+	}
+
+	namespace persistent_detail {
+
+		inline pvalue set_in(const pvalue& at, const path_step* path, std::size_t n, const pvalue& value) {
+			if (!n)
+				return value;
+			if (path->index < 0) {
+				pcompound c = at.get_id() == 0 ? pcompound() : at.get_compound();//missing compounds are created
+				const pvalue* child = c.find(path->key);
+				return c.set(path->key, set_in(child ? *child : pvalue(), path + 1, n - 1, value));
+			}
+			plist l = at.get_list();
+			return l.set((std::size_t)path->index, set_in(l[(std::size_t)path->index], path + 1, n - 1, value));
+		}
+
+		inline pvalue erase_in(const pvalue& at, const path_step* path, std::size_t n) {
+			if (n == 1)
+				return path->index < 0 ? pvalue(at.get_compound().erase(path->key)) : pvalue(at.get_list().erase((std::size_t)path->index));
+			if (path->index < 0) {
+				pcompound c = at.get_compound();
+				return c.set(path->key, erase_in(c[path->key], path + 1, n - 1));
+			}
+			plist l = at.get_list();
+			return l.set((std::size_t)path->index, erase_in(l[(std::size_t)path->index], path + 1, n - 1));
+		}
+
+	}
+
+	//new root with the value at path replaced, copying only the nodes on the way down.
+	//e.g. set_in(root, { "Level", "Sections", 3, "Y" }, pvalue::number<std::int8_t>(3))
+	inline pvalue set_in(const pvalue& root, std::initializer_list<path_step> path, const pvalue& value) {
+		return persistent_detail::set_in(root, path.begin(), path.size(), value);
+	}
+
+	inline pvalue erase_in(const pvalue& root, std::initializer_list<path_step> path) {
+		if (!path.size())
+			throw exception("empty path");
+		return persistent_detail::erase_in(root, path.begin(), path.size());
+	}
+
+	//NULL when any step is missing
+	inline const pvalue* find_in(const pvalue& root, std::initializer_list<path_step> path) {
+		const pvalue* at = &root;
+		for (const path_step& step : path) {
+			if (step.index < 0) {
+				if (at->get_id() != 10 || !(at = at->get_compound().find(step.key)))
+					return NULL;
+			}
+			else {
+				if (at->get_id() != 9)
+					return NULL;
+				plist l = at->get_list();
+				if ((std::size_t)step.index >= l.size())
+					return NULL;
+				at = &l[(std::size_t)step.index];
+			}
+		}
+		return at;
+	}
+
+	//the current version of a tree, swapped atomically. readers take a snapshot and keep it alive for as
+	//long as they use it, writers publish new versions without waiting for them
+	class snapshot_root {
+	public:
+
+		snapshot_root() : m_root(std::make_shared<const pvalue>()) {}
+		explicit snapshot_root(const pvalue& root) : m_root(std::make_shared<const pvalue>(root)) {}
+
+		snapshot_root(const snapshot_root&) = delete;
+		snapshot_root& operator=(const snapshot_root&) = delete;
+
+		inline std::shared_ptr<const pvalue> snapshot() const {
+			return m_root.load(std::memory_order_acquire);
+		}
+
+		inline void publish(const pvalue& root) {
+			m_root.store(std::make_shared<const pvalue>(root), std::memory_order_release);
+		}
+
+		//applies f(const pvalue&) -> pvalue to the current version and publishes the result, retrying if
+		//another writer got in first. returns the published version
+		template<class F>
+		std::shared_ptr<const pvalue> update(F f) {
+			std::shared_ptr<const pvalue> cur = snapshot();
+			for (;;) {
+				std::shared_ptr<const pvalue> next = std::make_shared<const pvalue>(f(*cur));
+				if (m_root.compare_exchange_weak(cur, next, std::memory_order_acq_rel, std::memory_order_acquire))
+					return next;
+			}
+		}
+
+	private:
+		std::atomic<std::shared_ptr<const pvalue>> m_root;
+	};
+
+}
+
+#endif
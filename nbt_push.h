@@ -0,0 +1,550 @@
+#ifndef _NBT_PUSH
+#define _NBT_PUSH
+
+#include "nbt.h"
+
+namespace nbt {
+
+	//resumable decoder for uncompressed nbt arriving in pieces, e.g. split over tcp segments. feed it chunks
+	//as they come. it keeps its place inside strings, arrays, varints and nested tags, so no byte is looked at
+	//twice and no message has to be buffered whole. trees and size limits match read_tag
+	class push_parser {
+	public:
+
+		explicit push_parser(format fmt = format::java, std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max())
+			: m_format(fmt), m_tracker(max_bytes), m_root(NULL) {
+			reset();
+		}
+
+		push_parser(const push_parser&) = delete;
+		push_parser& operator=(const push_parser&) = delete;
+
+		~push_parser() {
+			delete m_root;
+		}
+
+		//parses as much of data as it can and returns how many bytes it used. stops right after the root
+		//tag, so a return below size with done() set means the rest belongs to the next message.
+		//throws nbt::exception on corrupt input or when over max_bytes, the parser is reset in that case
+		std::size_t feed(const uint8* data, std::size_t size) {
+			const uint8* p = data;
+			const uint8* end = data + size;
+			try {
+				run(p, end);
+			}
+			catch (...) {
+				reset();
+				throw;
+			}
+			m_consumed += p - data;
+			return p - data;
+		}
+
+		bool done() const {
+			return m_step == step::done;
+		}
+
+		//bytes used by the current message so far
+		std::uint64_t consumed() const {
+			return m_consumed;
+		}
+
+		//hands the finished root tag to the caller and readies the parser for the next message
+		base* release() {
+			if (!done())
+				throw exception("nbt message is not complete");
+			base* root = m_root;
+			m_root = NULL;
+			reset();
+			return root;
+		}
+
+		//drops a partial message
+		void reset() {
+			delete m_root;
+			m_root = NULL;
+			m_tag = NULL;
+			m_stack.clear();
+			m_step = step::root_id;
+			m_tracker.m_read = 0;
+			m_consumed = 0;
+			m_have = 0;
+			m_acc = 0;
+			m_shift = 0;
+		}
+
+	private:
+
+		enum class step : std::uint8_t {
+			root_id,
+			root_name_length,
+			root_name,
+			payload,//start of m_tag's payload
+			scalar,
+			string_length,
+			string_bytes,
+			array_length,
+			array_data,
+			list_type,
+			list_length,
+			list_next,
+			compound_id,
+			compound_child,
+			done,
+		};
+
+		struct frame {
+			tag_compound* compound;//one of the two is set
+			tag_list* list;
+			std::int8_t element;
+			int depth;
+			std::uint32_t remaining;//list elements still to come
+		};
+
+		format m_format;
+		size_tracker m_tracker;
+		base* m_root;
+		base* m_tag;//tag whose payload is being read, already attached to its parent. scalars are only made once complete
+		std::int8_t m_id;//of the tag being read
+		int m_depth;
+		std::vector<frame> m_stack;
+		step m_step;
+		std::uint64_t m_consumed;
+
+		//partial primitives carried over between chunks
+		uint8 m_scratch[8];
+		std::size_t m_have;
+		std::uint64_t m_acc;
+		int m_shift;
+
+		std::uint32_t m_left;//bytes of a string or name, elements of an array, still to come
+		std::uint32_t m_count;//array length
+		std::uint32_t m_capacity;//array elements allocated so far
+		std::string m_key;
+		std::string* m_string;//string being filled, a value or m_key
+		std::int8_t m_childId;
+		std::int8_t m_listType;
+
+		//collects n bytes into m_scratch across calls, true once all are there
+		inline bool gather(const uint8*& p, const uint8* end, std::size_t n) {
+			std::size_t take = std::min<std::size_t>(n - m_have, end - p);
+			memcpy(m_scratch + m_have, p, take);
+			p += take;
+			m_have += take;
+			if (m_have < n)
+				return false;
+			m_have = 0;
+			return true;
+		}
+
+		template<class T>
+		inline bool fixed(const uint8*& p, const uint8* end, T& v) {
+			if (m_have == 0 && (std::size_t)(end - p) >= sizeof(T)) {//whole value in this chunk
+				memcpy(&v, p, sizeof(T));
+				p += sizeof(T);
+			}
+			else if (gather(p, end, sizeof(T)))
+				memcpy(&v, m_scratch, sizeof(T));
+			else return false;
+			v = m_format == format::java ? to_endian<endian_big>(v) : to_endian<endian_little>(v);
+			return true;
+		}
+
+		template<class T>
+		inline bool varuint(const uint8*& p, const uint8* end, T& v) {
+			constexpr int max_bytes = (sizeof(T) * 8 + 6) / 7;
+			while (p != end) {
+				uint8 b = *p++;
+				m_acc |= (std::uint64_t)(b & 0x7F) << m_shift;
+				m_shift += 7;
+				if (!(b & 0x80)) {
+					v = (T)m_acc;
+					m_acc = 0;
+					m_shift = 0;
+					return true;
+				}
+				if (m_shift == 7 * max_bytes)
+					throw exception("varint too long");
+			}
+			return false;
+		}
+
+		//one scalar the way the codec of m_format stores it
+		template<class T>
+		inline bool number(const uint8*& p, const uint8* end, T& v) {
+			if constexpr (std::is_same<T, std::int32_t>::value || std::is_same<T, std::int64_t>::value) {
+				if (m_format == format::bedrock_network) {
+					typename std::make_unsigned<T>::type u;
+					if (!varuint(p, end, u))
+						return false;
+					v = varint_codec::unzigzag(u);
+					return true;
+				}
+			}
+			return fixed(p, end, v);
+		}
+
+		inline bool length(const uint8*& p, const uint8* end, std::int32_t& len) {
+			if (m_format == format::bedrock_network) {
+				std::uint32_t u;
+				if (!varuint(p, end, u))
+					return false;
+				len = varint_codec::unzigzag(u);
+				return true;
+			}
+			return fixed(p, end, len);
+		}
+
+		inline bool string_length(const uint8*& p, const uint8* end, std::uint32_t& len) {
+			if (m_format == format::bedrock_network)
+				return varuint(p, end, len);
+			std::uint16_t v;
+			if (!fixed(p, end, v))
+				return false;
+			len = v;
+			return true;
+		}
+
+		//a cleared tag from the thread's tag_cache like base::create, but typed without a cast for fresh ones
+		template<class Tag>
+		static inline Tag* make(std::int8_t id) {
+			if (tag_cache* cache = tag_cache::current())
+				if (base* tag = cache->take(id))
+					return dynamic_cast<Tag*>(tag);
+			return _NBT_STATS_NEW(Tag);
+		}
+
+		//hangs a new tag off the container on top of the stack, or makes it the root
+		inline void attach(base* tag) {
+			if (m_stack.empty()) {
+				m_root = tag;
+				return;
+			}
+			frame& top = m_stack.back();
+			if (top.list) {
+				top.list->append_tag(tag);
+				return;
+			}
+			auto res = top.compound->m_tagMap.emplace(m_key, tag);
+			if (!res.second) {//duplicate key, last one wins
+				delete res.first->second;
+				res.first->second = tag;
+			}
+		}
+
+		template<class Tag>
+		inline bool scalar(const uint8*& p, const uint8* end) {
+			decltype(Tag::m_data) v;
+			if (!number(p, end, v))
+				return false;
+			Tag* tag = make<Tag>(m_id);
+			tag->m_data = v;
+			attach(tag);
+			return true;
+		}
+
+		//array payloads grow as bytes arrive instead of trusting the length prefix with one allocation
+		template<class Tag, class T>
+		inline void grow(Tag* tag) {
+			std::uint32_t cap = m_capacity ? std::min<std::uint64_t>(m_count, 2ull * m_capacity) : std::min<std::uint32_t>(m_count, 0x4000);
+			T* data = new T[cap];
+			if (m_capacity)
+				memcpy(data, tag->mp_data, sizeof(T) * m_capacity);
+			tag->clear_buffer();
+			tag->mp_data = data;
+			tag->m_dataSize = cap;//keeps the buffer owned by the tag if parsing fails
+			m_capacity = cap;
+		}
+
+		template<class Tag, class T>
+		inline bool array_data(const uint8*& p, const uint8* end) {
+			Tag* tag = dynamic_cast<Tag*>(m_tag);
+			if constexpr (sizeof(T) >= 4) {
+				if (m_format == format::bedrock_network) {
+					while (m_left) {
+						std::uint32_t index = m_count - m_left;
+						if (index == m_capacity)
+							grow<Tag, T>(tag);
+						typename std::make_unsigned<T>::type u;
+						if (!varuint(p, end, u))
+							return false;
+						tag->mp_data[index] = varint_codec::unzigzag(u);
+						m_left--;
+					}
+					return true;
+				}
+			}
+			//raw elements, m_have counts the bytes of a split element
+			while (m_left) {
+				std::uint32_t index = m_count - m_left;
+				if (index == m_capacity && m_have == 0)
+					grow<Tag, T>(tag);
+				if (p == end)
+					return false;
+				uint8* out = (uint8*)tag->mp_data + (std::size_t)index * sizeof(T) + m_have;
+				std::size_t room = (std::size_t)(m_capacity - index) * sizeof(T) - m_have;
+				std::size_t take = std::min<std::size_t>(room, end - p);
+				memcpy(out, p, take);
+				p += take;
+				std::size_t bytes = m_have + take;
+				m_left -= (std::uint32_t)(bytes / sizeof(T));
+				m_have = bytes % sizeof(T);
+			}
+			if (sizeof(T) > 1) {
+				for (std::uint32_t i = 0; i < m_count; i++)
+					tag->mp_data[i] = m_format == format::java ? to_endian<endian_big>(tag->mp_data[i]) : to_endian<endian_little>(tag->mp_data[i]);
+			}
+			return true;
+		}
+
+		inline bool read_array(const uint8*& p, const uint8* end) {
+			switch (m_id) {
+			case 7:
+				return array_data<tag_bytearray, std::int8_t>(p, end);
+			case 11:
+				return array_data<tag_intarray, std::int32_t>(p, end);
+			default:
+				return array_data<tag_longarray, std::int64_t>(p, end);
+			}
+		}
+
+		//m_tag is complete, continue with its parent
+		inline void finish() {
+			if (m_stack.empty()) {
+				m_step = step::done;
+				return;
+			}
+			m_step = m_stack.back().list ? step::list_next : step::compound_id;
+		}
+
+		inline void push(tag_compound* compound, tag_list* list, std::int8_t element, std::uint32_t remaining) {
+			frame f = { compound, list, element, m_depth, remaining };
+			m_stack.push_back(f);
+		}
+
+		void run(const uint8*& p, const uint8* end) {
+			for (;;) {
+				switch (m_step) {
+				case step::root_id: {
+					std::int8_t id;
+					if (!fixed(p, end, id))
+						return;
+					if (id == 0x1f)//gzip magic, spelled out since _NBT_GZIP_MAGIC is gone under _NBT_NO_COMPRESS
+						throw exception("compressed nbt cannot be parsed incrementally");
+					if ((std::uint8_t)id > 12)
+						throw exception("tag not created (invalid/out of mem)");
+					m_id = id;
+					m_depth = 0;
+					m_step = step::root_name_length;
+					break;
+				}
+				case step::root_name_length:
+					if (!string_length(p, end, m_left))
+						return;
+					m_step = step::root_name;
+					break;
+				case step::root_name: {
+					std::size_t take = std::min<std::size_t>(m_left, end - p);
+					p += take;
+					m_left -= (std::uint32_t)take;
+					if (m_left)
+						return;
+					m_step = step::payload;
+					break;
+				}
+				case step::payload:
+					if (m_id == 0 || m_id > 6) {
+						m_tag = base::create(m_id);
+						attach(m_tag);
+					}
+					switch (m_id) {
+					case 0:
+						m_tracker.read(64);
+						finish();
+						break;
+					case 1:
+						m_tracker.read(72);
+						m_step = step::scalar;
+						break;
+					case 2:
+						m_tracker.read(80);
+						m_step = step::scalar;
+						break;
+					case 3:
+					case 5:
+						m_tracker.read(96);
+						m_step = step::scalar;
+						break;
+					case 4:
+					case 6:
+						m_tracker.read(128);
+						m_step = step::scalar;
+						break;
+					case 7:
+					case 11:
+					case 12:
+						m_tracker.read(192);
+						m_step = step::array_length;
+						break;
+					case 8:
+						m_tracker.read(36 * 8);//same charges as tag_string::read_string
+						m_string = &static_cast<tag_string*>(m_tag)->m_data;
+						m_step = step::string_length;
+						break;
+					case 9:
+						m_tracker.read(296);
+						if (m_depth > 0x200)
+							throw exception("Tried to read NBT with too high complexity, depth > 512");
+						m_step = step::list_type;
+						break;
+					default:
+						m_tracker.read(384);
+						if (m_depth > 0x200)
+							throw exception("Tried to read NBT with too high complexity, depth > 512");
+						push(static_cast<tag_compound*>(m_tag), NULL, 0, 0);
+						m_step = step::compound_id;
+						break;
+					}
+					break;
+				case step::scalar: {
+					bool complete;
+					switch (m_id) {
+					case 1:
+						complete = scalar<tag_byte>(p, end);
+						break;
+					case 2:
+						complete = scalar<tag_short>(p, end);
+						break;
+					case 3:
+						complete = scalar<tag_int>(p, end);
+						break;
+					case 4:
+						complete = scalar<tag_long>(p, end);
+						break;
+					case 5:
+						complete = scalar<tag_float>(p, end);
+						break;
+					default:
+						complete = scalar<tag_double>(p, end);
+						break;
+					}
+					if (!complete)
+						return;
+					finish();
+					break;
+				}
+				case step::string_length:
+					if (!string_length(p, end, m_left))
+						return;
+					m_tracker.read(16ull * m_left);
+					m_string->clear();
+					m_string->reserve(std::min<std::uint32_t>(m_left, 0x1000));
+					m_step = step::string_bytes;
+					break;
+				case step::string_bytes: {
+					std::size_t take = std::min<std::size_t>(m_left, end - p);
+					m_string->append((const char*)p, take);
+					p += take;
+					m_left -= (std::uint32_t)take;
+					if (m_left)
+						return;
+					if (m_string == &m_key)
+						m_step = step::compound_child;
+					else finish();
+					break;
+				}
+				case step::array_length: {
+					std::int32_t len;
+					if (!length(p, end, len))
+						return;
+					if (len < 0)
+						throw exception("negative array length. corrupt tag?");
+					if (!len) {
+						finish();
+						break;
+					}
+					std::int8_t id = m_id;
+					m_tracker.read(8ull * (id == 7 ? 1 : id == 11 ? 4 : 8) * len);
+					m_count = m_left = (std::uint32_t)len;
+					m_capacity = 0;
+					m_step = step::array_data;
+					break;
+				}
+				case step::array_data:
+					if (!read_array(p, end))
+						return;
+					finish();
+					break;
+				case step::list_type:
+					if (!fixed(p, end, m_listType))
+						return;
+					m_step = step::list_length;
+					break;
+				case step::list_length: {
+					std::int32_t len;
+					if (!length(p, end, len))
+						return;
+					if (len < 0)
+						throw exception("negative list length. corrupt tag?");
+					if (m_listType == 0 && len > 0)
+						throw exception("missing type on list tag");
+					m_tracker.read(len * 32ull);
+					tag_list* list = static_cast<tag_list*>(m_tag);
+					list->set_tag_type(m_listType);
+					if (!len) {
+						finish();
+						break;
+					}
+					if ((std::uint8_t)m_listType > 12)
+						throw exception("error reading compound tag: tag id invalid. corrupt tag?");
+					push(NULL, list, m_listType, (std::uint32_t)len);
+					m_step = step::list_next;
+					break;
+				}
+				case step::list_next: {
+					frame& top = m_stack.back();
+					if (!top.remaining) {
+						m_stack.pop_back();
+						finish();
+						break;
+					}
+					top.remaining--;
+					m_id = top.element;
+					m_depth = top.depth + 1;
+					m_step = step::payload;
+					break;
+				}
+				case step::compound_id: {
+					std::int8_t id;
+					if (!fixed(p, end, id))
+						return;
+					if (id == 0) {
+						m_stack.pop_back();
+						finish();
+						break;
+					}
+					if ((std::uint8_t)id > 12)
+						throw exception("error reading compound tag: tag id invalid. corrupt tag?");
+					m_tracker.read(36 * 8);
+					m_childId = id;
+					m_string = &m_key;
+					m_step = step::string_length;
+					break;
+				}
+				case step::compound_child: {
+					m_tracker.read(288);
+					m_id = m_childId;
+					m_depth = m_stack.back().depth + 1;
+					m_step = step::payload;
+					break;
+				}
+				case step::done:
+					return;
+				}
+			}
+		}
+	};
+
+}
+
+#endif
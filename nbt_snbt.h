@@ -0,0 +1,609 @@
+#ifndef _NBT_SNBT
+#define _NBT_SNBT
+
+#include "nbt.h"
+#include <charconv>
+#include <cstring>
+
+//predefine '_NBT_NO_SIMD' to force the scalar scanners
+#if !defined(_NBT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define _NBT_SNBT_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace nbt {
+
+	//stringified nbt, as used by minecraft commands and datapacks.
+	//parses straight into the tag model, a single value per input with only whitespace around it
+	class snbt_parser {
+
+		const char* m_begin;
+		const char* m_cur;
+		const char* m_end;
+
+	public:
+
+		snbt_parser(const char* str, std::size_t len) : m_begin(str), m_cur(str), m_end(str + len) {}
+
+		//caller owns the returned tag. throws nbt::exception, get_position() then points at the error
+		base* parse() {
+			base* tag = parse_value(0);
+			m_cur = skip_ws(m_cur, m_end);
+			if (m_cur != m_end) {
+				delete tag;
+				throw exception("trailing data after snbt value");
+			}
+			return tag;
+		}
+
+		std::size_t get_position() const {
+			return m_cur - m_begin;
+		}
+
+		static inline bool is_unquoted_char(char c) {
+			return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+				|| c == '_' || c == '-' || c == '.' || c == '+';
+		}
+
+		//the scanners check 16 bytes at a time with sse2 and finish the tail one byte at a time
+		static inline const char* skip_ws(const char* p, const char* end) {
+#ifdef _NBT_SNBT_SSE2
+			const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+			while (end - p >= 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+					_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+				std::uint32_t bits = ~(std::uint32_t)_mm_movemask_epi8(ws) & 0xFFFF;
+				if (bits)
+					return p + ctz(bits);
+				p += 16;
+			}
+#endif
+			while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+				p++;
+			return p;
+		}
+
+		static inline const char* scan_unquoted(const char* p, const char* end) {
+#ifdef _NBT_SNBT_SSE2
+			while (end - p >= 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				__m128i m = _mm_or_si128(_mm_or_si128(in_range(v, '0', '9'), in_range(v, 'A', 'Z')), in_range(v, 'a', 'z'));
+				m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), _mm_cmpeq_epi8(v, _mm_set1_epi8('-'))));
+				m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')), _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))));
+				std::uint32_t bits = ~(std::uint32_t)_mm_movemask_epi8(m) & 0xFFFF;
+				if (bits)
+					return p + ctz(bits);
+				p += 16;
+			}
+#endif
+			while (p != end && is_unquoted_char(*p))
+				p++;
+			return p;
+		}
+
+		//first quote or backslash
+		static inline const char* scan_quoted(const char* p, const char* end, char quote) {
+#ifdef _NBT_SNBT_SSE2
+			const __m128i q = _mm_set1_epi8(quote), bs = _mm_set1_epi8('\\');
+			while (end - p >= 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				std::uint32_t bits = (std::uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)));
+				if (bits)
+					return p + ctz(bits);
+				p += 16;
+			}
+#endif
+			while (p != end && *p != quote && *p != '\\')
+				p++;
+			return p;
+		}
+
+	private:
+
+#ifdef _NBT_SNBT_SSE2
+		static inline int ctz(std::uint32_t v) {
+#ifdef _MSC_VER
+			unsigned long i;
+			_BitScanForward(&i, v);
+			return (int)i;
+#else
+			return __builtin_ctz(v);
+#endif
+		}
+
+		static inline __m128i in_range(__m128i v, char lo, char hi) {
+			return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+		}
+#endif
+
+		inline char peek() {
+			m_cur = skip_ws(m_cur, m_end);
+			if (m_cur == m_end)
+				throw exception("unexpected end of snbt");
+			return *m_cur;
+		}
+
+		inline void expect(char c, const char* const msg) {
+			if (peek() != c)
+				throw exception(msg);
+			m_cur++;
+		}
+
+		base* parse_value(int depth) {
+			if (depth > 0x200)
+				throw exception("Tried to read NBT with too high complexity, depth > 512");
+			char c = peek();
+			if (c == '{')
+				return parse_compound(depth);
+			if (c == '[')
+				return parse_list(depth);
+			if (c == '"' || c == '\'') {
+				tag_string* str = new tag_string;
+				try {
+					parse_quoted(str->m_data);
+				}
+				catch (...) {
+					delete str;
+					throw;
+				}
+				return str;
+			}
+			return parse_literal();
+		}
+
+		void parse_quoted(std::string& out) {
+			char quote = *m_cur++;
+			out.clear();
+			for (;;) {
+				const char* stop = scan_quoted(m_cur, m_end, quote);
+				out.append(m_cur, stop - m_cur);
+				m_cur = stop;
+				if (m_cur == m_end)
+					throw exception("unterminated snbt string");
+				if (*m_cur == quote) {
+					m_cur++;
+					return;
+				}
+				if (++m_cur == m_end)//backslash
+					throw exception("unterminated snbt string");
+				switch (*m_cur++) {
+				case '\\': out += '\\'; break;
+				case '"': out += '"'; break;
+				case '\'': out += '\''; break;
+				case 'n': out += '\n'; break;
+				case 't': out += '\t'; break;
+				case 'r': out += '\r'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 's': out += ' '; break;
+				case 'u': append_utf8(out, parse_hex(4)); break;
+				case 'U': append_utf8(out, parse_hex(8)); break;
+				case 'x': append_utf8(out, parse_hex(2)); break;
+				default:
+					throw exception("invalid escape in snbt string");
+				}
+			}
+		}
+
+		std::uint32_t parse_hex(int digits) {
+			if (m_end - m_cur < digits)
+				throw exception("truncated unicode escape in snbt string");
+			std::uint32_t v = 0;
+			auto res = std::from_chars(m_cur, m_cur + digits, v, 16);
+			if (res.ptr != m_cur + digits)
+				throw exception("invalid unicode escape in snbt string");
+			m_cur += digits;
+			return v;
+		}
+
+		static void append_utf8(std::string& out, std::uint32_t cp) {
+			if (cp < 0x80) {
+				out += (char)cp;
+			}
+			else if (cp < 0x800) {
+				out += (char)(0xC0 | (cp >> 6));
+				out += (char)(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x10000) {
+				out += (char)(0xE0 | (cp >> 12));
+				out += (char)(0x80 | ((cp >> 6) & 0x3F));
+				out += (char)(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x110000) {
+				out += (char)(0xF0 | (cp >> 18));
+				out += (char)(0x80 | ((cp >> 12) & 0x3F));
+				out += (char)(0x80 | ((cp >> 6) & 0x3F));
+				out += (char)(0x80 | (cp & 0x3F));
+			}
+			else throw exception("unicode escape out of range in snbt string");
+		}
+
+		void parse_key(std::string& out) {
+			char c = peek();
+			if (c == '"' || c == '\'') {
+				parse_quoted(out);
+				return;
+			}
+			const char* stop = scan_unquoted(m_cur, m_end);
+			if (stop == m_cur)
+				throw exception("expected compound key");
+			out.assign(m_cur, stop - m_cur);
+			m_cur = stop;
+		}
+
+		tag_compound* parse_compound(int depth) {
+			m_cur++;//{
+			tag_compound* compound = new tag_compound;
+			try {
+				if (peek() == '}') {
+					m_cur++;
+					return compound;
+				}
+				std::string key;
+				for (;;) {
+					parse_key(key);
+					expect(':', "expected ':' after compound key");
+					base* tag = parse_value(depth + 1);
+					auto res = compound->m_tagMap.emplace(key, tag);
+					if (!res.second) {//duplicate key, last one wins
+						delete res.first->second;
+						res.first->second = tag;
+					}
+					char c = peek();
+					m_cur++;
+					if (c == '}')
+						break;
+					if (c != ',')
+						throw exception("expected ',' or '}' in compound");
+				}
+			}
+			catch (...) {
+				delete compound;
+				throw;
+			}
+			return compound;
+		}
+
+		base* parse_list(int depth) {
+			m_cur++;//[
+			const char* type = skip_ws(m_cur, m_end);//[I;, also with spaces around the letter
+			const char* semicolon = type == m_end ? m_end : skip_ws(type + 1, m_end);
+			if (semicolon != m_end && *semicolon == ';') {
+				m_cur = semicolon + 1;
+				switch (*type) {
+				case 'B':
+					return parse_array<tag_bytearray, std::int8_t>('b');
+				case 'I':
+					return parse_array<tag_intarray, std::int32_t>(0);
+				case 'L':
+					return parse_array<tag_longarray, std::int64_t>('l');
+				default:
+					throw exception("unknown snbt array type");
+				}
+			}
+			tag_list* list = new tag_list;
+			try {
+				if (peek() == ']') {
+					m_cur++;
+					return list;
+				}
+				for (;;) {
+					base* tag = parse_value(depth + 1);
+					try {
+						list->append_tag(tag);
+					}
+					catch (...) {
+						delete tag;
+						throw;
+					}
+					char c = peek();
+					m_cur++;
+					if (c == ']')
+						break;
+					if (c != ',')
+						throw exception("expected ',' or ']' in list");
+				}
+			}
+			catch (...) {
+				delete list;
+				throw;
+			}
+			return list;
+		}
+
+		//suffix is the lowercase type letter elements may carry, 0 for none (int arrays)
+		template<class A, class T>
+		A* parse_array(char suffix) {
+			std::vector<T> values;
+			if (peek() == ']') {
+				m_cur++;
+			}
+			else {
+				for (;;) {
+					peek();
+					const char* stop = scan_unquoted(m_cur, m_end);
+					const char* num_end = stop;
+					if (suffix && num_end != m_cur && (num_end[-1] | 0x20) == suffix)
+						num_end--;
+					if (num_end != m_cur && *m_cur == '+')
+						m_cur++;
+					T v;
+					auto res = std::from_chars(m_cur, num_end, v);
+					if (num_end == m_cur || res.ec != std::errc() || res.ptr != num_end)
+						throw exception("invalid element in snbt array");
+					values.push_back(v);
+					m_cur = stop;
+					char c = peek();
+					m_cur++;
+					if (c == ']')
+						break;
+					if (c != ',')
+						throw exception("expected ',' or ']' in array");
+				}
+			}
+			A* arr = new A;
+			if (!values.empty()) {
+				arr->mp_data = new T[values.size()];
+				arr->m_dataSize = (int)values.size();
+				memcpy(arr->mp_data, values.data(), values.size() * sizeof(T));
+			}
+			return arr;
+		}
+
+		template<class T>
+		static bool parse_integer(const char* b, const char* e, T& out) {
+			if (b != e && *b == '+')
+				b++;
+			if (b == e)
+				return false;
+			auto res = std::from_chars(b, e, out);
+			return res.ec == std::errc() && res.ptr == e;
+		}
+
+		template<class T>
+		static bool parse_floating(const char* b, const char* e, T& out) {
+			if (b != e && *b == '+')
+				b++;
+			if (e - b == 3 && !memcmp(b, "NaN", 3)) {//non-finite values as the writer spells them, -Infinity is from_chars'
+				out = std::numeric_limits<T>::quiet_NaN();
+				return true;
+			}
+			if (e - b == 8 && !memcmp(b, "Infinity", 8)) {
+				out = std::numeric_limits<T>::infinity();
+				return true;
+			}
+			if (b == e || !((*b >= '0' && *b <= '9') || *b == '-' || *b == '.'))
+				return false;
+			auto res = std::from_chars(b, e, out);
+			return res.ec == std::errc() && res.ptr == e;
+		}
+
+		template<class P, class T>
+		static P* make(T v) {
+			P* tag = new P;
+			tag->m_data = v;
+			return tag;
+		}
+
+		//numbers (with b/s/l/f/d suffix), true/false, anything else is an unquoted string
+		base* parse_literal() {
+			const char* b = m_cur;
+			const char* e = scan_unquoted(m_cur, m_end);
+			if (b == e)
+				throw exception("expected snbt value");
+			m_cur = e;
+			std::size_t len = e - b;
+			if (len == 4 && !memcmp(b, "true", 4))
+				return make<tag_byte>((std::int8_t)1);
+			if (len == 5 && !memcmp(b, "false", 5))
+				return make<tag_byte>((std::int8_t)0);
+			switch (e[-1] | 0x20) {
+			case 'b': {
+				std::int8_t v;
+				if (parse_integer(b, e - 1, v))
+					return make<tag_byte>(v);
+				break;
+			}
+			case 's': {
+				std::int16_t v;
+				if (parse_integer(b, e - 1, v))
+					return make<tag_short>(v);
+				break;
+			}
+			case 'l': {
+				std::int64_t v;
+				if (parse_integer(b, e - 1, v))
+					return make<tag_long>(v);
+				break;
+			}
+			case 'f': {
+				float v;
+				if (parse_floating(b, e - 1, v))
+					return make<tag_float>(v);
+				break;
+			}
+			case 'd': {
+				double v;
+				if (parse_floating(b, e - 1, v))
+					return make<tag_double>(v);
+				break;
+			}
+			default: {
+				std::int32_t i;
+				if (parse_integer(b, e, i))
+					return make<tag_int>(i);
+				double d;
+				if (memchr(b, '.', len) || memchr(b, 'e', len) || memchr(b, 'E', len)) {
+					if (parse_floating(b, e, d))
+						return make<tag_double>(d);
+				}
+				break;
+			}
+			}
+			tag_string* str = new tag_string;
+			str->m_data.assign(b, len);
+			return str;
+		}
+
+	};
+
+	inline base* parse_snbt(const char* str, std::size_t len) {
+		snbt_parser parser(str, len);
+		return parser.parse();
+	}
+
+	inline base* parse_snbt(const std::string& str) {
+		return parse_snbt(str.data(), str.size());
+	}
+
+	class snbt_writer {
+	public:
+
+		static void write(std::string& out, const base* tag) {
+			switch (tag->get_id()) {
+			case 1:
+				write_number(out, dynamic_cast<const tag_byte*>(tag)->m_data, 'b');
+				break;
+			case 2:
+				write_number(out, dynamic_cast<const tag_short*>(tag)->m_data, 's');
+				break;
+			case 3:
+				write_number(out, dynamic_cast<const tag_int*>(tag)->m_data, 0);
+				break;
+			case 4:
+				write_number(out, dynamic_cast<const tag_long*>(tag)->m_data, 'L');
+				break;
+			case 5:
+				write_number(out, dynamic_cast<const tag_float*>(tag)->m_data, 'f');
+				break;
+			case 6:
+				write_number(out, dynamic_cast<const tag_double*>(tag)->m_data, 'd');
+				break;
+			case 7: {
+				const tag_bytearray* arr = dynamic_cast<const tag_bytearray*>(tag);
+				write_array(out, "[B;", arr->mp_data, arr->m_dataSize, 'B');
+				break;
+			}
+			case 8:
+				write_string(out, dynamic_cast<const tag_string*>(tag)->m_data);
+				break;
+			case 9: {
+				const tag_list* list = dynamic_cast<const tag_list*>(tag);
+				out += '[';
+				bool first = true;
+				for (const base* child : list->get_tags()) {
+					if (!first)
+						out += ',';
+					first = false;
+					write(out, child);
+				}
+				out += ']';
+				break;
+			}
+			case 10: {
+				const tag_compound* compound = dynamic_cast<const tag_compound*>(tag);
+				out += '{';
+				bool first = true;
+				for (auto it = compound->m_tagMap.begin(); it != compound->m_tagMap.end(); it++) {
+					if (it->second->get_id() == 0)
+						continue;
+					if (!first)
+						out += ',';
+					first = false;
+					write_key(out, it->first);
+					out += ':';
+					write(out, it->second);
+				}
+				out += '}';
+				break;
+			}
+			case 11: {
+				const tag_intarray* arr = dynamic_cast<const tag_intarray*>(tag);
+				write_array(out, "[I;", arr->mp_data, arr->m_dataSize, 0);
+				break;
+			}
+			case 12: {
+				const tag_longarray* arr = dynamic_cast<const tag_longarray*>(tag);
+				write_array(out, "[L;", arr->mp_data, arr->m_dataSize, 'L');
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		//quotes with " unless the string contains " but not '
+		static void write_string(std::string& out, const std::string& str) {
+			char quote = '"';
+			if (str.find('"') != std::string::npos && str.find('\'') == std::string::npos)
+				quote = '\'';
+			out += quote;
+			const char* p = str.data();
+			const char* end = p + str.size();
+			while (p != end) {
+				const char* stop = snbt_parser::scan_quoted(p, end, quote);
+				out.append(p, stop - p);
+				if (stop == end)
+					break;
+				out += '\\';
+				out += *stop;
+				p = stop + 1;
+			}
+			out += quote;
+		}
+
+		static void write_key(std::string& out, const std::string& key) {
+			if (!key.empty() && snbt_parser::scan_unquoted(key.data(), key.data() + key.size()) == key.data() + key.size())
+				out += key;
+			else
+				write_string(out, key);
+		}
+
+		//shortest representation that reads back to the same value
+		template<class T>
+		static void write_number(std::string& out, T v, char suffix) {
+			if constexpr (std::is_floating_point<T>::value) {
+				if (!std::isfinite(v)) {//to_chars gives nan/inf, which would read back as strings
+					out += std::isnan(v) ? "NaN" : v < 0 ? "-Infinity" : "Infinity";
+					out += suffix;
+					return;
+				}
+			}
+			char buf[40];
+			auto res = std::to_chars(buf, buf + sizeof(buf), v);
+			out.append(buf, res.ptr - buf);
+			if (suffix)
+				out += suffix;
+		}
+
+		template<class T>
+		static void write_array(std::string& out, const char* const prefix, const T* data, int size, char suffix) {
+			out += prefix;
+			for (int i = 0; i < size; i++) {
+				if (i)
+					out += ',';
+				write_number(out, data[i], suffix);
+			}
+			out += ']';
+		}
+
+	};
+
+	inline void write_snbt(std::string& out, const base* tag) {
+		if (tag)
+			snbt_writer::write(out, tag);
+	}
+
+	inline std::string to_snbt(const base* tag) {
+		std::string out;
+		write_snbt(out, tag);
+		return out;
+	}
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef _NBT_STREAM
+#define _NBT_STREAM
+
+#include "nbt.h"
+#include <algorithm>
+
+namespace nbt {
+
+	//buffered pull reader over a bytestream that inflates gzip/zlib input on the fly.
+	//memory use is two fixed windows no matter how big the input is
+	class stream_reader {
+	public:
+
+		static constexpr std::uint32_t chunk_size = 0x10000;
+
+		//compression is detected from the byte at the current position of input
+		explicit stream_reader(bytestream& input) : m_input(input), m_cur(NULL), m_end(NULL), m_consumed(0), m_compressed(false), m_done(false) {
+			m_window = (uint8*)malloc(chunk_size);
+			m_in = NULL;
+			if (!m_window)
+				throw exception("out of memory");
+#ifndef _NBT_NO_COMPRESS
+			if (input.get_position() < input.get_stream_size()) {
+				std::int8_t head = input.read();
+				input.seek_beg(input.get_position() - 1);
+				if (head == _NBT_GZIP_MAGIC) {
+					m_in = (uint8*)malloc(chunk_size);
+					if (!m_in) {
+						free(m_window);
+						throw exception("out of memory");
+					}
+					memset(&m_z, 0, sizeof(m_z));
+					if (inflateInit2(&m_z, 47) != Z_OK) {//15, add mask of 32 (1bit) to enable gz
+						free(m_in);
+						free(m_window);
+						throw exception("bad gzip compressed data");
+					}
+					m_compressed = true;
+				}
+			}
+#endif
+		}
+
+		stream_reader(const stream_reader&) = delete;
+		stream_reader& operator=(const stream_reader&) = delete;
+
+		~stream_reader() {
+#ifndef _NBT_NO_COMPRESS
+			if (m_compressed)
+				inflateEnd(&m_z);
+#endif
+			free(m_in);
+			free(m_window);
+		}
+
+		inline void read(void* dst, std::size_t n) {
+			uint8* out = (uint8*)dst;
+			while (n) {
+				if (m_cur == m_end && !refill())
+					throw exception("unexpected end of nbt data");
+				std::size_t take = std::min<std::size_t>(n, m_end - m_cur);
+				memcpy(out, m_cur, take);
+				m_cur += take;
+				m_consumed += take;
+				out += take;
+				n -= take;
+			}
+		}
+
+		template<endian E, class T>
+		inline T read_fixed() {
+			T v;
+			if ((std::size_t)(m_end - m_cur) >= sizeof(T)) {
+				memcpy(&v, m_cur, sizeof(T));
+				m_cur += sizeof(T);
+				m_consumed += sizeof(T);
+			}
+			else read(&v, sizeof(T));
+			return to_endian<E>(v);
+		}
+
+		template<class T>
+		inline T read_varuint() {
+			constexpr int max_bytes = (sizeof(T) * 8 + 6) / 7;
+			if (m_end - m_cur >= max_bytes) {
+				const uint8* p = m_cur;
+				T v = bytestream::decode_varuint<T>(p);
+				m_consumed += p - m_cur;
+				m_cur = p;
+				return v;
+			}
+			T v = 0;
+			for (int i = 0; i < max_bytes; i++) {
+				uint8 b = read_fixed<endian_little, uint8>();
+				v |= (T)(b & 0x7F) << (7 * i);
+				if (!(b & 0x80))
+					return v;
+			}
+			throw exception("varint too long");
+		}
+
+		//hands out up to max buffered bytes without copying, refilling if the window is empty
+		inline const uint8* next(std::size_t max, std::size_t& got) {
+			if (m_cur == m_end && !refill())
+				throw exception("unexpected end of nbt data");
+			got = std::min<std::size_t>(max, m_end - m_cur);
+			const uint8* p = m_cur;
+			m_cur += got;
+			m_consumed += got;
+			return p;
+		}
+
+		inline void skip(std::size_t n) {
+			std::size_t got;
+			while (n) {
+				next(n, got);
+				n -= got;
+			}
+		}
+
+		//decoded bytes handed out so far
+		uint64 get_consumed() const {
+			return m_consumed;
+		}
+
+		bool is_compressed() const {
+			return m_compressed;
+		}
+
+	private:
+
+		bool refill() {
+			if (m_done)
+				return false;
+			if (!m_compressed) {
+				uint64 left = m_input.get_stream_size() - m_input.get_position();
+				if (!left) {
+					m_done = true;
+					return false;
+				}
+				uint32 n = left < chunk_size ? (uint32)left : chunk_size;
+				m_input.read_to(m_window, n);
+				m_cur = m_window;
+				m_end = m_window + n;
+				return true;
+			}
+#ifndef _NBT_NO_COMPRESS
+			for (;;) {
+				if (m_z.avail_in == 0) {
+					uint64 left = m_input.get_stream_size() - m_input.get_position();
+					if (left) {
+						uint32 n = left < chunk_size ? (uint32)left : chunk_size;
+						m_input.read_to(m_in, n);
+						m_z.next_in = m_in;
+						m_z.avail_in = n;
+					}
+				}
+				m_z.next_out = m_window;
+				m_z.avail_out = chunk_size;
+				int stat = inflate(&m_z, Z_NO_FLUSH);
+				if (!(stat == Z_OK || stat == Z_STREAM_END || stat == Z_BUF_ERROR))
+					throw exception("bad gzip compressed data");
+				std::uint32_t produced = chunk_size - m_z.avail_out;
+				if (stat == Z_STREAM_END)
+					m_done = true;
+				if (produced) {
+					m_cur = m_window;
+					m_end = m_window + produced;
+					return true;
+				}
+				if (m_done || (stat == Z_BUF_ERROR && m_z.avail_in == 0 && m_input.get_position() == m_input.get_stream_size())) {
+					m_done = true;
+					return false;
+				}
+			}
+#else
+			return false;
+#endif
+		}
+
+		bytestream& m_input;
+		uint8* m_window;
+		uint8* m_in;
+		const uint8* m_cur;
+		const uint8* m_end;
+		uint64 m_consumed;
+		bool m_compressed;
+		bool m_done;
+#ifndef _NBT_NO_COMPRESS
+		z_stream m_z;
+#endif
+	};
+
+}
+
+#endif
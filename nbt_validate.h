@@ -0,0 +1,388 @@
+#ifndef _NBT_VALIDATE
+#define _NBT_VALIDATE
+
+#include "nbt.h"
+
+namespace nbt {
+
+	enum class validation : std::uint8_t {
+		ok,
+		truncated,//a length or value runs past the end of the data
+		bad_tag_id,
+		negative_length,
+		missing_list_type,//non empty list of TAG_End
+		too_deep,
+		too_big,//over the size_tracker style byte budget, or the inflate scratch buffer
+		too_many_nodes,
+		string_too_long,
+		bad_varint,
+		bad_compression,
+	};
+
+	struct validation_limits {
+		int max_depth = 0x200;//same rule as the decoder, containers deeper than this are rejected
+		std::int64_t max_bytes = std::numeric_limits<std::int64_t>::max();//budget counted exactly like size_tracker
+		std::uint64_t max_nodes = std::numeric_limits<std::uint64_t>::max();
+		std::uint32_t max_string = std::numeric_limits<std::uint32_t>::max();//keys and values
+	};
+
+	struct validation_result {
+		validation verdict;
+		std::uint64_t length;//encoded size of the root tag (of the inflated data for compressed input)
+		std::uint64_t error_offset;//where the walk stopped when verdict != ok
+		std::uint64_t nodes;
+		std::uint64_t budget;//bytes charged against max_bytes, equal to size_tracker::m_read after a decode
+		int max_depth;
+	};
+
+	//checks raw nbt against limits without allocating or building tags: tag ids, every length prefix
+	//against the bytes left, depth, node count, string sizes and the size_tracker byte budget.
+	//a tree that passes decodes with read_tag under a size_tracker of the same budget
+	class validator {
+	public:
+
+		validation_limits limits;
+
+		validator() = default;
+		explicit validator(const validation_limits& l) : limits(l) {}
+
+		validation_result validate(const uint8* data, std::size_t size, format fmt = format::java) const {
+			switch (fmt) {
+			case format::bedrock:
+				return walk<format::bedrock>(data, size);
+			case format::bedrock_network:
+				return walk<format::bedrock_network>(data, size);
+			default:
+				return walk<format::java>(data, size);
+			}
+		}
+
+#ifndef _NBT_NO_COMPRESS
+		//same, but gzip/zlib input is first inflated into the caller's scratch buffer. zlib's own state comes
+		//from a fixed arena inside this object, so nothing touches the heap. inflated data larger than the
+		//scratch is rejected as too_big, which also caps decompression bombs
+		validation_result validate(const uint8* data, std::size_t size, uint8* scratch, std::size_t scratch_size, format fmt = format::java) {
+			if (!size || data[0] != _NBT_GZIP_MAGIC)
+				return validate(data, size, fmt);
+			validation_result res = { validation::bad_compression, 0, 0, 0, 0, 0 };
+			m_arenaUsed = 0;
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			stream.zalloc = arena_alloc;
+			stream.zfree = arena_free;
+			stream.opaque = this;
+			if (inflateInit2(&stream, 47) != Z_OK)//15, add mask of 32 (1bit) to enable gz
+				return res;
+			stream.next_in = (Bytef*)data;
+			stream.avail_in = (uInt)size;
+			stream.next_out = scratch;
+			stream.avail_out = (uInt)scratch_size;
+			int stat = inflate(&stream, Z_FINISH);
+			std::uint64_t out = stream.total_out;
+			res.error_offset = stream.total_in;
+			inflateEnd(&stream);
+			if (stat == Z_BUF_ERROR && stream.avail_out == 0) {
+				res.verdict = validation::too_big;
+				return res;
+			}
+			if (stat != Z_STREAM_END)
+				return res;
+			return validate(scratch, (std::size_t)out, fmt);
+		}
+#endif
+
+	private:
+
+#ifndef _NBT_NO_COMPRESS
+		//inflate_state plus a 32k window, with room to spare
+		static constexpr std::size_t arena_size = 0xC000;
+		alignas(16) uint8 m_arena[arena_size];
+		std::size_t m_arenaUsed = 0;
+
+		static voidpf arena_alloc(voidpf opaque, uInt items, uInt size) {
+			validator* self = (validator*)opaque;
+			std::size_t n = ((std::size_t)items * size + 15) & ~(std::size_t)15;
+			if (self->m_arenaUsed + n > arena_size)
+				return Z_NULL;
+			voidpf p = self->m_arena + self->m_arenaUsed;
+			self->m_arenaUsed += n;
+			return p;
+		}
+
+		static void arena_free(voidpf, voidpf) {}
+#endif
+
+		static constexpr int stack_size = 0x202;
+
+		struct frame {
+			std::int8_t type;//9 or 10
+			std::int8_t element;//list element type
+			std::uint32_t remaining;
+		};
+
+		//bounds checked reads over the raw buffer. every one returns false instead of throwing
+		template<format F>
+		struct cursor {
+			const uint8* p;
+			const uint8* end;
+
+			inline bool skip(std::uint64_t n) {
+				if ((std::uint64_t)(end - p) < n)
+					return false;
+				p += n;
+				return true;
+			}
+
+			template<class T>
+			inline bool fixed(T& v) {
+				if ((std::size_t)(end - p) < sizeof(T))
+					return false;
+				memcpy(&v, p, sizeof(T));
+				v = to_endian<F == format::java ? endian_big : endian_little>(v);
+				p += sizeof(T);
+				return true;
+			}
+
+			template<class T>
+			inline bool varuint(T& v, validation& why) {
+				constexpr int max_bytes = (sizeof(T) * 8 + 6) / 7;
+				v = 0;
+				for (int i = 0; i < max_bytes; i++) {
+					if (p == end) {
+						why = validation::truncated;
+						return false;
+					}
+					uint8 b = *p++;
+					v |= (T)(b & 0x7F) << (7 * i);
+					if (!(b & 0x80))
+						return true;
+				}
+				why = validation::bad_varint;
+				return false;
+			}
+
+			inline bool string_length(std::uint32_t& len, validation& why) {
+				if constexpr (F == format::bedrock_network)
+					return varuint(len, why);
+				std::uint16_t v;
+				if (!fixed(v)) {
+					why = validation::truncated;
+					return false;
+				}
+				len = v;
+				return true;
+			}
+
+			inline bool length(std::int32_t& len, validation& why) {
+				if constexpr (F == format::bedrock_network) {
+					std::uint32_t v;
+					if (!varuint(v, why))
+						return false;
+					len = varint_codec::unzigzag(v);
+				}
+				else if (!fixed(len)) {
+					why = validation::truncated;
+					return false;
+				}
+				if (len < 0) {
+					why = validation::negative_length;
+					return false;
+				}
+				return true;
+			}
+
+			//one int/long element, a varint on the network format
+			template<class T>
+			inline bool number(validation& why) {
+				if constexpr (F == format::bedrock_network && sizeof(T) >= 4 && std::is_integral<T>::value) {
+					typename std::make_unsigned<T>::type v;
+					return varuint(v, why);
+				}
+				if (!skip(sizeof(T))) {
+					why = validation::truncated;
+					return false;
+				}
+				return true;
+			}
+		};
+
+		template<format F>
+		validation_result walk(const uint8* data, std::size_t size) const {
+			validation_result res = { validation::ok, 0, 0, 0, 0, 0 };
+			cursor<F> in = { data, data + size };
+			frame stack[stack_size];
+			int depth = 0;
+			validation why = validation::ok;
+			std::int64_t budget = 0;
+
+			//mirrors size_tracker::read, which truncates every charge to whole bytes
+			auto charge = [&](std::uint64_t bits) {
+				budget += (std::int64_t)(bits / 8);
+				return budget <= limits.max_bytes;
+			};
+			auto fail = [&](validation v) {
+				res.verdict = v;
+				res.error_offset = in.p - data;
+				res.budget = (std::uint64_t)budget;
+				return res;
+			};
+			auto string = [&](std::uint64_t bits_before) {
+				std::uint32_t len;
+				if (!charge(bits_before))
+					return validation::too_big;
+				if (!in.string_length(len, why))
+					return why;
+				if (len > limits.max_string)
+					return validation::string_too_long;
+				if (!charge(16ull * len))
+					return validation::too_big;
+				if (!in.skip(len))
+					return validation::truncated;
+				return validation::ok;
+			};
+
+			//payload of one tag at depth d. containers push a frame and are finished by the loop below
+			auto value = [&](std::int8_t id, int d) {
+				if (++res.nodes > limits.max_nodes)
+					return validation::too_many_nodes;
+				if (d > res.max_depth)
+					res.max_depth = d;
+				switch (id) {
+				case 0:
+					return charge(64) ? validation::ok : validation::too_big;
+				case 1:
+					if (!charge(72)) return validation::too_big;
+					return in.template number<std::int8_t>(why) ? validation::ok : why;
+				case 2:
+					if (!charge(80)) return validation::too_big;
+					return in.template number<std::int16_t>(why) ? validation::ok : why;
+				case 3:
+					if (!charge(96)) return validation::too_big;
+					return in.template number<std::int32_t>(why) ? validation::ok : why;
+				case 4:
+					if (!charge(128)) return validation::too_big;
+					return in.template number<std::int64_t>(why) ? validation::ok : why;
+				case 5:
+					if (!charge(96)) return validation::too_big;
+					return in.template number<float>(why) ? validation::ok : why;
+				case 6:
+					if (!charge(128)) return validation::too_big;
+					return in.template number<double>(why) ? validation::ok : why;
+				case 7:
+				case 11:
+				case 12: {
+					std::int32_t len;
+					if (!charge(192))
+						return validation::too_big;
+					if (!in.length(len, why))
+						return why;
+					std::uint64_t width = id == 7 ? 1 : id == 11 ? 4 : 8;
+					if (len && !charge(8ull * width * len))
+						return validation::too_big;
+					if (F == format::bedrock_network && id != 7) {
+						for (std::int32_t i = 0; i < len; i++) {
+							bool good = id == 11 ? in.template number<std::int32_t>(why) : in.template number<std::int64_t>(why);
+							if (!good)
+								return why;
+						}
+						return validation::ok;
+					}
+					return in.skip(width * (std::uint64_t)len) ? validation::ok : validation::truncated;
+				}
+				case 8:
+					return string(36 * 8);
+				case 9: {
+					if (!charge(296))
+						return validation::too_big;
+					if (d > limits.max_depth || depth == stack_size)
+						return validation::too_deep;
+					std::int8_t element;
+					std::int32_t len;
+					if (!in.fixed(element))
+						return validation::truncated;
+					if (!in.length(len, why))
+						return why;
+					if (element == 0 && len > 0)
+						return validation::missing_list_type;
+					if (element < 0 || element > 12)
+						return validation::bad_tag_id;
+					if (!charge(len * 32ull))
+						return validation::too_big;
+					frame& f = stack[depth++];
+					f.type = 9;
+					f.element = element;
+					f.remaining = (std::uint32_t)len;
+					return validation::ok;
+				}
+				case 10: {
+					if (!charge(384))
+						return validation::too_big;
+					if (d > limits.max_depth || depth == stack_size)
+						return validation::too_deep;
+					frame& f = stack[depth++];
+					f.type = 10;
+					f.element = 0;
+					f.remaining = 0;
+					return validation::ok;
+				}
+				default:
+					return validation::bad_tag_id;
+				}
+			};
+
+			std::int8_t root;
+			std::uint32_t name;
+			if (!in.fixed(root))
+				return fail(validation::truncated);
+			if (root < 0 || root > 12)
+				return fail(validation::bad_tag_id);
+			if (!in.string_length(name, why))
+				return fail(why);
+			if (!in.skip(name))
+				return fail(validation::truncated);
+			validation v = value(root, 0);
+			if (v != validation::ok)
+				return fail(v);
+			while (depth) {
+				frame& top = stack[depth - 1];
+				int d = depth;//children of the frame at index depth-1 sit at depth `depth`
+				if (top.type == 10) {
+					std::int8_t id;
+					if (!in.fixed(id))
+						return fail(validation::truncated);
+					if (id == 0) {
+						depth--;
+						continue;
+					}
+					if (id < 0 || id > 12)
+						return fail(validation::bad_tag_id);
+					if ((v = string(36 * 8)) != validation::ok)
+						return fail(v);
+					if ((v = value(id, d)) != validation::ok)
+						return fail(v);
+					if (!charge(288))
+						return fail(validation::too_big);
+				}
+				else {
+					if (top.remaining == 0) {
+						depth--;
+						continue;
+					}
+					top.remaining--;
+					if ((v = value(top.element, d)) != validation::ok)
+						return fail(v);
+				}
+			}
+			res.length = in.p - data;
+			res.budget = (std::uint64_t)budget;
+			return res;
+		}
+	};
+
+	inline validation_result validate_nbt(const uint8* data, std::size_t size, format fmt = format::java, const validation_limits& limits = validation_limits()) {
+		return validator(limits).validate(data, size, fmt);
+	}
+
+}
+
+#endif
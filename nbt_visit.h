@@ -0,0 +1,321 @@
+#ifndef _NBT_VISIT
+#define _NBT_VISIT
+
+#include "nbt.h"
+#include <type_traits>
+#include <utility>
+
+namespace nbt {
+
+	//tag class of an id, and the id of a tag class
+	template<std::int8_t Id> struct tag_type;
+	template<class T> struct tag_id;
+
+#define _NBT_TAG_TYPE(ID, T) \
+	template<> struct tag_type<ID> { typedef T type; }; \
+	template<> struct tag_id<T> { static constexpr std::int8_t value = ID; };
+
+	_NBT_TAG_TYPE(0, tag_end)
+	_NBT_TAG_TYPE(1, tag_byte)
+	_NBT_TAG_TYPE(2, tag_short)
+	_NBT_TAG_TYPE(3, tag_int)
+	_NBT_TAG_TYPE(4, tag_long)
+	_NBT_TAG_TYPE(5, tag_float)
+	_NBT_TAG_TYPE(6, tag_double)
+	_NBT_TAG_TYPE(7, tag_bytearray)
+	_NBT_TAG_TYPE(8, tag_string)
+	_NBT_TAG_TYPE(9, tag_list)
+	_NBT_TAG_TYPE(10, tag_compound)
+	_NBT_TAG_TYPE(11, tag_intarray)
+	_NBT_TAG_TYPE(12, tag_longarray)
+
+#undef _NBT_TAG_TYPE
+
+	//several handlers in one: for_each(tree, overload{ [](tag_int& i) { ... }, [](tag_string& s) { ... } })
+	template<class... F>
+	struct overload : F... {
+		using F::operator()...;
+	};
+
+	template<class... F>
+	overload(F...) -> overload<F...>;
+
+	//what a for_each handler returns, a handler returning void always goes on
+	enum class walk {
+		next,
+		skip,//not into this tag's children
+		stop,
+	};
+
+	namespace visit_detail {
+
+		//T with the constness of B
+		template<class B, class T>
+		using like = typename std::conditional<std::is_const<B>::value, const T, T>::type;
+
+		template<class T>
+		static constexpr bool is_container = std::is_same<typename std::remove_const<T>::type, tag_compound>::value
+			|| std::is_same<typename std::remove_const<T>::type, tag_list>::value;
+
+		template<class R, class T, class B, class F>
+		inline R call(B* tag, F& f) {
+			return f(*tag_cast<T>(tag));
+		}
+
+		template<class B, class F, std::size_t... I>
+		inline decltype(auto) dispatch(B* tag, F& f, std::index_sequence<I...>) {
+			typedef decltype(f(std::declval<like<B, tag_end>&>())) R;
+			static constexpr R(*const table[])(B*, F&) = { &call<R, like<B, typename tag_type<(std::int8_t)I>::type>, B, F>... };
+			return table[(std::uint8_t)tag->get_id()](tag, f);
+		}
+
+	}
+
+	//calls f with tag as its own class (tag_int&, tag_compound&, ...) through a table over the 13 types built at
+	//compile time: one virtual call for the id, no dynamic_cast. f must take all of them and return the same type
+	template<class F>
+	inline decltype(auto) visit(base* tag, F&& f) {
+		return visit_detail::dispatch(tag, f, std::make_index_sequence<13>());
+	}
+
+	template<class F>
+	inline decltype(auto) visit(const base* tag, F&& f) {
+		return visit_detail::dispatch(tag, f, std::make_index_sequence<13>());
+	}
+
+	namespace visit_detail {
+
+		template<class F, class T>
+		inline walk apply(F& f, T& tag) {
+			if constexpr (!std::is_invocable<F&, T&>::value)
+				return walk::next;
+			else if constexpr (std::is_void<typename std::invoke_result<F&, T&>::type>::value) {
+				f(tag);
+				return walk::next;
+			}
+			else return f(tag);
+		}
+
+		template<class T, class F>
+		inline walk walk_as(T& tag, F& f);
+
+		template<class B, class F>
+		inline walk walk_any(B* tag, F& f) {
+			return visit(tag, [&f](auto& t) { return walk_as(t, f); });
+		}
+
+		//elements all have the list's type, so they are dispatched once for the whole list
+		template<class L, class T, class F>
+		inline walk walk_elements(L& list, F& f) {
+			typedef like<L, T> E;
+			if constexpr (!std::is_invocable<F&, E&>::value && !is_container<T>)
+				return walk::next;//nothing in there f takes
+			else {
+				for (base* tag : list.get_tags())
+					if (walk_as(*tag_cast<E>(tag), f) == walk::stop)
+						return walk::stop;
+				return walk::next;
+			}
+		}
+
+		template<class L, class F, std::size_t... I>
+		inline walk walk_list(L& list, F& f, std::index_sequence<I...>) {
+			static constexpr walk(*const table[])(L&, F&) = { &walk_elements<L, typename tag_type<(std::int8_t)I>::type, F>... };
+			if (!list.size())
+				return walk::next;
+			return table[(std::uint8_t)list.get_tag_type()](list, f);
+		}
+
+		template<class T, class F>
+		inline walk walk_as(T& tag, F& f) {
+			walk w = apply(f, tag);
+			if (w != walk::next)
+				return w == walk::stop ? walk::stop : walk::next;
+			typedef typename std::remove_const<T>::type U;
+			if constexpr (std::is_same<U, tag_compound>::value) {
+				for (auto& entry : tag.m_tagMap)
+					if (walk_any(static_cast<like<T, base>*>(entry.second), f) == walk::stop)
+						return walk::stop;
+			}
+			else if constexpr (std::is_same<U, tag_list>::value)
+				return walk_list(tag, f, std::make_index_sequence<13>());
+			return walk::next;
+		}
+
+		//handler that is only callable with the classes pred takes, so lists of other types are still skipped
+		template<class F, class B>
+		struct finder {
+			F& pred;
+			B*& found;
+
+			template<class T, class = typename std::enable_if<std::is_invocable<F&, T&>::value>::type>
+			walk operator()(T& tag) {
+				if (!pred(tag))
+					return walk::next;
+				found = &tag;
+				return walk::stop;
+			}
+		};
+
+		template<class F>
+		struct counter {
+			F& pred;
+			std::size_t& n;
+
+			template<class T, class = typename std::enable_if<std::is_invocable<F&, T&>::value>::type>
+			void operator()(T& tag) {
+				if (pred(tag))
+					n++;
+			}
+		};
+
+		template<class T, class F>
+		inline base* transform_as(T& tag, F& f);
+
+		template<class F>
+		inline base* transform_any(base* tag, F& f) {
+			return visit(tag, [&f](auto& t) { return transform_as(t, f); });
+		}
+
+		//puts the non NULL replacements in out (one slot per element) into list, if it still has one element type
+		//afterwards. otherwise they are all deleted and an exception thrown
+		inline void replace_elements(tag_list& list, std::vector<base*>& out) {
+			std::int8_t type = out[0] ? out[0]->get_id() : list.get_tag_type();
+			bool uniform = type != 0;
+			for (base* r : out)
+				uniform = uniform && (r ? r->get_id() : list.get_tag_type()) == type;
+			if (!uniform) {
+				for (base* r : out)
+					delete r;
+				throw exception("transform would leave a list with mixed or end elements");
+			}
+			if (type == list.get_tag_type()) {
+				for (std::size_t i = 0; i < out.size(); i++)
+					if (out[i])
+						delete list.replace_tag(i, out[i]);
+			}
+			else {//every element was replaced
+				list.clear();
+				for (base* r : out)
+					list.append_tag(r);
+			}
+		}
+
+		//replacements are collected and only put in once the whole list is done
+		template<class T, class F>
+		inline void transform_elements(tag_list& list, F& f) {
+			if constexpr (std::is_invocable<F&, T&>::value || is_container<T>) {
+				const std::vector<base*>& tags = list.get_tags();
+				std::vector<base*> out;
+				try {
+					for (std::size_t i = 0; i < tags.size(); i++) {
+						base* r = transform_as(*tag_cast<T>(tags[i]), f);
+						if (r && r != tags[i]) {
+							out.resize(tags.size());
+							out[i] = r;
+						}
+					}
+				}
+				catch (...) {
+					for (base* r : out)
+						delete r;
+					throw;
+				}
+				if (!out.empty())
+					replace_elements(list, out);
+			}
+		}
+
+		template<class F, std::size_t... I>
+		inline void transform_list(tag_list& list, F& f, std::index_sequence<I...>) {
+			static constexpr void(*const table[])(tag_list&, F&) = { &transform_elements<typename tag_type<(std::int8_t)I>::type, F>... };
+			if (list.size())
+				table[(std::uint8_t)list.get_tag_type()](list, f);
+		}
+
+		template<class T, class F>
+		inline void transform_children(T& tag, F& f) {
+			if constexpr (std::is_same<T, tag_compound>::value) {
+				for (auto& entry : tag.m_tagMap) {
+					base* r = transform_any(entry.second, f);
+					if (r && r != entry.second) {
+						delete entry.second;
+						entry.second = r;
+					}
+				}
+			}
+			else if constexpr (std::is_same<T, tag_list>::value)
+				transform_list(tag, f, std::make_index_sequence<13>());
+		}
+
+		//children first, then f on tag. the replacement f gives, or NULL
+		template<class T, class F>
+		inline base* transform_as(T& tag, F& f) {
+			transform_children(tag, f);
+			if constexpr (std::is_invocable<F&, T&>::value)
+				return f(tag);
+			else return NULL;
+		}
+
+	}
+
+	//calls f on tag and everything below it, parents before children. f takes the tag classes it is interested
+	//in (the others are passed over, lists of them are not even iterated) and returns void or a walk. on a
+	//const tree f must take const references. false if f stopped the walk
+	template<class F>
+	inline bool for_each(base* tag, F&& f) {
+		return visit_detail::walk_any(tag, f) != walk::stop;
+	}
+
+	template<class F>
+	inline bool for_each(const base* tag, F&& f) {
+		return visit_detail::walk_any(tag, f) != walk::stop;
+	}
+
+	//first tag, parents before children, that pred accepts. pred takes the classes it wants and returns bool.
+	//NULL if there is none
+	template<class F>
+	inline base* find_if(base* tag, F&& pred) {
+		base* found = NULL;
+		visit_detail::finder<F, base> finder{ pred, found };
+		visit_detail::walk_any(tag, finder);
+		return found;
+	}
+
+	template<class F>
+	inline const base* find_if(const base* tag, F&& pred) {
+		const base* found = NULL;
+		visit_detail::finder<F, const base> finder{ pred, found };
+		visit_detail::walk_any(tag, finder);
+		return found;
+	}
+
+	//tags pred accepts, same rules as find_if
+	template<class F>
+	inline std::size_t count(base* tag, F&& pred) {
+		std::size_t n = 0;
+		visit_detail::counter<F> counter{ pred, n };
+		visit_detail::walk_any(tag, counter);
+		return n;
+	}
+
+	template<class F>
+	inline std::size_t count(const base* tag, F&& pred) {
+		std::size_t n = 0;
+		visit_detail::counter<F> counter{ pred, n };
+		visit_detail::walk_any(tag, counter);
+		return n;
+	}
+
+	//replaces tags below root, children before their parent. f takes the classes it wants and returns a new tag
+	//to put in place of the one passed, which is then deleted, or NULL to keep it. replacements are not walked
+	//into. list elements can change type only all together, otherwise the list is left alone and an exception
+	//thrown. root itself is never replaced
+	template<class F>
+	inline void transform(base* root, F&& f) {
+		visit(root, [&f](auto& t) { visit_detail::transform_children(t, f); });
+	}
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+//shared by the tests. CHECK reports and counts a failure and carries on, main returns the count so ctest
+//sees a nonzero exit. not assert: the default build is Release, which defines NDEBUG
+
+#include "../nbt.h"
+#include "../nbt_diff.h"
+#include "../bench/corpus.h"
+#include <cstdio>
+#include <vector>
+
+using namespace nbt;
+
+static int g_failures = 0;
+
+#define CHECK(x) do { if (!(x)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #x); g_failures++; } } while (0)
+
+//the corpus samples, caller deletes them
+inline std::vector<base*> sample_trees() {
+	return { nbt_corpus::level_dat(1), nbt_corpus::player(2), nbt_corpus::chunk(3), nbt_corpus::entity_chunk(4, 40) };
+}
+
+inline std::vector<uint8> encode(base* tag, format fmt = format::java) {
+	byteoutstream output;
+	write_tag(output, tag, fmt);
+	return std::vector<uint8>(output.get_buffer(), output.get_buffer() + output.get_position());
+}
+
+inline base* decode(const std::vector<uint8>& data, format fmt = format::java) {
+	bytestream input((uint8*)data.data(), data.size());
+	input.keep_buffer(true);
+	size_tracker tracker(INT64_MAX);
+	return read_tag(input, tracker, fmt);
+}
@@ -0,0 +1,82 @@
+//round trips the corpus through every wire format, plain and compressed
+
+#include "check.h"
+#include "../nbt_deflate.h"
+
+int main() {
+	std::vector<base*> trees = sample_trees();
+	for (base* tree : trees) {
+		for (format fmt : { format::java, format::bedrock, format::bedrock_network }) {
+			std::vector<uint8> data = encode(tree, fmt);
+			base* back = decode(data, fmt);
+			CHECK(equal(back, tree));
+			CHECK(encode(back, fmt).size() == data.size());//compounds are unordered, so only the size is stable
+			delete back;
+
+			for (deflate_wrapper wrapper : { deflate_wrapper::gzip, deflate_wrapper::zlib }) {
+				for (unsigned threads : { 1u, 0u }) {
+					deflate_options options;
+					options.wrapper = wrapper;
+					options.threads = threads;
+					options.block_size = 0x4000;//several blocks even for the small samples
+					byteoutstream output;
+					write_tag(output, tree, fmt, options);
+					std::vector<uint8> packed(output.get_buffer(), output.get_buffer() + output.get_position());
+					if (wrapper == deflate_wrapper::gzip) {//read_tag only detects gzip
+						back = decode(packed, fmt);
+						CHECK(equal(back, tree));
+						delete back;
+					}
+					uLongf size = (uLongf)data.size();
+					std::vector<uint8> raw(data.size());
+					z_stream z = {};
+					CHECK(inflateInit2(&z, wrapper == deflate_wrapper::gzip ? 31 : 15) == Z_OK);
+					z.next_in = packed.data();
+					z.avail_in = (uInt)packed.size();
+					z.next_out = raw.data();
+					z.avail_out = (uInt)size;
+					CHECK(inflate(&z, Z_FINISH) == Z_STREAM_END);
+					inflateEnd(&z);
+					CHECK(raw == data);
+				}
+			}
+		}
+
+		//translating between formats keeps the tree
+		base* bedrock = decode(encode(tree, format::bedrock), format::bedrock);
+		base* java = decode(encode(bedrock, format::java), format::java);
+		CHECK(equal(java, tree));
+		delete bedrock;
+		delete java;
+	}
+
+	//bedrock level.dat has its own header
+	tag_compound* level = static_cast<tag_compound*>(trees[0]);
+	byteoutstream output;
+	write_bedrock_level(output, level, 10);
+	std::vector<uint8> data(output.get_buffer(), output.get_buffer() + output.get_position());
+	bytestream input(data.data(), data.size());
+	input.keep_buffer(true);
+	tag_compound back;
+	CHECK(read_bedrock_level(input, back) == 10);
+	CHECK(equal(&back, level));
+
+	//corrupt input throws instead of crashing
+	std::vector<uint8> bad = encode(trees[2]);
+	bad.resize(bad.size() / 2);
+	bool threw = false;
+	try {
+		delete decode(bad);
+	}
+	catch (const std::exception&) {
+		threw = true;
+	}
+	catch (const char*) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	for (base* tree : trees)
+		delete tree;
+	return g_failures;
+}
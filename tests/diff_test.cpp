@@ -0,0 +1,90 @@
+//patches between edited clones apply back to the target, and stay small for small edits
+
+#include "check.h"
+
+static tag_int* make_int(int v) {
+	tag_int* t = new tag_int();
+	t->m_data = v;
+	return t;
+}
+
+static tag_list* entities(base* chunk) {
+	return static_cast<tag_list*>(static_cast<tag_compound*>(chunk)->m_tagMap["Entities"]);
+}
+
+//patch from a to b, applied to a clone of a. returns the patch size
+static std::size_t round_trip(base* a, base* b) {
+	tree_patch patch = make_patch(a, b);
+	CHECK(patch.empty() == equal(a, b));
+	base* c = a->clone();
+	apply_patch(c, patch);
+	CHECK(equal(c, b));
+	delete c;
+	return patch.size();
+}
+
+int main() {
+	std::vector<base*> trees = sample_trees();
+	for (base* tree : trees) {
+		base* copy = tree->clone();
+		CHECK(equal(copy, tree) && hash_tree(copy) == hash_tree(tree));
+		CHECK(make_patch(tree, copy).empty());
+		static_cast<tag_compound*>(copy)->m_tagMap["added"] = make_int(1);
+		round_trip(tree, copy);
+		delete copy;
+	}
+
+	//one entity moved costs about its own size, not the list
+	base* chunk = nbt_corpus::entity_chunk(1, 300);
+	std::size_t full = encode(chunk).size();
+	base* moved = chunk->clone();
+	tag_list* list = entities(moved);
+	base* first = list->get_tags()[0]->clone();
+	list->erase_tags(0, 1);
+	list->append_tag(first);
+	CHECK(round_trip(chunk, moved) < full / 50);
+	delete moved;
+
+	//a few edits in a list of compounds
+	base* edited = chunk->clone();
+	list = entities(edited);
+	list->erase_tags(10, 2);
+	base*& air = static_cast<tag_compound*>(list->get_tags()[50])->m_tagMap["Air"];
+	delete air;
+	air = make_int(7);
+	list->insert_tag(100, list->get_tags()[5]->clone());
+	CHECK(round_trip(chunk, edited) < full / 20);
+	delete edited;
+	delete chunk;
+
+	//int lists with repeated values, shuffled around
+	std::uint64_t seed = 1;
+	auto next = [&seed] { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return (std::size_t)(seed >> 33); };
+	for (int round = 0; round < 200; round++) {
+		tag_list* a = new tag_list();
+		for (std::size_t i = 0, n = next() % 50; i < n; i++)
+			a->append_tag(make_int((int)(next() % 6)));
+		tag_list* b = static_cast<tag_list*>(a->clone());
+		for (std::size_t k = 0, n = next() % 8; k < n; k++) {
+			if (b->size() && next() % 2)
+				b->erase_tags(next() % b->size(), 1);
+			else b->insert_tag(next() % (b->size() + 1), make_int((int)(next() % 6)));
+		}
+		round_trip(a, b);
+		delete a;
+		delete b;
+	}
+
+	//an emptied list takes the target's element type
+	tag_list* a = new tag_list();
+	a->append_tag(make_int(1));
+	tag_list* b = new tag_list();
+	b->set_tag_type(10);
+	round_trip(a, b);
+	delete a;
+	delete b;
+
+	for (base* tree : trees)
+		delete tree;
+	return g_failures;
+}
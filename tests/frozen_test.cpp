@@ -0,0 +1,75 @@
+//frozen images written, verified, read in place and thawed, and crafted images rejected
+
+#include "check.h"
+#include "../nbt_frozen.h"
+
+int main() {
+	std::vector<base*> trees = sample_trees();
+	for (base* tree : trees) {
+		byteoutstream output;
+		write_frozen(output, tree);
+		std::vector<std::uint64_t> image((output.get_position() + 7) / 8);//8 aligned
+		memcpy(image.data(), output.get_buffer(), (std::size_t)output.get_position());
+		frozen_tree frozen;
+		frozen.open(image.data(), (std::size_t)output.get_position());
+		CHECK(frozen.verify());
+		base* back = thaw(frozen.root());
+		CHECK(equal(back, tree));
+		delete back;
+
+		//flipping bytes must never crash verify, and what passes must thaw
+		for (std::size_t i = 0; i < 200; i++) {
+			std::vector<std::uint64_t> bad = image;
+			((uint8*)bad.data())[(i * 7919) % output.get_position()] ^= (uint8)(i | 1);
+			frozen_tree f;
+			try {
+				f.open(bad.data(), (std::size_t)output.get_position());
+			}
+			catch (const std::exception&) {
+				continue;
+			}
+			if (f.verify())
+				delete thaw(f.root());
+		}
+	}
+
+	//lookups in place
+	byteoutstream output;
+	write_frozen(output, trees[1]);
+	std::vector<std::uint64_t> image((output.get_position() + 7) / 8);
+	memcpy(image.data(), output.get_buffer(), (std::size_t)output.get_position());
+	frozen_tree frozen;
+	frozen.open(image.data(), (std::size_t)output.get_position());
+	frozen_compound player = frozen.root().get_compound();
+	CHECK(player["DataVersion"].get<std::int32_t>() == 3465);
+	CHECK(player["Pos"].get_list().size() == 3);
+	CHECK(!player.find("missing").valid());
+
+	//every list holds two offsets to the one before it. walking shared siblings as a tree would take 2^40 steps
+	std::vector<std::uint64_t> chain(4 + 2 * 40);
+	uint8* p = (uint8*)chain.data();
+	frozen_layout::header* h = (frozen_layout::header*)p;
+	memcpy(h->magic, frozen_layout::magic, 4);
+	h->version = frozen_layout::version;
+	h->endian = endian_native;
+	h->root_type = 9;
+	std::uint64_t at = sizeof(frozen_layout::header), prev = at;
+	at += sizeof(frozen_layout::block);//empty list
+	for (int i = 0; i < 40; i++, at += 16) {
+		frozen_layout::block* b = (frozen_layout::block*)(p + at);
+		b->count = 2;
+		b->type = 9;
+		std::uint32_t* items = (std::uint32_t*)(b + 1);
+		items[0] = items[1] = (std::uint32_t)prev;
+		prev = at;
+	}
+	h->size = at;
+	h->root = prev;
+	frozen_tree crafted;
+	crafted.open(p, (std::size_t)at);
+	CHECK(!crafted.verify());
+
+	for (base* tree : trees)
+		delete tree;
+	return g_failures;
+}
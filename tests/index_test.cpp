@@ -0,0 +1,109 @@
+//a small world indexed, queried, saved, loaded and updated after a region changes
+
+#include "check.h"
+#include "../nbt_index.h"
+#include <map>
+#include <set>
+
+namespace fs = std::filesystem;
+
+typedef std::set<std::tuple<std::uint32_t, std::int32_t, std::int32_t>> chunk_set;
+
+static void put_be(std::vector<uint8>& v, std::size_t at, std::uint32_t x) {
+	v[at] = (uint8)(x >> 24);
+	v[at + 1] = (uint8)(x >> 16);
+	v[at + 2] = (uint8)(x >> 8);
+	v[at + 3] = (uint8)x;
+}
+
+//region r.0.0.mca with the chunks zlib compressed, one per slot
+static void write_region(const fs::path& dir, const std::map<int, base*>& chunks, std::uint32_t stamp) {
+	std::vector<uint8> file(2 * index_detail::sector);
+	for (auto& [slot, tree] : chunks) {
+		std::vector<uint8> raw = encode(tree);
+		uLongf size = compressBound((uLong)raw.size());
+		std::vector<uint8> packed(5 + size);
+		compress2(packed.data() + 5, &size, raw.data(), (uLong)raw.size(), 6);
+		packed.resize(5 + size);
+		put_be(packed, 0, (std::uint32_t)size + 1);
+		packed[4] = 2;
+		std::size_t at = file.size(), sectors = (packed.size() + index_detail::sector - 1) / index_detail::sector;
+		file.resize(at + sectors * index_detail::sector);
+		memcpy(file.data() + at, packed.data(), packed.size());
+		put_be(file, slot * 4, (std::uint32_t)(at / index_detail::sector << 8 | sectors));
+		put_be(file, index_detail::sector + slot * 4, stamp);
+	}
+	FILE* f = fopen((dir / "r.0.0.mca").string().c_str(), "wb");
+	fwrite(file.data(), 1, file.size(), f);
+	fclose(f);
+}
+
+//entity ids of the chunks in directory 1, as the index should have them
+static std::map<std::string, chunk_set> expected_ids(const std::map<int, base*>& chunks) {
+	std::map<std::string, chunk_set> ids;
+	for (auto& [slot, tree] : chunks) {
+		tag_list* list = static_cast<tag_list*>(static_cast<tag_compound*>(tree)->m_tagMap["Entities"]);
+		for (base* e : list->get_tags())
+			ids[static_cast<tag_string*>(static_cast<tag_compound*>(e)->m_tagMap["id"])->m_data].insert({ 1u, slot % 32, slot / 32 });
+	}
+	return ids;
+}
+
+static void check_ids(const world_index& index, const std::map<std::string, chunk_set>& ids) {
+	for (auto& [id, expected] : ids) {
+		chunk_set got;
+		for (const chunk_key& k : index.find(1, id))
+			got.insert({ k.region, k.x, k.z });
+		CHECK(got == expected);
+	}
+}
+
+int main() {
+	fs::path root = fs::temp_directory_path() / "nbt_index_test";
+	fs::remove_all(root);
+	fs::create_directories(root / "region");
+	fs::create_directories(root / "entities");
+
+	std::map<int, base*> terrain, mobs;
+	for (int slot : { 0, 1, 33, 1023 })
+		terrain[slot] = nbt_corpus::chunk(slot);
+	for (int slot : { 0, 5, 64 })
+		mobs[slot] = nbt_corpus::entity_chunk(slot, 10);
+	write_region(root / "region", terrain, 100);
+	write_region(root / "entities", mobs, 100);
+
+	std::vector<field_path> fields = { { "Status" }, { "Entities", path_step::each, "id" }, { "DataVersion" } };
+	std::vector<std::string> dirs = { (root / "region").string(), (root / "entities").string() };
+	task_pool pool(2);
+	world_index index(fields, dirs);
+	index_update u = index.update(pool);
+	CHECK(u.regions_read == 2 && u.chunks_failed == 0);
+	CHECK(index.find(0, "minecraft:full").size() == terrain.size());
+	CHECK(index.find(2, 3465).size() == terrain.size() + mobs.size());
+	CHECK(index.find(0, "minecraft:missing").empty());
+	check_ids(index, expected_ids(mobs));
+
+	u = index.update(pool);
+	CHECK(u.regions_read == 0 && u.regions_skipped == 2);
+
+	std::string saved = (root / "index.bin").string();
+	index.save(saved);
+	world_index loaded(fields, dirs);
+	CHECK(loaded.load(saved));
+	check_ids(loaded, expected_ids(mobs));
+
+	//a new chunk with a newer timestamp, the file's time moved so the update rereads it
+	mobs[200] = nbt_corpus::entity_chunk(200, 10);
+	write_region(root / "entities", mobs, 200);
+	fs::last_write_time(root / "entities" / "r.0.0.mca", fs::file_time_type::clock::now() + std::chrono::hours(1));
+	u = loaded.update(pool);
+	CHECK(u.regions_read == 1 && u.regions_skipped == 1);
+	check_ids(loaded, expected_ids(mobs));
+
+	for (auto& [slot, tree] : terrain)
+		delete tree;
+	for (auto& [slot, tree] : mobs)
+		delete tree;
+	fs::remove_all(root);
+	return g_failures;
+}
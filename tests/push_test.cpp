@@ -0,0 +1,60 @@
+//push_parser fed in pieces of every size gives the same tree as read_tag
+
+#include "check.h"
+#include "../nbt_push.h"
+
+//feeds data in pieces of step bytes (0: pieces of varying size), returns the tree or NULL
+static base* feed_all(const uint8* data, std::size_t size, format fmt, std::size_t step, std::size_t& used) {
+	push_parser parser(fmt);
+	used = 0;
+	for (std::size_t piece = 1; used < size && !parser.done(); piece = piece * 3 % 257 + 1) {
+		std::size_t n = step ? step : piece;
+		if (n > size - used)
+			n = size - used;
+		used += parser.feed(data + used, n);
+	}
+	return parser.done() ? parser.release() : NULL;
+}
+
+int main() {
+	std::vector<base*> trees = sample_trees();
+	tag_compound* edge = new tag_compound();
+	tag_list* typed = new tag_list();
+	typed->set_tag_type(3);
+	edge->m_tagMap["empty_list"] = typed;
+	edge->m_tagMap["empty_string"] = new tag_string();
+	edge->m_tagMap["empty_bytes"] = new tag_bytearray();
+	trees.push_back(edge);
+
+	for (format fmt : { format::java, format::bedrock, format::bedrock_network }) {
+		for (base* tree : trees) {
+			std::vector<uint8> data = encode(tree, fmt);
+			for (std::size_t step : { (std::size_t)1, (std::size_t)0, data.size() }) {
+				std::size_t used;
+				base* back = feed_all(data.data(), data.size(), fmt, step, used);
+				CHECK(back && equal(back, tree) && used == data.size());
+				delete back;
+			}
+
+			//two messages in one buffer, the parser stops at the end of the first
+			std::vector<uint8> two = data;
+			two.insert(two.end(), data.begin(), data.end());
+			push_parser parser(fmt);
+			CHECK(parser.feed(two.data(), two.size()) == data.size() && parser.done());
+			base* a = parser.release();
+			CHECK(parser.feed(two.data() + data.size(), data.size()) == data.size() && parser.done());
+			base* b = parser.release();
+			CHECK(equal(a, tree) && equal(b, tree));
+			delete a;
+			delete b;
+
+			//a truncated message is never done
+			std::size_t used;
+			CHECK(!feed_all(data.data(), data.size() - 1, fmt, 7, used));
+		}
+	}
+
+	for (base* tree : trees)
+		delete tree;
+	return g_failures;
+}
@@ -0,0 +1,97 @@
+//snbt printed and parsed back, and json output for known input
+
+#include "check.h"
+#include "../nbt_snbt.h"
+#include "../nbt_json.h"
+
+static std::string to_json(base* tag, const json_options& options = json_options()) {
+	std::vector<uint8> data = encode(tag, options.fmt);
+	bytestream input(data.data(), data.size());
+	input.keep_buffer(true);
+	byteoutstream output;
+	nbt_to_json(input, output, options);
+	return std::string((const char*)output.get_buffer(), (std::size_t)output.get_position());
+}
+
+int main() {
+	std::vector<base*> trees = sample_trees();
+	for (base* tree : trees) {
+		std::string text = to_snbt(tree);
+		base* copy = parse_snbt(text);
+		CHECK(equal(copy, tree));
+		CHECK(to_snbt(copy).size() == text.size());
+		delete copy;
+	}
+	for (base* tree : trees)
+		delete tree;
+
+	//one key per compound, so the output order is fixed
+	base* tag = parse_snbt("{a:[{s:\"x\\\"y\"},{b:1b},{l:[1.5d,2.0d]},{ia:[I;1,2]},{c:{}},{n:-7L}]}");
+	CHECK(to_json(tag) == "{\"a\":[{\"s\":\"x\\\"y\"},{\"b\":1},{\"l\":[1.5,2]},{\"ia\":[1,2]},{\"c\":{}},{\"n\":-7}]}");
+	json_options options;
+	options.fmt = format::bedrock_network;
+	CHECK(to_json(tag, options) == to_json(tag));
+	delete tag;
+
+	//spaces inside the array prefix
+	tag = parse_snbt("{a:[I ; 1, 2],b:[ B;1b],c:[L;]}");
+	base* spaced = parse_snbt("{a:[I;1,2],b:[B;1b],c:[L;]}");
+	CHECK(equal(tag, spaced));
+	delete tag;
+	delete spaced;
+
+	//non-finite values read back as the same numbers
+	tag_compound* odd = new tag_compound();
+	float values[] = { std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+	for (int i = 0; i < 3; i++) {
+		tag_float* f = new tag_float();
+		f->m_data = values[i];
+		odd->m_tagMap["f" + std::to_string(i)] = f;
+		tag_double* d = new tag_double();
+		d->m_data = values[i];
+		odd->m_tagMap["d" + std::to_string(i)] = d;
+	}
+	base* back = parse_snbt(to_snbt(odd));
+	CHECK(equal(back, odd));
+	delete back;
+	delete odd;
+
+	//modified utf-8 comes out as standard utf-8: the encoded nul and a surrogate pair are escaped
+	tag_compound* text = new tag_compound();
+	tag_string* s = new tag_string();
+	s->m_data = "\xC0\x80\xED\xA0\xBD\xED\xB8\x80";
+	text->m_tagMap["s"] = s;
+	CHECK(to_json(text) == "{\"s\":\"\\u0000\\ud83d\\ude00\"}");
+	delete text;
+
+	//sequences split by the reader window are kept whole
+	text = new tag_compound();
+	std::string euros;
+	for (int i = 0; i < 20000; i++)
+		euros += "\xE2\x82\xAC";
+	for (int i = 0; i < 4; i++) {
+		s = new tag_string();
+		s->m_data = std::string(i + 1, 'a') + euros;
+		text->m_tagMap["s" + std::to_string(i)] = s;
+	}
+	std::string json = to_json(text);
+	CHECK(json.find("\\ufffd") == std::string::npos);
+	std::size_t count = 0;
+	for (std::size_t at = json.find(euros); at != std::string::npos; at = json.find(euros, at + 1))
+		count++;
+	CHECK(count == 4);
+	delete text;
+
+	//malformed snbt throws
+	for (const char* bad : { "{a:", "[I;1,2", "{a:1b,,}", "[1b,2s]" }) {
+		bool threw = false;
+		try {
+			delete parse_snbt(bad);
+		}
+		catch (const std::exception&) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+	return g_failures;
+}